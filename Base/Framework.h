@@ -3,6 +3,18 @@
 struct StartupConf
 {
     StartupConf() = delete;
+
+    uint32_t msaa_samples = 4; //clamped to what the device supports, 1 disables MSAA
+    uint32_t device_index = UINT32_MAX; //physical device to use, UINT32_MAX picks the best scored one
+    bool meshlets = true; //meshlet culling, false draws whole objects in instanced batches
+    float gpu_target_ms = 0.0f; //dynamic resolution keeps the GPU frame time under this, 0 renders at full resolution
+
+    //no window, surface or swapchain, frames go to offscreen images and are read back
+    bool headless = false;
+    uint32_t width = 1280; //headless resolution
+    uint32_t height = 720;
+    uint32_t frame_limit = 0; //headless: exit after this many frames, 0 runs until shut down
+    uint32_t benchmark_objects = 0; //headless: fills the scene with a grid of this many cubes
 };
 
 class BaseEXPORT Framework
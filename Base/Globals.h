@@ -28,3 +28,10 @@ constexpr std::size_t countof(T const (&)[N])
 {
     return std::extent<T[N]>::value;
 }
+
+//boost style, order dependent
+template <typename T>
+void HashCombine(std::size_t& seed, const T& value)
+{
+    seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
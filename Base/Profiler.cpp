@@ -0,0 +1,75 @@
+#include "stdafx.h"
+#include "Profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+class ProfilerImpl : public Profiler
+{
+public:
+    ProfilerImpl() : m_start(std::chrono::steady_clock::now()) { m_events.reserve(MAX_EVENTS); }
+
+    virtual void BeginFrame() override { ++m_frame; }
+    virtual uint64_t GetFrame() const override { return m_frame; }
+    virtual double Now() const override;
+
+    virtual void AddEvent(const Event& event) override;
+    virtual std::vector<Event> GetEvents() const override;
+    virtual void Clear() override;
+
+private:
+    const std::chrono::steady_clock::time_point m_start;
+    std::atomic<uint64_t> m_frame{0};
+
+    mutable std::mutex m_mutex{};
+    std::vector<Event> m_events{}; //ring once it's full
+    size_t m_next = 0;
+};
+
+Profiler& Profiler::Instance()
+{
+    static ProfilerImpl profiler;
+    return profiler;
+}
+
+double ProfilerImpl::Now() const
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+void ProfilerImpl::AddEvent(const Event& event)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_events.size() < MAX_EVENTS)
+    {
+        m_events.push_back(event);
+    }
+    else
+    {
+        m_events[m_next] = event;
+    }
+    m_next = (m_next + 1) % MAX_EVENTS;
+}
+
+std::vector<Profiler::Event> ProfilerImpl::GetEvents() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_events.size() < MAX_EVENTS)
+    {
+        return m_events;
+    }
+
+    std::vector<Event> events;
+    events.reserve(MAX_EVENTS);
+    events.insert(events.end(), m_events.begin() + m_next, m_events.end());
+    events.insert(events.end(), m_events.begin(), m_events.begin() + m_next);
+    return events;
+}
+
+void ProfilerImpl::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.clear();
+    m_next = 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+//one timeline for CPU and GPU timings
+//CPU code marks scopes with ProfileScope, the renderer adds its GPU passes once their timestamps
+//have been read back, both end up as events in nanoseconds since the profiler started
+//only the last MAX_EVENTS events are kept
+
+class BaseEXPORT Profiler
+{
+public:
+    enum class Track : uint32_t
+    {
+        CPU,
+        GPU
+    };
+
+    struct Event
+    {
+        std::string name;
+        Track track;
+        uint64_t frame;
+        double begin_ns;
+        double end_ns;
+    };
+
+    static constexpr size_t MAX_EVENTS = 4096;
+
+    static Profiler& Instance();
+
+    virtual void BeginFrame() = 0;
+    virtual uint64_t GetFrame() const = 0;
+    //on the timeline's clock
+    virtual double Now() const = 0;
+
+    //thread safe
+    virtual void AddEvent(const Event& event) = 0;
+    //oldest first
+    virtual std::vector<Event> GetEvents() const = 0;
+    virtual void Clear() = 0;
+
+protected:
+    virtual ~Profiler() = default;
+};
+
+//times the enclosing scope on the CPU track
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name) : m_name(name), m_begin_ns(Profiler::Instance().Now()) {}
+    ~ProfileScope()
+    {
+        Profiler& profiler = Profiler::Instance();
+        profiler.AddEvent({m_name, Profiler::Track::CPU, profiler.GetFrame(), m_begin_ns, profiler.Now()});
+    }
+
+private:
+    const char* m_name;
+    double m_begin_ns;
+};
@@ -2,13 +2,54 @@
 
 #include "MainFramework.h"
 #include <chrono>
+#include <sstream>
 
+#include <Base/Profiler.h>
 #include <Renderer/RendererFramework.h>
 #include <WindowFramework/WindowFramework.h>
 
 StartupConf ParseArgs(const std::string& args)
 {
     StartupConf ret{};
+
+    std::istringstream stream(args);
+    std::string arg;
+    while(stream >> arg)
+    {
+        if(arg == "-msaa")
+        {
+            stream >> ret.msaa_samples;
+        }
+        else if(arg == "-device")
+        {
+            stream >> ret.device_index;
+        }
+        else if(arg == "-nomeshlets")
+        {
+            ret.meshlets = false;
+        }
+        else if(arg == "-gputarget")
+        {
+            stream >> ret.gpu_target_ms;
+        }
+        else if(arg == "-headless")
+        {
+            ret.headless = true;
+        }
+        else if(arg == "-size")
+        {
+            stream >> ret.width >> ret.height;
+        }
+        else if(arg == "-frames")
+        {
+            stream >> ret.frame_limit;
+        }
+        else if(arg == "-benchmark")
+        {
+            stream >> ret.benchmark_objects;
+        }
+    }
+
     return ret;
 }
 
@@ -16,13 +57,25 @@ int MainFramework::Run(const std::string& args)
 {
     StartupConf conf = ParseArgs(args);
 
-    //creation
-    auto&& window_framework = WindowFramework::Create();
-    auto&& renderer_framework = RendererFramework::Create(*window_framework.get());
+    //creation, headless runs without any window
+    std::unique_ptr<WindowFramework> window_framework;
+    std::unique_ptr<RendererFramework> renderer_framework;
+    if(conf.headless)
+    {
+        renderer_framework = RendererFramework::CreateHeadless(conf);
+    }
+    else
+    {
+        window_framework = WindowFramework::Create();
+        renderer_framework = RendererFramework::Create(*window_framework.get(), conf);
+    }
 
     //push into the vector so we can iterate easily
     std::vector<Framework*> frameworks;
-    frameworks.emplace_back(window_framework.get());
+    if(window_framework)
+    {
+        frameworks.emplace_back(window_framework.get());
+    }
     frameworks.emplace_back(renderer_framework.get());
 
     //initialization
@@ -45,6 +98,8 @@ int MainFramework::Run(const std::string& args)
             double delta = std::chrono::duration<double, std::nano>(new_time - current_time).count();
             current_time = new_time;
 
+            Profiler::Instance().BeginFrame();
+
             for(auto&& framework : frameworks)
             {
                 framework->StartUpdate(delta);
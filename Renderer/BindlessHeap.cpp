@@ -0,0 +1,207 @@
+#include "stdafx.h"
+#include "BindlessHeap.h"
+#include "VKUtils.h"
+
+static const vk::DescriptorType DESCRIPTOR_TYPES[] =
+{
+    vk::DescriptorType::eSampledImage,
+    vk::DescriptorType::eStorageBuffer,
+    vk::DescriptorType::eSampler
+};
+
+//the device limits count every set of a pipeline layout, left over for the sets bound next to the heap:
+//GPUScene's draw set and the lighting set take up to 10 storage buffers and one combined image sampler
+static const uint32_t RESERVED_SAMPLED_IMAGES = 4;
+static const uint32_t RESERVED_STORAGE_BUFFERS = 16;
+static const uint32_t RESERVED_SAMPLERS = 4;
+
+static uint32_t LeaveHeadroom(const uint32_t limit, const uint32_t reserved)
+{
+    return (limit > reserved) ? limit - reserved : 0;
+}
+
+void BindlessHeap::Init(const vk::PhysicalDevice physical_device, const vk::Device device, const Limits& limits, const uint32_t frames_in_flight)
+{
+    Assert(physical_device);
+    Assert(device);
+    Assert(frames_in_flight > 0);
+
+    m_device = device;
+
+    const auto& properties_chain = physical_device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingProperties>();
+    const auto& indexing = properties_chain.get<vk::PhysicalDeviceDescriptorIndexingProperties>();
+
+    m_slots[static_cast<size_t>(Type::SampledImage)].capacity = std::min
+    ({
+        limits.max_sampled_images,
+        LeaveHeadroom(indexing.maxDescriptorSetUpdateAfterBindSampledImages, RESERVED_SAMPLED_IMAGES),
+        LeaveHeadroom(indexing.maxPerStageDescriptorUpdateAfterBindSampledImages, RESERVED_SAMPLED_IMAGES)
+    });
+    m_slots[static_cast<size_t>(Type::StorageBuffer)].capacity = std::min
+    ({
+        limits.max_storage_buffers,
+        LeaveHeadroom(indexing.maxDescriptorSetUpdateAfterBindStorageBuffers, RESERVED_STORAGE_BUFFERS),
+        LeaveHeadroom(indexing.maxPerStageDescriptorUpdateAfterBindStorageBuffers, RESERVED_STORAGE_BUFFERS)
+    });
+    m_slots[static_cast<size_t>(Type::Sampler)].capacity = std::min
+    ({
+        limits.max_samplers,
+        LeaveHeadroom(indexing.maxDescriptorSetUpdateAfterBindSamplers, RESERVED_SAMPLERS),
+        LeaveHeadroom(indexing.maxPerStageDescriptorUpdateAfterBindSamplers, RESERVED_SAMPLERS)
+    });
+
+    std::array<vk::DescriptorSetLayoutBinding, TYPE_COUNT> bindings;
+    std::array<vk::DescriptorBindingFlags, TYPE_COUNT> binding_flags;
+    std::array<vk::DescriptorPoolSize, TYPE_COUNT> pool_sizes;
+    for(uint32_t i = 0; i < TYPE_COUNT; ++i)
+    {
+        Assert(m_slots[i].capacity > 0);
+        bindings[i] = vk::DescriptorSetLayoutBinding(i, DESCRIPTOR_TYPES[i], m_slots[i].capacity, vk::ShaderStageFlagBits::eAll);
+        //slots nobody indexes may hold stale or no descriptors, and may be rewritten while other frames are in flight
+        binding_flags[i] =
+            vk::DescriptorBindingFlagBits::eUpdateAfterBind
+            | vk::DescriptorBindingFlagBits::ePartiallyBound
+            | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+        pool_sizes[i] = vk::DescriptorPoolSize(DESCRIPTOR_TYPES[i], m_slots[i].capacity);
+    }
+
+    const vk::DescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info(static_cast<uint32_t>(TYPE_COUNT), binding_flags.data());
+    vk::DescriptorSetLayoutCreateInfo layout_info
+    (
+        vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+        static_cast<uint32_t>(TYPE_COUNT),
+        bindings.data()
+    );
+    layout_info.pNext = &binding_flags_info;
+    m_layout = Get(m_device.createDescriptorSetLayout(layout_info));
+
+    const vk::DescriptorPoolCreateInfo pool_info
+    (
+        vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+        1,
+        static_cast<uint32_t>(TYPE_COUNT),
+        pool_sizes.data()
+    );
+    m_pool = Get(m_device.createDescriptorPool(pool_info));
+
+    const auto& sets = Get(m_device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo(m_pool, 1, &m_layout)));
+    Assert(sets.size() == 1);
+    m_set = sets[0];
+
+    m_retired.resize(frames_in_flight);
+    m_frame_index = 0;
+}
+
+void BindlessHeap::Shutdown()
+{
+    if(!m_device)
+    {
+        return;
+    }
+
+    m_device.destroyDescriptorPool(m_pool);
+    m_device.destroyDescriptorSetLayout(m_layout);
+    m_pool = vk::DescriptorPool();
+    m_layout = vk::DescriptorSetLayout();
+    m_set = vk::DescriptorSet();
+
+    m_slots = {};
+    m_retired.clear();
+    m_device = vk::Device();
+}
+
+void BindlessHeap::BeginFrame(const uint32_t frame_index)
+{
+    Assert(frame_index < m_retired.size());
+    m_frame_index = frame_index;
+
+    //whatever this frame retired last time round is no longer referenced by the GPU
+    for(const auto& retired : m_retired[m_frame_index])
+    {
+        m_slots[static_cast<size_t>(retired.type)].free.push_back(retired.index);
+    }
+    m_retired[m_frame_index].clear();
+}
+
+BindlessHeap::Handle BindlessHeap::AddImage(const vk::ImageView image_view, const vk::ImageLayout layout)
+{
+    Assert(image_view);
+    const Handle handle = Allocate(Type::SampledImage);
+
+    const vk::DescriptorImageInfo image_info({}, image_view, layout);
+    const vk::WriteDescriptorSet write(m_set, 0, handle.index, 1, vk::DescriptorType::eSampledImage, &image_info);
+    m_device.updateDescriptorSets(1, &write, 0, nullptr);
+
+    return handle;
+}
+
+BindlessHeap::Handle BindlessHeap::AddBuffer(const vk::Buffer buffer, const vk::DeviceSize offset, const vk::DeviceSize range)
+{
+    Assert(buffer);
+    const Handle handle = Allocate(Type::StorageBuffer);
+
+    const vk::DescriptorBufferInfo buffer_info(buffer, offset, range);
+    const vk::WriteDescriptorSet write(m_set, 1, handle.index, 1, vk::DescriptorType::eStorageBuffer, nullptr, &buffer_info);
+    m_device.updateDescriptorSets(1, &write, 0, nullptr);
+
+    return handle;
+}
+
+BindlessHeap::Handle BindlessHeap::AddSampler(const vk::Sampler sampler)
+{
+    Assert(sampler);
+    const Handle handle = Allocate(Type::Sampler);
+
+    const vk::DescriptorImageInfo image_info(sampler);
+    const vk::WriteDescriptorSet write(m_set, 2, handle.index, 1, vk::DescriptorType::eSampler, &image_info);
+    m_device.updateDescriptorSets(1, &write, 0, nullptr);
+
+    return handle;
+}
+
+void BindlessHeap::Remove(const Handle handle)
+{
+    Assert(IsValid(handle));
+
+    //bumping the generation invalidates every copy of the handle right away, the slot itself waits for the GPU
+    ++m_slots[static_cast<size_t>(handle.type)].generations[handle.index];
+    m_retired[m_frame_index].push_back({handle.type, handle.index});
+}
+
+bool BindlessHeap::IsValid(const Handle handle) const
+{
+    if(handle.type == Type::Count)
+    {
+        return false;
+    }
+
+    const Slots& slots = m_slots[static_cast<size_t>(handle.type)];
+    return (handle.index < slots.generations.size()) && (slots.generations[handle.index] == handle.generation);
+}
+
+void BindlessHeap::Bind(const vk::CommandBuffer command_buffer, const vk::PipelineBindPoint bind_point, const vk::PipelineLayout pipeline_layout, const uint32_t set) const
+{
+    command_buffer.bindDescriptorSets(bind_point, pipeline_layout, set, m_set, nullptr);
+}
+
+BindlessHeap::Handle BindlessHeap::Allocate(const Type type)
+{
+    Slots& slots = m_slots[static_cast<size_t>(type)];
+
+    Handle handle;
+    handle.type = type;
+    if(!slots.free.empty())
+    {
+        handle.index = slots.free.back();
+        slots.free.pop_back();
+    }
+    else
+    {
+        Assert(slots.generations.size() < slots.capacity);
+        handle.index = static_cast<uint32_t>(slots.generations.size());
+        slots.generations.push_back(0);
+    }
+    handle.generation = slots.generations[handle.index];
+
+    return handle;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+//one global descriptor set holding every sampled image, storage buffer and sampler in
+//update-after-bind arrays, bound once per command buffer
+//shaders index the arrays with Handle::index, the generation catches stale handles on the CPU side
+//slots of removed resources are only reused once the frames that could still read them are done
+
+class BindlessHeap
+{
+public:
+    enum class Type
+    {
+        SampledImage, //binding 0
+        StorageBuffer, //binding 1
+        Sampler, //binding 2
+        Count
+    };
+
+    struct Handle
+    {
+        uint32_t index = UINT32_MAX;
+        uint32_t generation = 0;
+        Type type = Type::Count;
+    };
+
+    struct Limits
+    {
+        uint32_t max_sampled_images;
+        uint32_t max_storage_buffers;
+        uint32_t max_samplers;
+    };
+
+    //limits are clamped to what the device supports, less what the sets bound next to the heap need
+    void Init(const vk::PhysicalDevice physical_device, const vk::Device device, const Limits& limits, const uint32_t frames_in_flight);
+    void Shutdown();
+
+    //frame_index's previous submission must have completed
+    void BeginFrame(const uint32_t frame_index);
+
+    Handle AddImage(const vk::ImageView image_view, const vk::ImageLayout layout);
+    Handle AddBuffer(const vk::Buffer buffer, const vk::DeviceSize offset, const vk::DeviceSize range);
+    Handle AddSampler(const vk::Sampler sampler);
+    void Remove(const Handle handle);
+    bool IsValid(const Handle handle) const;
+
+    void Bind(const vk::CommandBuffer command_buffer, const vk::PipelineBindPoint bind_point, const vk::PipelineLayout pipeline_layout, const uint32_t set) const;
+
+    vk::DescriptorSetLayout GetLayout() const { return m_layout; }
+    uint32_t GetCapacity(const Type type) const { return m_slots[static_cast<size_t>(type)].capacity; }
+
+private:
+    static constexpr size_t TYPE_COUNT = static_cast<size_t>(Type::Count);
+
+    struct Slots
+    {
+        uint32_t capacity = 0;
+        std::vector<uint32_t> generations{}; //one per slot ever handed out
+        std::vector<uint32_t> free{};
+    };
+
+    struct Retired
+    {
+        Type type;
+        uint32_t index;
+    };
+
+    Handle Allocate(const Type type);
+
+    vk::Device m_device{};
+    vk::DescriptorSetLayout m_layout{};
+    vk::DescriptorPool m_pool{};
+    vk::DescriptorSet m_set{};
+
+    std::array<Slots, TYPE_COUNT> m_slots{};
+    std::vector<std::vector<Retired>> m_retired{}; //per frame in flight
+    uint32_t m_frame_index = 0;
+};
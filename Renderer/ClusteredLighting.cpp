@@ -0,0 +1,210 @@
+#include "stdafx.h"
+#include "ClusteredLighting.h"
+#include "DescriptorAllocator.h"
+
+void ClusteredLighting::Init
+(
+    const vk::PhysicalDevice physical_device,
+    const vk::Device device,
+    DescriptorAllocator& descriptor_allocator,
+    const uint32_t max_lights,
+    const uint32_t frames_in_flight,
+    const std::vector<uint32_t>& queue_families
+)
+{
+    Assert(physical_device);
+    Assert(device);
+    Assert(max_lights > 0);
+    Assert(frames_in_flight > 0);
+
+    m_device = device;
+    m_descriptor_allocator = &descriptor_allocator;
+    m_max_lights = max_lights;
+
+    //a light count and a fixed array of light indices per cluster, see ClusterLights.comp
+    m_cluster_buffer = CreateBuffer
+    (
+        physical_device,
+        m_device,
+        sizeof(uint32_t) * (1 + MAX_LIGHTS_PER_CLUSTER) * CLUSTER_COUNT,
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        queue_families
+    );
+
+    //params, lights, clusters, shadow atlas, shadows
+    const vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eFragment;
+    const std::vector<vk::DescriptorSetLayoutBinding> bindings =
+    {
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer, 1, stages),
+        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, stages),
+        vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eStorageBuffer, 1, stages),
+        vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment),
+        vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment)
+    };
+    m_set_layout = descriptor_allocator.GetLayout(bindings);
+
+    const vk::MemoryPropertyFlags host_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    m_frames.resize(frames_in_flight);
+    for(auto& frame : m_frames)
+    {
+        frame.params = CreateBuffer(physical_device, m_device, sizeof(Params), vk::BufferUsageFlagBits::eUniformBuffer, host_flags, queue_families);
+        frame.lights = CreateBuffer(physical_device, m_device, sizeof(GPULight) * m_max_lights, vk::BufferUsageFlagBits::eStorageBuffer, host_flags, queue_families);
+    }
+
+    m_binning_pipeline_layout = Get(m_device.createPipelineLayout(vk::PipelineLayoutCreateInfo({}, 1, &m_set_layout, 0, nullptr)));
+
+    const vk::ShaderModule binning_module = LoadShaderModule(m_device, "./Resources/Shaders/ClusterLights.comp.spv");
+    const vk::ComputePipelineCreateInfo binning_pipeline_info
+    (
+        {},
+        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, binning_module, "main"),
+        m_binning_pipeline_layout
+    );
+    m_binning_pipeline = Get(m_device.createComputePipeline(vk::PipelineCache(), binning_pipeline_info));
+    m_device.destroyShaderModule(binning_module);
+}
+
+void ClusteredLighting::Shutdown()
+{
+    if(!m_device)
+    {
+        return;
+    }
+
+    m_device.destroyPipeline(m_binning_pipeline);
+    m_device.destroyPipelineLayout(m_binning_pipeline_layout);
+    //sets and the layout go with the descriptor allocator
+    m_set_layout = vk::DescriptorSetLayout();
+    m_descriptor_allocator = nullptr;
+    m_atlas_view = vk::ImageView();
+    m_atlas_sampler = vk::Sampler();
+    m_shadow_buffers.clear();
+
+    for(auto& frame : m_frames)
+    {
+        DestroyBuffer(m_device, frame.lights);
+        DestroyBuffer(m_device, frame.params);
+    }
+    m_frames.clear();
+
+    DestroyBuffer(m_device, m_cluster_buffer);
+
+    m_lights.clear();
+    m_device = vk::Device();
+}
+
+uint32_t ClusteredLighting::AddLight(const glm::vec3& position, const float radius, const glm::vec3& colour)
+{
+    Assert(m_lights.size() < m_max_lights);
+
+    const uint32_t light = static_cast<uint32_t>(m_lights.size());
+    m_lights.emplace_back();
+    SetLight(light, position, radius, colour);
+    return light;
+}
+
+void ClusteredLighting::SetLight(const uint32_t light, const glm::vec3& position, const float radius, const glm::vec3& colour)
+{
+    Assert(light < m_lights.size());
+    Assert(radius > 0.0f);
+
+    m_lights[light].position = glm::vec4(position, radius);
+    m_lights[light].colour = colour;
+    MarkDirty(light);
+}
+
+void ClusteredLighting::SetShadow(const uint32_t light, const uint32_t shadow)
+{
+    Assert(light < m_lights.size());
+
+    m_lights[light].shadow = shadow;
+    MarkDirty(light);
+}
+
+void ClusteredLighting::SetShadowAtlas(const vk::ImageView view, const vk::Sampler sampler, const std::vector<vk::Buffer>& shadow_buffers)
+{
+    Assert(view);
+    Assert(sampler);
+    Assert(shadow_buffers.size() == m_frames.size());
+
+    m_atlas_view = view;
+    m_atlas_sampler = sampler;
+    m_shadow_buffers = shadow_buffers;
+}
+
+void ClusteredLighting::SetView(const glm::mat4& view, const glm::mat4& projection, const float near_plane, const float far_plane)
+{
+    Assert((near_plane > 0.0f) && (far_plane > near_plane));
+
+    m_view = view;
+    m_projection = projection;
+    m_near = near_plane;
+    m_far = far_plane;
+}
+
+void ClusteredLighting::Update(const uint32_t frame_index, const vk::Extent2D& extent)
+{
+    Assert(m_atlas_view);
+
+    FrameData& frame = m_frames[frame_index];
+    frame.light_count = static_cast<uint32_t>(m_lights.size());
+
+    //binning and every lit draw of the frame share it
+    DescriptorAllocator::SetDesc desc;
+    desc.layout = m_set_layout;
+    desc.Buffer(0, vk::DescriptorType::eUniformBuffer, frame.params.buffer, 0, VK_WHOLE_SIZE);
+    desc.Buffer(1, vk::DescriptorType::eStorageBuffer, frame.lights.buffer, 0, VK_WHOLE_SIZE);
+    desc.Buffer(2, vk::DescriptorType::eStorageBuffer, m_cluster_buffer.buffer, 0, VK_WHOLE_SIZE);
+    desc.Image(3, vk::DescriptorType::eCombinedImageSampler, m_atlas_view, vk::ImageLayout::eShaderReadOnlyOptimal, m_atlas_sampler);
+    desc.Buffer(4, vk::DescriptorType::eStorageBuffer, m_shadow_buffers[frame_index], 0, VK_WHOLE_SIZE);
+    frame.set = m_descriptor_allocator->GetFrameSet(desc);
+
+    //the previous use of this frame's buffers is done, the frame has been waited on
+    Params params{};
+    params.view = m_view;
+    params.inverse_projection = glm::inverse(m_projection);
+    params.camera_position = glm::inverse(m_view)[3];
+    params.screen_size = glm::vec2(static_cast<float>(extent.width), static_cast<float>(extent.height));
+    params.near_plane = m_near;
+    params.far_plane = m_far;
+    params.light_count = frame.light_count;
+    memcpy(frame.params.mapped, &params, sizeof(Params));
+
+    if(frame.dirty_begin >= frame.dirty_end)
+    {
+        return;
+    }
+
+    memcpy
+    (
+        static_cast<GPULight*>(frame.lights.mapped) + frame.dirty_begin,
+        &m_lights[frame.dirty_begin],
+        (frame.dirty_end - frame.dirty_begin) * sizeof(GPULight)
+    );
+    frame.dirty_begin = UINT32_MAX;
+    frame.dirty_end = 0;
+}
+
+void ClusteredLighting::RecordBinning(const vk::CommandBuffer command_buffer, const uint32_t frame_index) const
+{
+    const FrameData& frame = m_frames[frame_index];
+    if(frame.light_count == 0)
+    {
+        return;
+    }
+
+    //a workgroup per cluster, its invocations split the lights between them
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_binning_pipeline);
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_binning_pipeline_layout, 0, frame.set, nullptr);
+    command_buffer.dispatch(CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+}
+
+void ClusteredLighting::MarkDirty(const uint32_t light)
+{
+    for(auto& frame : m_frames)
+    {
+        frame.dirty_begin = std::min(frame.dirty_begin, light);
+        frame.dirty_end = std::max(frame.dirty_end, light + 1);
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "VKUtils.h"
+
+class DescriptorAllocator;
+
+//clustered forward lighting: the view frustum is cut into CLUSTER_X by CLUSTER_Y screen tiles
+//and CLUSTER_Z exponential depth slices, a compute pass bins every light into the clusters its
+//sphere touches and the fragment shader only loops over the lights of its own cluster
+//the per fragment cost depends on how many lights overlap it, not on how many there are
+//lights are point lights in world space, everything they need is in one descriptor set that
+//the binning pass and the fragment shader share, shadows come from a ShadowAtlas that lights
+//point into
+
+class ClusteredLighting
+{
+public:
+    static constexpr uint32_t CLUSTER_X = 16;
+    static constexpr uint32_t CLUSTER_Y = 9;
+    static constexpr uint32_t CLUSTER_Z = 24;
+    static constexpr uint32_t CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+    //lights past this in a single cluster are dropped, keeps the worst case bounded
+    static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+    static constexpr uint32_t NO_SHADOW = UINT32_MAX;
+
+    //queue_families: every family that binning or drawing runs on
+    void Init
+    (
+        const vk::PhysicalDevice physical_device,
+        const vk::Device device,
+        DescriptorAllocator& descriptor_allocator,
+        const uint32_t max_lights,
+        const uint32_t frames_in_flight,
+        const std::vector<uint32_t>& queue_families
+    );
+    void Shutdown();
+
+    uint32_t AddLight(const glm::vec3& position, const float radius, const glm::vec3& colour);
+    void SetLight(const uint32_t light, const glm::vec3& position, const float radius, const glm::vec3& colour);
+    //shadow is ShadowAtlas::AddLight()'s, kept up to date with the light by the caller
+    void SetShadow(const uint32_t light, const uint32_t shadow);
+    uint32_t GetLightCount() const { return static_cast<uint32_t>(m_lights.size()); }
+    //the atlas and its per frame shadow buffers, has to be set before the first frame is drawn,
+    //a new one is picked up by the next Update()
+    void SetShadowAtlas(const vk::ImageView view, const vk::Sampler sampler, const std::vector<vk::Buffer>& shadow_buffers);
+    //perspective projections only, clusters are built from rays through the tile corners
+    void SetView(const glm::mat4& view, const glm::mat4& projection, const float near_plane, const float far_plane);
+
+    //host side, before the frame is recorded and after DescriptorAllocator::BeginFrame()
+    void Update(const uint32_t frame_index, const vk::Extent2D& extent);
+    //render graph pass, writes the cluster buffer
+    void RecordBinning(const vk::CommandBuffer command_buffer, const uint32_t frame_index) const;
+
+    //set 1 of every pipeline that draws lit
+    vk::DescriptorSetLayout GetSetLayout() const { return m_set_layout; }
+    vk::DescriptorSet GetSet(const uint32_t frame_index) const { return m_frames[frame_index].set; }
+    vk::Buffer GetClusterBuffer() const { return m_cluster_buffer.buffer; }
+
+private:
+    //layouts shared with ClusterLights.comp and Simple.frag
+    struct Params
+    {
+        glm::mat4 view;
+        glm::mat4 inverse_projection;
+        glm::vec4 camera_position;
+        glm::vec2 screen_size;
+        float near_plane;
+        float far_plane;
+        uint32_t light_count;
+        uint32_t pad[3];
+    };
+    static_assert(sizeof(Params) == 176, "Params layout");
+
+    struct GPULight
+    {
+        glm::vec4 position; //world space, w is the radius
+        glm::vec3 colour;
+        uint32_t shadow = NO_SHADOW;
+    };
+    static_assert(sizeof(GPULight) == 32, "GPULight layout");
+
+    struct FrameData
+    {
+        BufferAllocation params{};
+        BufferAllocation lights{};
+        vk::DescriptorSet set{}; //a frame set, from this frame's Update()
+        uint32_t light_count = 0;
+        //lights written since this frame's buffer was last updated
+        uint32_t dirty_begin = UINT32_MAX;
+        uint32_t dirty_end = 0;
+    };
+
+    void MarkDirty(const uint32_t light);
+
+    vk::Device m_device{};
+    DescriptorAllocator* m_descriptor_allocator = nullptr;
+    uint32_t m_max_lights = 0;
+
+    BufferAllocation m_cluster_buffer{};
+    std::vector<FrameData> m_frames{};
+    std::vector<GPULight> m_lights{};
+
+    glm::mat4 m_view{1.0f};
+    glm::mat4 m_projection{1.0f};
+    float m_near = 0.1f;
+    float m_far = 100.0f;
+
+    vk::ImageView m_atlas_view{};
+    vk::Sampler m_atlas_sampler{};
+    std::vector<vk::Buffer> m_shadow_buffers{};
+
+    vk::DescriptorSetLayout m_set_layout{};
+    vk::PipelineLayout m_binning_pipeline_layout{};
+    vk::Pipeline m_binning_pipeline{};
+};
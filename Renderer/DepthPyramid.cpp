@@ -0,0 +1,252 @@
+#include "stdafx.h"
+#include "DepthPyramid.h"
+#include "DescriptorAllocator.h"
+
+static const uint32_t COPY_GROUP_SIZE = 8; //local_size_x and y in DepthPyramidCopy.comp
+static const uint32_t REDUCE_TILE_SIZE = 64; //mip 0 texels per workgroup and axis in DepthPyramid.comp
+
+static uint32_t PreviousPowerOfTwo(const uint32_t value)
+{
+    uint32_t ret = 1;
+    while((ret << 1) <= value)
+    {
+        ret <<= 1;
+    }
+    return ret;
+}
+
+void DepthPyramid::Init
+(
+    const vk::PhysicalDevice physical_device,
+    const vk::Device device,
+    DescriptorAllocator& descriptor_allocator,
+    const vk::Queue queue,
+    const uint32_t queue_family,
+    const vk::ImageView depth_view,
+    const vk::Extent2D& depth_extent,
+    const vk::SampleCountFlagBits depth_samples
+)
+{
+    Assert(physical_device);
+    Assert(device);
+    Assert(depth_view);
+
+    m_device = device;
+    m_depth_extent = depth_extent;
+    m_extent = vk::Extent2D
+    (
+        std::min(PreviousPowerOfTwo(depth_extent.width), MAX_SIZE),
+        std::min(PreviousPowerOfTwo(depth_extent.height), MAX_SIZE)
+    );
+    m_mip_count = 1;
+    while((std::max(m_extent.width, m_extent.height) >> m_mip_count) > 0)
+    {
+        ++m_mip_count;
+    }
+    Assert(m_mip_count <= MAX_MIPS);
+
+    const vk::ImageCreateInfo image_info
+    (
+        {},
+        vk::ImageType::e2D,
+        vk::Format::eR32Sfloat,
+        {m_extent.width, m_extent.height, 1},
+        m_mip_count,
+        1,
+        vk::SampleCountFlagBits::e1,
+        vk::ImageTiling::eOptimal,
+        vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+        vk::SharingMode::eExclusive,
+        0,
+        nullptr,
+        vk::ImageLayout::eUndefined
+    );
+    m_image = Get(m_device.createImage(image_info));
+
+    const auto& mem_reqs = m_device.getImageMemoryRequirements(m_image);
+    const uint32_t memory_type_index = FindMemoryTypeIndex(physical_device.getMemoryProperties(), mem_reqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    Assert(memory_type_index != UINT32_MAX);
+    m_memory = Get(m_device.allocateMemory(vk::MemoryAllocateInfo(mem_reqs.size, memory_type_index)));
+    Assert(m_device.bindImageMemory(m_image, m_memory, 0) == vk::Result::eSuccess);
+
+    const vk::ComponentMapping identity;
+    m_view = Get(m_device.createImageView(vk::ImageViewCreateInfo({}, m_image, vk::ImageViewType::e2D, vk::Format::eR32Sfloat, identity, vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, m_mip_count, 0, 1))));
+    for(uint32_t mip = 0; mip < m_mip_count; ++mip)
+    {
+        const vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, mip, 1, 0, 1);
+        m_mip_views.push_back(Get(m_device.createImageView(vk::ImageViewCreateInfo({}, m_image, vk::ImageViewType::e2D, vk::Format::eR32Sfloat, identity, range))));
+    }
+
+    //culling only ever fetches texels, depth is read with texelFetch too
+    const vk::SamplerCreateInfo sampler_info
+    (
+        {},
+        vk::Filter::eNearest,
+        vk::Filter::eNearest,
+        vk::SamplerMipmapMode::eNearest,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge
+    );
+    m_sampler = Get(m_device.createSampler(sampler_info));
+    m_depth_sampler = Get(m_device.createSampler(sampler_info));
+
+    m_counter = CreateBuffer(physical_device, m_device, sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+    //depth, mip 0
+    const std::vector<vk::DescriptorSetLayoutBinding> copy_bindings =
+    {
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute)
+    };
+    m_copy_set_layout = descriptor_allocator.GetLayout(copy_bindings);
+
+    //every mip, counter
+    const std::vector<vk::DescriptorSetLayoutBinding> reduce_bindings =
+    {
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eStorageImage, MAX_MIPS, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute)
+    };
+    m_reduce_set_layout = descriptor_allocator.GetLayout(reduce_bindings);
+
+    DescriptorAllocator::SetDesc copy_desc;
+    copy_desc.layout = m_copy_set_layout;
+    copy_desc.Image(0, vk::DescriptorType::eCombinedImageSampler, depth_view, vk::ImageLayout::eShaderReadOnlyOptimal, m_depth_sampler);
+    copy_desc.Image(1, vk::DescriptorType::eStorageImage, m_mip_views[0], vk::ImageLayout::eGeneral);
+    m_copy_set = descriptor_allocator.AllocatePersistent(copy_desc);
+
+    //slots past the last mip repeat it, the shader never touches them
+    DescriptorAllocator::SetDesc reduce_desc;
+    reduce_desc.layout = m_reduce_set_layout;
+    for(uint32_t mip = 0; mip < MAX_MIPS; ++mip)
+    {
+        reduce_desc.Image(0, vk::DescriptorType::eStorageImage, m_mip_views[std::min(mip, m_mip_count - 1)], vk::ImageLayout::eGeneral, vk::Sampler(), mip);
+    }
+    reduce_desc.Buffer(1, vk::DescriptorType::eStorageBuffer, m_counter.buffer, 0, VK_WHOLE_SIZE);
+    m_reduce_set = descriptor_allocator.AllocatePersistent(reduce_desc);
+
+    const vk::PushConstantRange copy_push_constants(vk::ShaderStageFlagBits::eCompute, 0, sizeof(uint32_t) * 2);
+    m_copy_pipeline_layout = Get(m_device.createPipelineLayout(vk::PipelineLayoutCreateInfo({}, 1, &m_copy_set_layout, 1, &copy_push_constants)));
+    const vk::PushConstantRange reduce_push_constants(vk::ShaderStageFlagBits::eCompute, 0, sizeof(uint32_t) * 2);
+    m_reduce_pipeline_layout = Get(m_device.createPipelineLayout(vk::PipelineLayoutCreateInfo({}, 1, &m_reduce_set_layout, 1, &reduce_push_constants)));
+
+    //multisampled depth needs a sampler2DMS, the type can't be specialized
+    const char* copy_shader = (depth_samples == vk::SampleCountFlagBits::e1) ? "./Resources/Shaders/DepthPyramidCopy.comp.spv" : "./Resources/Shaders/DepthPyramidCopyMS.comp.spv";
+    const vk::ShaderModule copy_module = LoadShaderModule(m_device, copy_shader);
+    const vk::ComputePipelineCreateInfo copy_pipeline_info
+    (
+        {},
+        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, copy_module, "main"),
+        m_copy_pipeline_layout
+    );
+    m_copy_pipeline = Get(m_device.createComputePipeline(vk::PipelineCache(), copy_pipeline_info));
+    m_device.destroyShaderModule(copy_module);
+
+    const vk::ShaderModule reduce_module = LoadShaderModule(m_device, "./Resources/Shaders/DepthPyramid.comp.spv");
+    const vk::ComputePipelineCreateInfo reduce_pipeline_info
+    (
+        {},
+        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, reduce_module, "main"),
+        m_reduce_pipeline_layout
+    );
+    m_reduce_pipeline = Get(m_device.createComputePipeline(vk::PipelineCache(), reduce_pipeline_info));
+    m_device.destroyShaderModule(reduce_module);
+
+    Clear(queue, queue_family);
+}
+
+void DepthPyramid::Shutdown()
+{
+    if(!m_device)
+    {
+        return;
+    }
+
+    m_device.destroyPipeline(m_reduce_pipeline);
+    m_device.destroyPipeline(m_copy_pipeline);
+    m_device.destroyPipelineLayout(m_reduce_pipeline_layout);
+    m_device.destroyPipelineLayout(m_copy_pipeline_layout);
+    //sets and layouts go with the descriptor allocator
+    m_reduce_set_layout = vk::DescriptorSetLayout();
+    m_copy_set_layout = vk::DescriptorSetLayout();
+
+    DestroyBuffer(m_device, m_counter);
+    m_device.destroySampler(m_depth_sampler);
+    m_device.destroySampler(m_sampler);
+    for(auto& view : m_mip_views)
+    {
+        m_device.destroyImageView(view);
+    }
+    m_mip_views.clear();
+    m_device.destroyImageView(m_view);
+    m_device.destroyImage(m_image);
+    m_device.freeMemory(m_memory);
+
+    m_device = vk::Device();
+}
+
+void DepthPyramid::RecordBuild(const vk::CommandBuffer command_buffer, const vk::Extent2D& rendered_extent) const
+{
+    Assert((rendered_extent.width <= m_depth_extent.width) && (rendered_extent.height <= m_depth_extent.height));
+
+    const uint32_t depth_size[2] = {rendered_extent.width, rendered_extent.height};
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_copy_pipeline);
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_copy_pipeline_layout, 0, m_copy_set, nullptr);
+    command_buffer.pushConstants(m_copy_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(depth_size), depth_size);
+    command_buffer.dispatch((m_extent.width + COPY_GROUP_SIZE - 1) / COPY_GROUP_SIZE, (m_extent.height + COPY_GROUP_SIZE - 1) / COPY_GROUP_SIZE, 1);
+
+    //mip 0 is read back by the reduction, the graph only orders whole passes
+    const vk::MemoryBarrier barrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+    command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+
+    const uint32_t groups_x = (m_extent.width + REDUCE_TILE_SIZE - 1) / REDUCE_TILE_SIZE;
+    const uint32_t groups_y = (m_extent.height + REDUCE_TILE_SIZE - 1) / REDUCE_TILE_SIZE;
+    const uint32_t constants[2] = {m_mip_count, groups_x * groups_y};
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_reduce_pipeline);
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_reduce_pipeline_layout, 0, m_reduce_set, nullptr);
+    command_buffer.pushConstants(m_reduce_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), constants);
+    command_buffer.dispatch(groups_x, groups_y, 1);
+}
+
+void DepthPyramid::Clear(const vk::Queue queue, const uint32_t queue_family) const
+{
+    //the far plane everywhere and a zeroed counter, before any frame can use either
+    SubmitAndWait
+    (
+        m_device,
+        queue,
+        queue_family,
+        [this](const vk::CommandBuffer command_buffer)
+        {
+            const vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, m_mip_count, 0, 1);
+            const vk::ImageMemoryBarrier to_transfer
+            (
+                {},
+                vk::AccessFlagBits::eTransferWrite,
+                vk::ImageLayout::eUndefined,
+                vk::ImageLayout::eTransferDstOptimal,
+                VK_QUEUE_FAMILY_IGNORED,
+                VK_QUEUE_FAMILY_IGNORED,
+                m_image,
+                range
+            );
+            command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, to_transfer);
+
+            command_buffer.clearColorImage(m_image, vk::ImageLayout::eTransferDstOptimal, vk::ClearColorValue(std::array<float, 4>{1.0f, 1.0f, 1.0f, 1.0f}), range);
+            command_buffer.fillBuffer(m_counter.buffer, 0, VK_WHOLE_SIZE, 0);
+
+            const vk::ImageMemoryBarrier to_read
+            (
+                vk::AccessFlagBits::eTransferWrite,
+                vk::AccessFlagBits::eShaderRead,
+                vk::ImageLayout::eTransferDstOptimal,
+                vk::ImageLayout::eShaderReadOnlyOptimal,
+                VK_QUEUE_FAMILY_IGNORED,
+                VK_QUEUE_FAMILY_IGNORED,
+                m_image,
+                range
+            );
+            command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, to_read);
+        }
+    );
+}
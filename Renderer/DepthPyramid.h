@@ -0,0 +1,70 @@
+#pragma once
+
+#include "VKUtils.h"
+
+class DescriptorAllocator;
+
+//hierarchical depth for occlusion culling: an R32F mip chain where every texel holds the farthest
+//depth of the screen area it covers, built at the end of a frame from that frame's depth buffer
+//and tested against by the next frame's culling, with the camera that frame was rendered with
+//mip 0 is the largest power of two that fits in the depth buffer, so every mip halves exactly,
+//and all the mips below it come out of a single dispatch
+//the pyramid starts out at the far plane, nothing is occluded before the first build
+//with dynamic resolution only the top left of the depth buffer holds the frame, the pyramid is
+//built from that part alone so it always covers exactly what the frame saw
+
+class DepthPyramid
+{
+public:
+    static constexpr uint32_t MAX_SIZE = 4096; //two rounds of 64x64 tiles in the single pass downsample
+    static constexpr uint32_t MAX_MIPS = 13;
+
+    //queue is only used once to clear the pyramid, depth_view is sampled by every build
+    void Init
+    (
+        const vk::PhysicalDevice physical_device,
+        const vk::Device device,
+        DescriptorAllocator& descriptor_allocator,
+        const vk::Queue queue,
+        const uint32_t queue_family,
+        const vk::ImageView depth_view,
+        const vk::Extent2D& depth_extent,
+        const vk::SampleCountFlagBits depth_samples
+    );
+    void Shutdown();
+
+    //render graph pass, reads the rendered part of the depth buffer and writes every mip
+    void RecordBuild(const vk::CommandBuffer command_buffer, const vk::Extent2D& rendered_extent) const;
+
+    //between builds the whole chain is in eShaderReadOnlyOptimal
+    vk::Image GetImage() const { return m_image; }
+    vk::ImageView GetView() const { return m_view; }
+    vk::Sampler GetSampler() const { return m_sampler; }
+    vk::Extent2D GetExtent() const { return m_extent; }
+    uint32_t GetMipCount() const { return m_mip_count; }
+
+private:
+    void Clear(const vk::Queue queue, const uint32_t queue_family) const;
+
+    vk::Device m_device{};
+    vk::Extent2D m_extent{};
+    vk::Extent2D m_depth_extent{};
+    uint32_t m_mip_count = 0;
+
+    vk::Image m_image{};
+    vk::DeviceMemory m_memory{};
+    vk::ImageView m_view{}; //all mips, for sampling
+    std::vector<vk::ImageView> m_mip_views{}; //one per mip, for storing
+    vk::Sampler m_sampler{};
+    vk::Sampler m_depth_sampler{};
+    BufferAllocation m_counter{};
+
+    vk::DescriptorSetLayout m_copy_set_layout{};
+    vk::DescriptorSetLayout m_reduce_set_layout{};
+    vk::DescriptorSet m_copy_set{};
+    vk::DescriptorSet m_reduce_set{};
+    vk::PipelineLayout m_copy_pipeline_layout{};
+    vk::PipelineLayout m_reduce_pipeline_layout{};
+    vk::Pipeline m_copy_pipeline{};
+    vk::Pipeline m_reduce_pipeline{};
+};
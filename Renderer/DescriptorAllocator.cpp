@@ -0,0 +1,244 @@
+#include "stdafx.h"
+#include "DescriptorAllocator.h"
+#include "VKUtils.h"
+
+static const uint32_t FIRST_POOL_SETS = 64;
+static const uint32_t MAX_POOL_SETS = 4096;
+
+//descriptors of each type per set a pool is sized for
+static const std::pair<vk::DescriptorType, uint32_t> POOL_RATIOS[] =
+{
+    {vk::DescriptorType::eUniformBuffer, 2},
+    {vk::DescriptorType::eUniformBufferDynamic, 1},
+    {vk::DescriptorType::eStorageBuffer, 2},
+    {vk::DescriptorType::eStorageBufferDynamic, 1},
+    {vk::DescriptorType::eCombinedImageSampler, 2},
+    {vk::DescriptorType::eSampledImage, 2},
+    {vk::DescriptorType::eSampler, 1},
+    {vk::DescriptorType::eStorageImage, 1},
+    {vk::DescriptorType::eUniformTexelBuffer, 1},
+    {vk::DescriptorType::eStorageTexelBuffer, 1},
+    {vk::DescriptorType::eInputAttachment, 1}
+};
+
+DescriptorAllocator::SetDesc& DescriptorAllocator::SetDesc::Buffer(const uint32_t binding, const vk::DescriptorType type, const vk::Buffer buffer, const vk::DeviceSize offset, const vk::DeviceSize range)
+{
+    writes.push_back({binding, 0, type, vk::DescriptorBufferInfo(buffer, offset, range), vk::DescriptorImageInfo()});
+    return *this;
+}
+
+DescriptorAllocator::SetDesc& DescriptorAllocator::SetDesc::Image(const uint32_t binding, const vk::DescriptorType type, const vk::ImageView image_view, const vk::ImageLayout layout, const vk::Sampler sampler, const uint32_t element)
+{
+    writes.push_back({binding, element, type, vk::DescriptorBufferInfo(), vk::DescriptorImageInfo(sampler, image_view, layout)});
+    return *this;
+}
+
+void DescriptorAllocator::Init(const vk::Device device, const uint32_t frames_in_flight)
+{
+    Assert(device);
+    Assert(frames_in_flight > 0);
+
+    m_device = device;
+    m_frames.resize(frames_in_flight);
+    m_frame_index = 0;
+}
+
+void DescriptorAllocator::Shutdown()
+{
+    if(!m_device)
+    {
+        return;
+    }
+
+    for(auto& frame : m_frames)
+    {
+        for(auto& pool : frame.pools.pools)
+        {
+            m_device.destroyDescriptorPool(pool);
+        }
+    }
+    m_frames.clear();
+
+    for(auto& pool : m_persistent.pools)
+    {
+        m_device.destroyDescriptorPool(pool);
+    }
+    m_persistent = PoolChain();
+
+    for(auto& layout : m_layouts)
+    {
+        m_device.destroyDescriptorSetLayout(layout.second);
+    }
+    m_layouts.clear();
+
+    m_device = vk::Device();
+}
+
+void DescriptorAllocator::BeginFrame(const uint32_t frame_index)
+{
+    Assert(frame_index < m_frames.size());
+    m_frame_index = frame_index;
+
+    FrameData& frame = m_frames[m_frame_index];
+    for(auto& pool : frame.pools.pools)
+    {
+        Assert(m_device.resetDescriptorPool(pool) == vk::Result::eSuccess);
+    }
+    frame.pools.current = 0;
+    frame.sets.clear();
+}
+
+vk::DescriptorSetLayout DescriptorAllocator::GetLayout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings)
+{
+    //binding order doesn't matter to Vulkan, it shouldn't matter to the cache either
+    std::vector<vk::DescriptorSetLayoutBinding> key = bindings;
+    std::sort(key.begin(), key.end(), [](const auto& a, const auto& b) { return a.binding < b.binding; });
+
+    const auto found = m_layouts.find(key);
+    if(found != m_layouts.end())
+    {
+        return found->second;
+    }
+
+    const vk::DescriptorSetLayoutCreateInfo layout_info({}, static_cast<uint32_t>(key.size()), key.data());
+    const vk::DescriptorSetLayout layout = Get(m_device.createDescriptorSetLayout(layout_info));
+    m_layouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+vk::DescriptorSet DescriptorAllocator::AllocatePersistent(const SetDesc& desc)
+{
+    const vk::DescriptorSet set = Allocate(m_persistent, desc.layout);
+    WriteSet(set, desc);
+    return set;
+}
+
+vk::DescriptorSet DescriptorAllocator::GetFrameSet(const SetDesc& desc)
+{
+    FrameData& frame = m_frames[m_frame_index];
+
+    const auto found = frame.sets.find(desc);
+    if(found != frame.sets.end())
+    {
+        return found->second;
+    }
+
+    const vk::DescriptorSet set = Allocate(frame.pools, desc.layout);
+    WriteSet(set, desc);
+    frame.sets.emplace(desc, set);
+    return set;
+}
+
+size_t DescriptorAllocator::LayoutKeyHash::operator()(const std::vector<vk::DescriptorSetLayoutBinding>& bindings) const
+{
+    size_t seed = 0;
+    for(const auto& binding : bindings)
+    {
+        HashCombine(seed, binding.binding);
+        HashCombine(seed, binding.descriptorType);
+        HashCombine(seed, binding.descriptorCount);
+        HashCombine(seed, static_cast<VkShaderStageFlags>(binding.stageFlags));
+        HashCombine(seed, binding.pImmutableSamplers);
+    }
+    return seed;
+}
+
+size_t DescriptorAllocator::SetDescHash::operator()(const SetDesc& desc) const
+{
+    size_t seed = 0;
+    HashCombine(seed, static_cast<VkDescriptorSetLayout>(desc.layout));
+    for(const auto& write : desc.writes)
+    {
+        HashCombine(seed, write.binding);
+        HashCombine(seed, write.element);
+        HashCombine(seed, write.type);
+        HashCombine(seed, static_cast<VkBuffer>(write.buffer.buffer));
+        HashCombine(seed, write.buffer.offset);
+        HashCombine(seed, write.buffer.range);
+        HashCombine(seed, static_cast<VkImageView>(write.image.imageView));
+        HashCombine(seed, static_cast<VkSampler>(write.image.sampler));
+        HashCombine(seed, write.image.imageLayout);
+    }
+    return seed;
+}
+
+bool DescriptorAllocator::SetDescEqual::operator()(const SetDesc& a, const SetDesc& b) const
+{
+    return (a.layout == b.layout) && std::equal
+    (
+        a.writes.begin(),
+        a.writes.end(),
+        b.writes.begin(),
+        b.writes.end(),
+        [](const SetDesc::Write& x, const SetDesc::Write& y)
+        {
+            return (x.binding == y.binding) && (x.element == y.element) && (x.type == y.type) && (x.buffer == y.buffer) && (x.image == y.image);
+        }
+    );
+}
+
+vk::DescriptorSet DescriptorAllocator::Allocate(PoolChain& chain, const vk::DescriptorSetLayout layout)
+{
+    Assert(layout);
+
+    for(;;)
+    {
+        const bool new_pool = chain.current == chain.pools.size();
+        if(new_pool)
+        {
+            const uint32_t max_sets = std::min(FIRST_POOL_SETS << std::min<size_t>(chain.pools.size(), 6), MAX_POOL_SETS);
+            chain.pools.push_back(CreatePool(max_sets));
+        }
+
+        vk::DescriptorSet set;
+        const vk::DescriptorSetAllocateInfo allocate_info(chain.pools[chain.current], 1, &layout);
+        const vk::Result result = m_device.allocateDescriptorSets(&allocate_info, &set);
+        if(result == vk::Result::eSuccess)
+        {
+            return set;
+        }
+
+        //this pool is used up, move on to the next one or grow the chain
+        Assert((result == vk::Result::eErrorOutOfPoolMemory) || (result == vk::Result::eErrorFragmentedPool));
+        Assert(!new_pool); //the layout needs more than a whole pool holds
+        ++chain.current;
+    }
+}
+
+vk::DescriptorPool DescriptorAllocator::CreatePool(const uint32_t max_sets)
+{
+    std::array<vk::DescriptorPoolSize, countof(POOL_RATIOS)> pool_sizes;
+    for(size_t i = 0; i < pool_sizes.size(); ++i)
+    {
+        pool_sizes[i] = vk::DescriptorPoolSize(POOL_RATIOS[i].first, POOL_RATIOS[i].second * max_sets);
+    }
+
+    const vk::DescriptorPoolCreateInfo pool_info({}, max_sets, static_cast<uint32_t>(pool_sizes.size()), pool_sizes.data());
+    return Get(m_device.createDescriptorPool(pool_info));
+}
+
+void DescriptorAllocator::WriteSet(const vk::DescriptorSet set, const SetDesc& desc)
+{
+    std::vector<vk::WriteDescriptorSet> writes;
+    writes.reserve(desc.writes.size());
+    for(const auto& write : desc.writes)
+    {
+        const bool is_buffer =
+            (write.type == vk::DescriptorType::eUniformBuffer)
+            || (write.type == vk::DescriptorType::eUniformBufferDynamic)
+            || (write.type == vk::DescriptorType::eStorageBuffer)
+            || (write.type == vk::DescriptorType::eStorageBufferDynamic);
+
+        writes.emplace_back
+        (
+            set,
+            write.binding,
+            write.element,
+            1,
+            write.type,
+            is_buffer ? nullptr : &write.image,
+            is_buffer ? &write.buffer : nullptr
+        );
+    }
+    m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <unordered_map>
+
+//descriptor sets for everything that doesn't go through the bindless heap
+//- layouts are cached by their bindings, asking twice returns the same layout
+//- persistent sets come from pools that grow on demand and live until Shutdown()
+//- frame sets come from per-frame pools that are reset in bulk, identical contents
+//  requested again in the same frame return the already written set
+
+class DescriptorAllocator
+{
+public:
+    //what gets written into a set, also the key for deduplication
+    struct SetDesc
+    {
+        struct Write
+        {
+            uint32_t binding;
+            uint32_t element; //for array bindings
+            vk::DescriptorType type;
+            vk::DescriptorBufferInfo buffer;
+            vk::DescriptorImageInfo image;
+        };
+
+        SetDesc& Buffer(const uint32_t binding, const vk::DescriptorType type, const vk::Buffer buffer, const vk::DeviceSize offset, const vk::DeviceSize range);
+        SetDesc& Image(const uint32_t binding, const vk::DescriptorType type, const vk::ImageView image_view, const vk::ImageLayout layout, const vk::Sampler sampler = {}, const uint32_t element = 0);
+
+        vk::DescriptorSetLayout layout{};
+        std::vector<Write> writes{};
+    };
+
+    void Init(const vk::Device device, const uint32_t frames_in_flight);
+    void Shutdown();
+
+    //frame_index's previous submission must have completed, its sets are recycled
+    void BeginFrame(const uint32_t frame_index);
+
+    vk::DescriptorSetLayout GetLayout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings);
+    vk::DescriptorSet AllocatePersistent(const SetDesc& desc);
+    vk::DescriptorSet GetFrameSet(const SetDesc& desc);
+
+private:
+    struct LayoutKeyHash
+    {
+        size_t operator()(const std::vector<vk::DescriptorSetLayoutBinding>& bindings) const;
+    };
+
+    struct SetDescHash
+    {
+        size_t operator()(const SetDesc& desc) const;
+    };
+
+    struct SetDescEqual
+    {
+        bool operator()(const SetDesc& a, const SetDesc& b) const;
+    };
+
+    //a chain of pools, each one twice the size of the previous
+    struct PoolChain
+    {
+        std::vector<vk::DescriptorPool> pools{};
+        uint32_t current = 0;
+    };
+
+    vk::DescriptorSet Allocate(PoolChain& chain, const vk::DescriptorSetLayout layout);
+    vk::DescriptorPool CreatePool(const uint32_t max_sets);
+    void WriteSet(const vk::DescriptorSet set, const SetDesc& desc);
+
+    vk::Device m_device{};
+
+    std::unordered_map<std::vector<vk::DescriptorSetLayoutBinding>, vk::DescriptorSetLayout, LayoutKeyHash> m_layouts{};
+
+    PoolChain m_persistent{};
+    struct FrameData
+    {
+        PoolChain pools{};
+        std::unordered_map<SetDesc, vk::DescriptorSet, SetDescHash, SetDescEqual> sets{};
+    };
+    std::vector<FrameData> m_frames{};
+    uint32_t m_frame_index = 0;
+};
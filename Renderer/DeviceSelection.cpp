@@ -0,0 +1,164 @@
+#include "stdafx.h"
+#include "DeviceSelection.h"
+#include "VKUtils.h"
+
+#include <cstring>
+
+static uint64_t TypeWeight(const vk::PhysicalDeviceType type)
+{
+    switch(type)
+    {
+        case vk::PhysicalDeviceType::eDiscreteGpu:
+            return 4;
+        case vk::PhysicalDeviceType::eIntegratedGpu:
+            return 3;
+        case vk::PhysicalDeviceType::eVirtualGpu:
+            return 2;
+        case vk::PhysicalDeviceType::eCpu: //software rasterizers, only if nothing else works
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static bool HasExtension(const std::vector<vk::ExtensionProperties>& extensions, const char* name)
+{
+    return std::any_of(extensions.begin(), extensions.end(), [name](const auto& extension) { return strcmp(extension.extensionName, name) == 0; });
+}
+
+DeviceCapabilities QueryDeviceCapabilities(const vk::PhysicalDevice physical_device, const vk::SurfaceKHR surface)
+{
+    Assert(physical_device);
+
+    DeviceCapabilities caps;
+
+    if(physical_device.getProperties().apiVersion < VK_API_VERSION_1_2)
+    {
+        return caps;
+    }
+    //without a surface nothing is presented, headless rendering doesn't need a swapchain
+    if(surface && !HasExtension(Get(physical_device.enumerateDeviceExtensionProperties()), VK_KHR_SWAPCHAIN_EXTENSION_NAME))
+    {
+        return caps;
+    }
+
+    bool graphics = false;
+    bool present = false;
+    bool graphics_timestamps = false;
+    const auto& queue_family_properties = physical_device.getQueueFamilyProperties();
+    for(uint32_t i = 0; i < queue_family_properties.size(); ++i)
+    {
+        const vk::QueueFlags flags = queue_family_properties[i].queueFlags;
+        graphics |= static_cast<bool>(flags & vk::QueueFlagBits::eGraphics);
+        graphics_timestamps |= (flags & vk::QueueFlagBits::eGraphics) && (queue_family_properties[i].timestampValidBits > 0);
+        present |= !surface || (Get(physical_device.getSurfaceSupportKHR(i, surface)) == VK_TRUE);
+        if(!(flags & vk::QueueFlagBits::eGraphics))
+        {
+            caps.async_compute |= static_cast<bool>(flags & vk::QueueFlagBits::eCompute);
+            caps.dedicated_transfer |= static_cast<bool>(flags & (vk::QueueFlagBits::eTransfer | vk::QueueFlagBits::eCompute));
+        }
+    }
+    if(!graphics || !present)
+    {
+        caps.async_compute = false;
+        caps.dedicated_transfer = false;
+        return caps;
+    }
+
+    const auto& chain = physical_device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+    const auto& features = chain.get<vk::PhysicalDeviceFeatures2>().features;
+    const auto& features_12 = chain.get<vk::PhysicalDeviceVulkan12Features>();
+
+    //the GPU scene draws every batch with one indirect call, firstInstance is where its instances start
+    if(!features.multiDrawIndirect || !features.drawIndirectFirstInstance || !features_12.timelineSemaphore)
+    {
+        caps.async_compute = false;
+        caps.dedicated_transfer = false;
+        return caps;
+    }
+    caps.tier = DeviceTier::Baseline;
+    caps.timestamps = graphics_timestamps && features_12.hostQueryReset && (physical_device.getProperties().limits.timestampPeriod > 0.0f);
+
+    if(!features_12.drawIndirectCount)
+    {
+        return caps;
+    }
+    caps.tier = DeviceTier::IndirectCount;
+
+    const bool bindless =
+        features_12.descriptorIndexing
+        && features_12.runtimeDescriptorArray
+        && features_12.descriptorBindingPartiallyBound
+        && features_12.descriptorBindingUpdateUnusedWhilePending
+        && features_12.descriptorBindingSampledImageUpdateAfterBind
+        && features_12.descriptorBindingStorageBufferUpdateAfterBind
+        && features_12.shaderSampledImageArrayNonUniformIndexing
+        && features_12.shaderStorageBufferArrayNonUniformIndexing;
+    if(bindless)
+    {
+        caps.tier = DeviceTier::Bindless;
+    }
+
+    return caps;
+}
+
+uint64_t ScoreDevice(const vk::PhysicalDevice physical_device, const DeviceCapabilities& caps)
+{
+    Assert(physical_device);
+
+    if(!caps.Has(DeviceTier::Baseline))
+    {
+        return 0;
+    }
+
+    const auto& properties = physical_device.getProperties();
+    const auto& mem_properties = physical_device.getMemoryProperties();
+
+    vk::DeviceSize device_local = 0;
+    for(uint32_t i = 0; i < mem_properties.memoryHeapCount; ++i)
+    {
+        if(mem_properties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+        {
+            device_local += mem_properties.memoryHeaps[i].size;
+        }
+    }
+    const uint64_t device_local_mb = std::min<uint64_t>(device_local >> 20, 0xFFFFFFFF);
+    const uint64_t queues = (caps.async_compute ? 2 : 0) + (caps.dedicated_transfer ? 1 : 0);
+    const uint64_t image_size = std::min<uint64_t>(properties.limits.maxImageDimension2D >> 10, 0x1FFF);
+
+    //type, tier, memory, queues, limits: each field only breaks ties of the ones above it
+    return
+        (TypeWeight(properties.deviceType) << 56)
+        | (static_cast<uint64_t>(caps.tier) << 48)
+        | (device_local_mb << 16)
+        | (queues << 13)
+        | image_size;
+}
+
+DeviceCandidate SelectPhysicalDevice(const vk::Instance instance, const vk::SurfaceKHR surface, const uint32_t device_index)
+{
+    Assert(instance);
+
+    const auto& physical_devices = Get(instance.enumeratePhysicalDevices());
+    Assert(!physical_devices.empty());
+
+    std::vector<DeviceCandidate> candidates;
+    for(const auto& physical_device : physical_devices)
+    {
+        DeviceCandidate candidate;
+        candidate.physical_device = physical_device;
+        candidate.caps = QueryDeviceCapabilities(physical_device, surface);
+        candidate.score = ScoreDevice(physical_device, candidate.caps);
+        candidates.push_back(candidate);
+    }
+
+    //an override that can't run the renderer falls back to scoring
+    if((device_index < candidates.size()) && (candidates[device_index].score > 0))
+    {
+        return candidates[device_index];
+    }
+
+    const auto best = std::max_element(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.score < b.score; });
+    Assert(best->score > 0);
+    return *best;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+//picks the physical device the renderer runs on instead of whatever enumerates first
+//devices missing something the renderer can't do without are never picked, the rest are
+//scored on type, capability tier, device local memory and limits, in that order
+//the tier is what the renderer looks at to choose between its paths
+
+//cumulative, every tier has everything the tiers below it have
+enum class DeviceTier : uint32_t
+{
+    Unsupported,
+    Baseline, //Vulkan 1.2, timeline semaphores, multi draw indirect with firstInstance
+    IndirectCount, //GPU culling writes the draw count itself
+    Bindless //descriptor indexing with update-after-bind arrays
+};
+
+struct DeviceCapabilities
+{
+    DeviceTier tier = DeviceTier::Unsupported;
+    bool async_compute = false; //has a compute family without graphics
+    bool dedicated_transfer = false; //has a transfer family without graphics
+    bool timestamps = false; //graphics timestamps with host query reset, for the GPU profiler
+
+    bool Has(const DeviceTier required) const { return tier >= required; }
+};
+
+struct DeviceCandidate
+{
+    vk::PhysicalDevice physical_device{};
+    DeviceCapabilities caps{};
+    uint64_t score = 0; //0 for unsupported devices
+};
+
+DeviceCapabilities QueryDeviceCapabilities(const vk::PhysicalDevice physical_device, const vk::SurfaceKHR surface);
+uint64_t ScoreDevice(const vk::PhysicalDevice physical_device, const DeviceCapabilities& caps);
+
+//device_index is an index into the enumerated devices and wins over the scores as long as the
+//device is supported, UINT32_MAX takes the best scored one
+DeviceCandidate SelectPhysicalDevice(const vk::Instance instance, const vk::SurfaceKHR surface, const uint32_t device_index);
@@ -0,0 +1,111 @@
+#include "stdafx.h"
+#include "DrawConstants.h"
+#include "DescriptorAllocator.h"
+
+void DrawConstants::Init
+(
+    const vk::PhysicalDevice physical_device,
+    const vk::Device device,
+    DescriptorAllocator& descriptor_allocator,
+    const uint32_t size,
+    const vk::ShaderStageFlags stages,
+    const uint32_t frames_in_flight,
+    const uint32_t max_draws
+)
+{
+    Assert(physical_device);
+    Assert(device);
+    Assert(size > 0);
+    Assert(frames_in_flight > 0);
+
+    m_device = device;
+    m_size = size;
+    m_stages = stages;
+
+    const vk::PhysicalDeviceLimits& limits = physical_device.getProperties().limits;
+    m_push_constants = (size <= limits.maxPushConstantsSize);
+    if(m_push_constants)
+    {
+        //keeps set 1 and up where the shaders expect them
+        m_set_layout = descriptor_allocator.GetLayout({});
+        return;
+    }
+
+    const vk::DescriptorSetLayoutBinding binding(0, vk::DescriptorType::eUniformBufferDynamic, 1, stages);
+    m_set_layout = descriptor_allocator.GetLayout({binding});
+
+    const vk::DeviceSize alignment = limits.minUniformBufferOffsetAlignment;
+    m_slot_size = (size + alignment - 1) / alignment * alignment;
+    m_max_draws = max_draws;
+
+    const vk::MemoryPropertyFlags host_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    m_frames.resize(frames_in_flight);
+    for(auto& frame : m_frames)
+    {
+        frame.ring = CreateBuffer(physical_device, m_device, m_slot_size * m_max_draws, vk::BufferUsageFlagBits::eUniformBuffer, host_flags);
+
+        DescriptorAllocator::SetDesc desc;
+        desc.layout = m_set_layout;
+        desc.Buffer(0, vk::DescriptorType::eUniformBufferDynamic, frame.ring.buffer, 0, m_size);
+        frame.set = descriptor_allocator.AllocatePersistent(desc);
+    }
+}
+
+void DrawConstants::Shutdown()
+{
+    if(!m_device)
+    {
+        return;
+    }
+
+    //sets and the layout go with the descriptor allocator
+    for(auto& frame : m_frames)
+    {
+        DestroyBuffer(m_device, frame.ring);
+    }
+    m_frames.clear();
+    m_set_layout = vk::DescriptorSetLayout();
+
+    m_device = vk::Device();
+}
+
+vk::PipelineLayout DrawConstants::CreatePipelineLayout(const std::vector<vk::DescriptorSetLayout>& set_layouts) const
+{
+    Assert(m_device);
+
+    std::vector<vk::DescriptorSetLayout> all_set_layouts;
+    all_set_layouts.push_back(m_set_layout);
+    all_set_layouts.insert(all_set_layouts.end(), set_layouts.begin(), set_layouts.end());
+
+    const vk::PushConstantRange push_constants(m_stages, 0, m_size);
+    const vk::PipelineLayoutCreateInfo layout_info
+    (
+        {},
+        static_cast<uint32_t>(all_set_layouts.size()),
+        all_set_layouts.data(),
+        m_push_constants ? 1 : 0,
+        m_push_constants ? &push_constants : nullptr
+    );
+    return Get(m_device.createPipelineLayout(layout_info));
+}
+
+void DrawConstants::BeginFrame(const uint32_t frame_index)
+{
+    m_frame_index = frame_index;
+    m_next_slot = 0;
+}
+
+void DrawConstants::Record(const vk::CommandBuffer command_buffer, const vk::PipelineLayout layout, const void* data)
+{
+    if(m_push_constants)
+    {
+        command_buffer.pushConstants(layout, m_stages, 0, m_size, data);
+        return;
+    }
+
+    Assert(m_next_slot < m_max_draws);
+    const FrameData& frame = m_frames[m_frame_index];
+    const uint32_t offset = static_cast<uint32_t>(m_slot_size * m_next_slot++);
+    memcpy(static_cast<uint8_t*>(frame.ring.mapped) + offset, data, m_size);
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, frame.set, offset);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "VKUtils.h"
+
+class DescriptorAllocator;
+
+//small per draw data, a transform or a few parameters that change with every draw
+//push constants when the data fits the device's maxPushConstantsSize, nothing is written to
+//memory and no descriptor offset changes between draws
+//larger data goes to a per frame uniform ring instead, every draw writes its copy to the next
+//aligned slot and rebinds the ring's set with a dynamic offset
+//pipeline layouts come from CreatePipelineLayout() so they carry whichever of the two is in use:
+//set 0 is the ring's in ring mode and empty otherwise, the caller's sets follow it
+//shaders read the data as
+//    layout(push_constant) uniform ...                     with UsesPushConstants()
+//    layout(set = 0, binding = 0) uniform ...              without
+
+class DrawConstants
+{
+public:
+    //max_draws: per frame, only sizes the ring
+    void Init
+    (
+        const vk::PhysicalDevice physical_device,
+        const vk::Device device,
+        DescriptorAllocator& descriptor_allocator,
+        const uint32_t size,
+        const vk::ShaderStageFlags stages,
+        const uint32_t frames_in_flight,
+        const uint32_t max_draws
+    );
+    void Shutdown();
+
+    bool UsesPushConstants() const { return m_push_constants; }
+    uint32_t GetSize() const { return m_size; }
+    //set_layouts become sets 1 and up, the caller destroys the layout
+    vk::PipelineLayout CreatePipelineLayout(const std::vector<vk::DescriptorSetLayout>& set_layouts) const;
+
+    //frame_index's previous submission must have completed, its ring slots are reused
+    void BeginFrame(const uint32_t frame_index);
+    //size bytes of data for the next draw, layout has to come from CreatePipelineLayout()
+    void Record(const vk::CommandBuffer command_buffer, const vk::PipelineLayout layout, const void* data);
+
+private:
+    struct FrameData
+    {
+        BufferAllocation ring{};
+        vk::DescriptorSet set{};
+    };
+
+    vk::Device m_device{};
+    uint32_t m_size = 0;
+    vk::ShaderStageFlags m_stages{};
+    bool m_push_constants = false;
+
+    vk::DescriptorSetLayout m_set_layout{}; //owned by the descriptor allocator
+    vk::DeviceSize m_slot_size = 0; //size aligned to minUniformBufferOffsetAlignment
+    uint32_t m_max_draws = 0;
+    std::vector<FrameData> m_frames{};
+    uint32_t m_frame_index = 0;
+    uint32_t m_next_slot = 0;
+};
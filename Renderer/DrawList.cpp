@@ -0,0 +1,158 @@
+#include "stdafx.h"
+#include "DrawList.h"
+#include "DrawConstants.h"
+
+void DrawList::Init(const uint32_t thread_count, const uint32_t sort_threads)
+{
+    Assert(thread_count > 0);
+    Assert(sort_threads > 0);
+
+    m_buckets.clear();
+    m_buckets.resize(thread_count);
+    m_sort.Init(sort_threads);
+}
+
+uint64_t DrawList::MakeKey
+(
+    const uint32_t pass,
+    const uint32_t layer,
+    const uint32_t pipeline,
+    const uint32_t material,
+    const float depth,
+    const bool back_to_front
+)
+{
+    Assert(pass < (1u << PASS_BITS));
+    Assert(layer < (1u << LAYER_BITS));
+    Assert(pipeline < (1u << PIPELINE_BITS));
+    Assert(material < (1u << MATERIAL_BITS));
+
+    //non-negative floats order like their bit patterns, the top bits keep the exponent and 15 bits of mantissa
+    const float clamped = (depth > 0.0f) ? depth : 0.0f;
+    uint32_t depth_bits = 0;
+    memcpy(&depth_bits, &clamped, sizeof(depth_bits));
+    uint64_t depth_key = depth_bits >> (32 - DEPTH_BITS);
+    if(back_to_front)
+    {
+        depth_key = ((1u << DEPTH_BITS) - 1) - depth_key;
+    }
+
+    return (static_cast<uint64_t>(pass) << (LAYER_BITS + PIPELINE_BITS + MATERIAL_BITS + DEPTH_BITS))
+        | (static_cast<uint64_t>(layer) << (PIPELINE_BITS + MATERIAL_BITS + DEPTH_BITS))
+        | (static_cast<uint64_t>(pipeline) << (MATERIAL_BITS + DEPTH_BITS))
+        | (static_cast<uint64_t>(material) << DEPTH_BITS)
+        | depth_key;
+}
+
+void DrawList::Reset()
+{
+    for(auto& bucket : m_buckets)
+    {
+        bucket.draws.clear();
+        bucket.constants.clear();
+    }
+    m_sorted.clear();
+}
+
+void DrawList::Submit(const uint32_t thread, const Draw& draw, const void* constants)
+{
+    Assert(thread < m_buckets.size());
+    Assert(!draw.constants || constants);
+
+    Bucket& bucket = m_buckets[thread];
+    const uint32_t constants_offset = static_cast<uint32_t>(bucket.constants.size());
+    if(draw.constants)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(constants);
+        bucket.constants.insert(bucket.constants.end(), bytes, bytes + draw.constants->GetSize());
+    }
+    bucket.draws.push_back({draw, constants_offset});
+}
+
+void DrawList::Sort()
+{
+    m_sorted.clear();
+    for(uint32_t b = 0; b < m_buckets.size(); ++b)
+    {
+        const auto& draws = m_buckets[b].draws;
+        for(uint32_t d = 0; d < draws.size(); ++d)
+        {
+            m_sorted.push_back({draws[d].draw.key, (static_cast<uint64_t>(b) << 32) | d});
+        }
+    }
+    m_sort.Sort(m_sorted);
+}
+
+void DrawList::Record
+(
+    const vk::CommandBuffer command_buffer,
+    const PipelineManager& pipelines,
+    const uint32_t material_set,
+    const std::function<void(uint32_t pass, uint32_t layer)>& begin_layer
+) const
+{
+    const uint32_t layer_shift = 64 - PASS_BITS - LAYER_BITS;
+    uint64_t current_layer = UINT64_MAX;
+    PipelineManager::Handle current_pipeline = PipelineManager::INVALID_HANDLE;
+    bool pipeline_ready = false;
+    vk::DescriptorSet current_material{};
+    vk::Buffer current_vertex_buffer{};
+    vk::Buffer current_index_buffer{};
+
+    for(const auto& entry : m_sorted)
+    {
+        const Bucket& bucket = m_buckets[entry.value >> 32];
+        const Submitted& submitted = bucket.draws[static_cast<uint32_t>(entry.value)];
+        const Draw& draw = submitted.draw;
+
+        const uint64_t layer = entry.key >> layer_shift;
+        if(layer != current_layer)
+        {
+            current_layer = layer;
+            if(begin_layer)
+            {
+                begin_layer(static_cast<uint32_t>(layer >> LAYER_BITS), static_cast<uint32_t>(layer & ((1u << LAYER_BITS) - 1)));
+            }
+        }
+
+        if(draw.pipeline != current_pipeline)
+        {
+            //layouts can differ, the material set has to be bound again
+            current_pipeline = draw.pipeline;
+            current_material = vk::DescriptorSet();
+            const vk::Pipeline pipeline = pipelines.Get(draw.pipeline);
+            pipeline_ready = static_cast<bool>(pipeline);
+            if(pipeline_ready)
+            {
+                command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+            }
+        }
+        //not compiled yet and without a fallback, see PipelineManager
+        if(!pipeline_ready)
+        {
+            continue;
+        }
+
+        if(draw.material && (draw.material != current_material))
+        {
+            command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, draw.layout, material_set, draw.material, nullptr);
+            current_material = draw.material;
+        }
+        if(draw.vertex_buffer && (draw.vertex_buffer != current_vertex_buffer))
+        {
+            const vk::DeviceSize offset = 0;
+            command_buffer.bindVertexBuffers(0, 1, &draw.vertex_buffer, &offset);
+            current_vertex_buffer = draw.vertex_buffer;
+        }
+        if(draw.index_buffer && (draw.index_buffer != current_index_buffer))
+        {
+            command_buffer.bindIndexBuffer(draw.index_buffer, 0, vk::IndexType::eUint32);
+            current_index_buffer = draw.index_buffer;
+        }
+        if(draw.constants)
+        {
+            draw.constants->Record(command_buffer, draw.layout, bucket.constants.data() + submitted.constants_offset);
+        }
+        command_buffer.drawIndexed(draw.index_count, draw.instance_count, draw.first_index, draw.vertex_offset, draw.first_instance);
+    }
+}
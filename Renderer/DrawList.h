@@ -0,0 +1,94 @@
+#pragma once
+
+#include "PipelineManager.h"
+#include "RadixSort.h"
+
+class DrawConstants;
+
+//CPU recorded draws, sorted by a 64 bit key before recording so state only changes where it has to
+//the key, most significant bits first: pass 6 | layer 10 | pipeline 12 | material 12 | depth 24
+//a pass and layer's draws stay together, inside them the draws of a pipeline, then of a material,
+//and those front to back, or back to front for keys made with back_to_front
+//submission doesn't lock: every thread appends to its own bucket, the buckets are gathered and
+//radix sorted once a frame, on several threads when there are enough draws to pay for them, see RadixSort
+//recording binds pipelines, material sets, vertex and index buffers only when they change, per
+//draw constants go through the draw's DrawConstants
+
+class DrawList
+{
+public:
+    static constexpr uint32_t PASS_BITS = 6;
+    static constexpr uint32_t LAYER_BITS = 10;
+    static constexpr uint32_t PIPELINE_BITS = 12;
+    static constexpr uint32_t MATERIAL_BITS = 12;
+    static constexpr uint32_t DEPTH_BITS = 24;
+
+    struct Draw
+    {
+        uint64_t key;
+        PipelineManager::Handle pipeline;
+        vk::PipelineLayout layout;
+        vk::DescriptorSet material{}; //bound at the set Record() is given, none keeps what is bound
+        vk::Buffer vertex_buffer{}; //binding 0
+        vk::Buffer index_buffer{}; //32 bit indices
+        uint32_t index_count = 0;
+        uint32_t instance_count = 1;
+        uint32_t first_index = 0;
+        int32_t vertex_offset = 0;
+        uint32_t first_instance = 0;
+        DrawConstants* constants = nullptr; //none for draws without, layout has to come from its CreatePipelineLayout()
+    };
+
+    //thread_count: threads submitting, each with its own index
+    //sort_threads: at most this many sort large lists, 1 always sorts on the calling thread
+    void Init(const uint32_t thread_count, const uint32_t sort_threads);
+
+    //depth: non-negative, view space distance or anything else that grows away from the camera
+    static uint64_t MakeKey
+    (
+        const uint32_t pass,
+        const uint32_t layer,
+        const uint32_t pipeline,
+        const uint32_t material,
+        const float depth,
+        const bool back_to_front = false
+    );
+
+    //before the frame's submissions, not while any are running
+    void Reset();
+    //any number of threads at once as long as each passes its own index, constants are copied,
+    //draw.constants->GetSize() bytes of them
+    void Submit(const uint32_t thread, const Draw& draw, const void* constants = nullptr);
+    //once every submission is done
+    void Sort();
+    //in key order, begin_layer is called whenever the pass or layer changes, before its first draw
+    void Record
+    (
+        const vk::CommandBuffer command_buffer,
+        const PipelineManager& pipelines,
+        const uint32_t material_set,
+        const std::function<void(uint32_t pass, uint32_t layer)>& begin_layer
+    ) const;
+
+    size_t GetDrawCount() const { return m_sorted.size(); }
+
+private:
+    struct Submitted
+    {
+        Draw draw;
+        uint32_t constants_offset;
+    };
+
+    //only ever touched by its thread, padded so two buckets never share a cache line
+    struct Bucket
+    {
+        std::vector<Submitted> draws{};
+        std::vector<uint8_t> constants{};
+        uint8_t pad[128 - 2 * sizeof(std::vector<uint8_t>)];
+    };
+
+    std::vector<Bucket> m_buckets{};
+
+    RadixSort m_sort{};
+    std::vector<RadixSort::Entry> m_sorted{}; //values are the bucket in the high half, the draw in the low half
+};
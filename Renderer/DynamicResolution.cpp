@@ -0,0 +1,159 @@
+#include "stdafx.h"
+#include "DynamicResolution.h"
+#include "DescriptorAllocator.h"
+
+static const float SCALE_STEP = 1.0f / 32.0f; //scales snap to this, small changes aren't worth it
+static const double HEADROOM = 0.9; //of the target, what a new scale aims for
+static const double RAISE_BELOW = 0.8; //of the target, frames faster than this may raise the scale
+static const float MAX_RAISE = 0.05f; //per change, relative
+static const float MAX_SHARPNESS = 0.5f;
+
+void DynamicResolution::Init(const vk::Device device, DescriptorAllocator& descriptor_allocator, const vk::Extent2D& output_extent, const Settings& settings, const uint32_t frames_in_flight)
+{
+    Assert(device);
+    Assert((settings.min_scale > 0.0f) && (settings.min_scale <= settings.max_scale) && (settings.max_scale <= 1.0f));
+
+    m_device = device;
+    m_output_extent = output_extent;
+    m_settings = settings;
+    //frames submitted with the old scale plus the one being recorded
+    m_latency = frames_in_flight + 1;
+    m_scale = settings.max_scale;
+    m_render_extent = vk::Extent2D
+    (
+        std::max(static_cast<uint32_t>(std::ceil(static_cast<float>(output_extent.width) * m_scale)), 1u),
+        std::max(static_cast<uint32_t>(std::ceil(static_cast<float>(output_extent.height) * m_scale)), 1u)
+    );
+
+    vk::SamplerCreateInfo sampler_info
+    (
+        {},
+        vk::Filter::eLinear,
+        vk::Filter::eLinear,
+        vk::SamplerMipmapMode::eNearest,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge
+    );
+    m_sampler = Get(m_device.createSampler(sampler_info));
+
+    //the scene image, written by InitPipeline() once the render graph has it
+    const vk::DescriptorSetLayoutBinding binding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment);
+    m_set_layout = descriptor_allocator.GetLayout({binding});
+
+    DescriptorAllocator::SetDesc desc;
+    desc.layout = m_set_layout;
+    m_set = descriptor_allocator.AllocatePersistent(desc);
+
+    const vk::PushConstantRange push_constants(vk::ShaderStageFlagBits::eFragment, 0, sizeof(UpscaleConstants));
+    m_pipeline_layout = Get(m_device.createPipelineLayout(vk::PipelineLayoutCreateInfo({}, 1, &m_set_layout, 1, &push_constants)));
+}
+
+void DynamicResolution::InitPipeline(PipelineManager& pipelines, const vk::RenderPass render_pass, const uint32_t subpass, const vk::ImageView scene_view)
+{
+    Assert(m_device);
+    Assert(render_pass);
+    Assert(scene_view);
+
+    const vk::DescriptorImageInfo scene_info(m_sampler, scene_view, vk::ImageLayout::eShaderReadOnlyOptimal);
+    const vk::WriteDescriptorSet write(m_set, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &scene_info);
+    m_device.updateDescriptorSets(1, &write, 0, nullptr);
+
+    //a single triangle over the whole output, no vertex input
+    PipelineManager::GraphicsDesc desc;
+    desc.vertex_shader = "./Resources/Shaders/Upscale.vert.spv";
+    desc.fragment_shader = "./Resources/Shaders/Upscale.frag.spv";
+    desc.cull_mode = vk::CullModeFlagBits::eNone;
+    desc.depth_test = false;
+    desc.depth_write = false;
+    desc.layout = m_pipeline_layout;
+    desc.render_pass = render_pass;
+    desc.subpass = subpass;
+
+    m_pipelines = &pipelines;
+    m_pipeline = pipelines.RequestNow(desc);
+}
+
+void DynamicResolution::Shutdown()
+{
+    if(!m_device)
+    {
+        return;
+    }
+
+    m_device.destroyPipelineLayout(m_pipeline_layout);
+    //the set and its layout go with the descriptor allocator
+    m_set_layout = vk::DescriptorSetLayout();
+    m_device.destroySampler(m_sampler);
+    m_pipeline = PipelineManager::INVALID_HANDLE;
+    m_pipelines = nullptr;
+
+    m_device = vk::Device();
+}
+
+void DynamicResolution::Update(const double gpu_frame_ns)
+{
+    if((m_settings.target_ns <= 0.0) || (gpu_frame_ns <= 0.0))
+    {
+        return;
+    }
+    //still measuring frames rendered at an older scale
+    if(m_cooldown > 0)
+    {
+        --m_cooldown;
+        return;
+    }
+
+    //pixels per axis go with the square root of the time
+    float scale = m_scale * static_cast<float>(std::sqrt(m_settings.target_ns * HEADROOM / gpu_frame_ns));
+    if(gpu_frame_ns > m_settings.target_ns)
+    {
+        scale = std::floor(scale / SCALE_STEP) * SCALE_STEP;
+    }
+    else if(gpu_frame_ns < m_settings.target_ns * RAISE_BELOW)
+    {
+        scale = std::floor(std::min(scale, m_scale * (1.0f + MAX_RAISE)) / SCALE_STEP) * SCALE_STEP;
+    }
+    else
+    {
+        return;
+    }
+    scale = std::min(std::max(scale, m_settings.min_scale), m_settings.max_scale);
+    if(scale == m_scale)
+    {
+        return;
+    }
+
+    m_scale = scale;
+    m_render_extent = vk::Extent2D
+    (
+        std::min(std::max(static_cast<uint32_t>(std::ceil(static_cast<float>(m_output_extent.width) * m_scale)), 1u), m_output_extent.width),
+        std::min(std::max(static_cast<uint32_t>(std::ceil(static_cast<float>(m_output_extent.height) * m_scale)), 1u), m_output_extent.height)
+    );
+    m_cooldown = m_latency;
+}
+
+void DynamicResolution::RecordUpscale(const vk::CommandBuffer command_buffer) const
+{
+    const vk::Pipeline pipeline = m_pipelines->Get(m_pipeline);
+    Assert(pipeline);
+
+    const vk::Viewport viewport(0.0f, 0.0f, static_cast<float>(m_output_extent.width), static_cast<float>(m_output_extent.height), 0.0f, 1.0f);
+    const vk::Rect2D scissor({0, 0}, m_output_extent);
+
+    UpscaleConstants constants{};
+    constants.uv_scale = glm::vec2
+    (
+        static_cast<float>(m_render_extent.width) / static_cast<float>(m_output_extent.width),
+        static_cast<float>(m_render_extent.height) / static_cast<float>(m_output_extent.height)
+    );
+    constants.texel_size = glm::vec2(1.0f / static_cast<float>(m_output_extent.width), 1.0f / static_cast<float>(m_output_extent.height));
+    constants.sharpness = std::min(1.0f - m_scale, MAX_SHARPNESS);
+
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+    command_buffer.setViewport(0, viewport);
+    command_buffer.setScissor(0, scissor);
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline_layout, 0, m_set, nullptr);
+    command_buffer.pushConstants(m_pipeline_layout, vk::ShaderStageFlagBits::eFragment, 0, sizeof(UpscaleConstants), &constants);
+    command_buffer.draw(3, 1, 0, 0);
+}
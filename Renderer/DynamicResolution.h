@@ -0,0 +1,65 @@
+#pragma once
+
+#include "PipelineManager.h"
+
+class DescriptorAllocator;
+
+//dynamic resolution: the scene is rendered to the top left of full size targets at a scale picked
+//from the measured GPU frame time, and upscaled to the output at the end of the frame
+//GPU time is taken to grow with the pixel count, the scale moves towards the one that would have
+//hit the target, down straight away when a frame goes over it and up a few percent at a time
+//when there is headroom, so a load spike costs resolution instead of frames
+//timings arrive frames in flight late, after a change the controller waits that long before it
+//trusts them again
+//targets never change size, a new scale is just a smaller viewport, the upscale is a bilinear
+//fetch sharpened by how far the scale is below 1
+
+class DynamicResolution
+{
+public:
+    struct Settings
+    {
+        double target_ns; //GPU frame time to stay under, 0 always renders at full resolution
+        float min_scale; //per axis
+        float max_scale;
+    };
+
+    void Init(const vk::Device device, DescriptorAllocator& descriptor_allocator, const vk::Extent2D& output_extent, const Settings& settings, const uint32_t frames_in_flight);
+    //needs the render pass of the upscale pass and the view of the image the scene was rendered to
+    void InitPipeline(PipelineManager& pipelines, const vk::RenderPass render_pass, const uint32_t subpass, const vk::ImageView scene_view);
+    void Shutdown();
+
+    //before the frame is recorded, gpu_frame_ns is GPUProfiler::GetFrameTime(), 0 without timings
+    void Update(const double gpu_frame_ns);
+    //render graph pass writing the output, samples the rendered part of the scene image
+    void RecordUpscale(const vk::CommandBuffer command_buffer) const;
+
+    //what this frame renders at, at most the output extent
+    vk::Extent2D GetRenderExtent() const { return m_render_extent; }
+    float GetScale() const { return m_scale; }
+
+private:
+    //Upscale.frag
+    struct UpscaleConstants
+    {
+        glm::vec2 uv_scale; //rendered part of the scene image
+        glm::vec2 texel_size;
+        float sharpness;
+    };
+
+    vk::Device m_device{};
+    vk::Extent2D m_output_extent{};
+    Settings m_settings{};
+    uint32_t m_latency = 0;
+
+    float m_scale = 1.0f;
+    vk::Extent2D m_render_extent{};
+    uint32_t m_cooldown = 0; //frames until timings reflect the current scale
+
+    vk::Sampler m_sampler{};
+    vk::DescriptorSetLayout m_set_layout{};
+    vk::DescriptorSet m_set{};
+    vk::PipelineLayout m_pipeline_layout{};
+    PipelineManager* m_pipelines = nullptr;
+    PipelineManager::Handle m_pipeline = PipelineManager::INVALID_HANDLE;
+};
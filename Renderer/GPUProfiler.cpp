@@ -0,0 +1,159 @@
+#include "stdafx.h"
+#include "GPUProfiler.h"
+#include "VKUtils.h"
+
+#include <Base/Profiler.h>
+
+void GPUProfiler::Init
+(
+    const vk::PhysicalDevice physical_device,
+    const vk::Device device,
+    const uint32_t graphics_family,
+    const uint32_t frames_in_flight,
+    const uint32_t max_scopes
+)
+{
+    Assert(physical_device);
+    Assert(device);
+    Assert(frames_in_flight > 0);
+    Assert(max_scopes > 0);
+
+    m_device = device;
+    m_timestamp_period = physical_device.getProperties().limits.timestampPeriod;
+    m_graphics_family = graphics_family;
+    m_max_scopes = max_scopes;
+
+    for(const auto& family : physical_device.getQueueFamilyProperties())
+    {
+        m_valid_bits.push_back(family.timestampValidBits);
+    }
+    Assert(graphics_family < m_valid_bits.size());
+
+    //begin and end per scope
+    const vk::QueryPoolCreateInfo pool_info({}, vk::QueryType::eTimestamp, max_scopes * 2);
+    m_frames.resize(frames_in_flight);
+    for(auto& frame : m_frames)
+    {
+        frame.pool = Get(m_device.createQueryPool(pool_info));
+        m_device.resetQueryPool(frame.pool, 0, max_scopes * 2);
+    }
+}
+
+void GPUProfiler::Shutdown()
+{
+    if(!m_device)
+    {
+        return;
+    }
+
+    for(auto& frame : m_frames)
+    {
+        m_device.destroyQueryPool(frame.pool);
+    }
+    m_frames.clear();
+    m_valid_bits.clear();
+    m_timings.clear();
+    m_device = vk::Device();
+}
+
+void GPUProfiler::BeginFrame(const uint32_t frame_index)
+{
+    Assert(frame_index < m_frames.size());
+    m_frame_index = frame_index;
+
+    FrameData& frame = m_frames[m_frame_index];
+    const uint32_t query_count = static_cast<uint32_t>(frame.scopes.size()) * 2;
+    if(query_count > 0)
+    {
+        //the frame has been waited on, results are there unless a scope was never written
+        std::vector<uint64_t> timestamps(query_count);
+        const vk::Result result = m_device.getQueryPoolResults
+        (
+            frame.pool,
+            0,
+            query_count,
+            timestamps.size() * sizeof(uint64_t),
+            timestamps.data(),
+            sizeof(uint64_t),
+            vk::QueryResultFlagBits::e64
+        );
+
+        if(result == vk::Result::eSuccess)
+        {
+            //per queue family, their timestamps can't be compared with each other
+            std::vector<uint64_t> first(m_valid_bits.size(), UINT64_MAX);
+            std::vector<uint64_t> last(m_valid_bits.size(), 0);
+            for(size_t i = 0; i < frame.scopes.size(); ++i)
+            {
+                const Scope& scope = frame.scopes[i];
+                if(scope.ended)
+                {
+                    first[scope.queue_family] = std::min(first[scope.queue_family], timestamps[i * 2] & scope.valid_mask);
+                    last[scope.queue_family] = std::max(last[scope.queue_family], timestamps[i * 2 + 1] & scope.valid_mask);
+                }
+            }
+
+            m_timings.clear();
+            Profiler& profiler = Profiler::Instance();
+            for(size_t i = 0; i < frame.scopes.size(); ++i)
+            {
+                const Scope& scope = frame.scopes[i];
+                if(!scope.ended)
+                {
+                    continue;
+                }
+
+                const uint64_t origin = first[scope.queue_family];
+                const double begin_ns = static_cast<double>((timestamps[i * 2] & scope.valid_mask) - origin) * m_timestamp_period;
+                const double end_ns = static_cast<double>((timestamps[i * 2 + 1] & scope.valid_mask) - origin) * m_timestamp_period;
+                m_timings.push_back({scope.name, scope.queue_family, begin_ns, end_ns});
+                profiler.AddEvent({scope.name, Profiler::Track::GPU, frame.frame, frame.submit_ns + begin_ns, frame.submit_ns + end_ns});
+            }
+            //the graphics queue starts the frame and, waiting on all async work, ends it
+            const uint64_t graphics_first = first[m_graphics_family];
+            const uint64_t graphics_last = last[m_graphics_family];
+            m_frame_time_ns = (graphics_last > graphics_first) ? static_cast<double>(graphics_last - graphics_first) * m_timestamp_period : 0.0;
+        }
+
+        //host reset, no command buffer has to run before the first scope
+        m_device.resetQueryPool(frame.pool, 0, query_count);
+    }
+
+    frame.scopes.clear();
+    frame.frame = Profiler::Instance().GetFrame();
+}
+
+void GPUProfiler::MarkSubmit()
+{
+    m_frames[m_frame_index].submit_ns = Profiler::Instance().Now();
+}
+
+uint32_t GPUProfiler::BeginScope(const vk::CommandBuffer command_buffer, const uint32_t queue_family, const std::string& name)
+{
+    Assert(queue_family < m_valid_bits.size());
+
+    FrameData& frame = m_frames[m_frame_index];
+    const uint32_t valid_bits = m_valid_bits[queue_family];
+    if((valid_bits == 0) || (frame.scopes.size() == m_max_scopes))
+    {
+        return NO_SCOPE;
+    }
+
+    const uint32_t scope = static_cast<uint32_t>(frame.scopes.size());
+    frame.scopes.push_back({name, queue_family, valid_bits == 64 ? UINT64_MAX : ((uint64_t(1) << valid_bits) - 1), false});
+    command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, frame.pool, scope * 2);
+    return scope;
+}
+
+void GPUProfiler::EndScope(const vk::CommandBuffer command_buffer, const uint32_t scope)
+{
+    if(scope == NO_SCOPE)
+    {
+        return;
+    }
+
+    FrameData& frame = m_frames[m_frame_index];
+    Assert(scope < frame.scopes.size());
+    command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, frame.pool, scope * 2 + 1);
+    frame.scopes[scope].ended = true;
+}
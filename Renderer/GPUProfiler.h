@@ -0,0 +1,74 @@
+#pragma once
+
+//per pass GPU timings from timestamp queries
+//every frame in flight has its own query pool, a frame's results are read when it has
+//been waited on again, so reading never stalls, timings are MAX_FRAMES_IN_FLIGHT frames late
+//read back scopes go to the Profiler's GPU track, placed relative to when the frame was submitted
+//timestamps of different queues don't share a clock, every queue family is measured from its own
+//first timestamp and the frame time only comes from the graphics queue
+
+class GPUProfiler
+{
+public:
+    static constexpr uint32_t NO_SCOPE = UINT32_MAX;
+
+    struct Timing
+    {
+        std::string name;
+        uint32_t queue_family;
+        double begin_ns; //from the first timestamp of its queue family in the frame
+        double end_ns;
+    };
+
+    void Init
+    (
+        const vk::PhysicalDevice physical_device,
+        const vk::Device device,
+        const uint32_t graphics_family,
+        const uint32_t frames_in_flight,
+        const uint32_t max_scopes
+    );
+    void Shutdown();
+
+    //frame_index's previous submission must have completed, reads its results and starts it over
+    void BeginFrame(const uint32_t frame_index);
+    //right before the frame is submitted, its timings are placed from here
+    void MarkSubmit();
+
+    //NO_SCOPE if the queue family can't write timestamps or the frame is out of scopes
+    uint32_t BeginScope(const vk::CommandBuffer command_buffer, const uint32_t queue_family, const std::string& name);
+    void EndScope(const vk::CommandBuffer command_buffer, const uint32_t scope);
+
+    //the most recently read back frame
+    const std::vector<Timing>& GetTimings() const { return m_timings; }
+    double GetFrameTime() const { return m_frame_time_ns; } //first to last graphics queue timestamp, nanoseconds
+
+private:
+    struct Scope
+    {
+        std::string name;
+        uint32_t queue_family;
+        uint64_t valid_mask; //timestamps only have timestampValidBits bits
+        bool ended;
+    };
+
+    struct FrameData
+    {
+        vk::QueryPool pool{};
+        std::vector<Scope> scopes{};
+        uint64_t frame = 0; //Profiler frame it was recorded in
+        double submit_ns = 0.0;
+    };
+
+    vk::Device m_device{};
+    double m_timestamp_period = 0.0; //nanoseconds per tick
+    uint32_t m_graphics_family = UINT32_MAX;
+    std::vector<uint32_t> m_valid_bits{}; //per queue family
+    uint32_t m_max_scopes = 0;
+
+    std::vector<FrameData> m_frames{};
+    uint32_t m_frame_index = 0;
+
+    std::vector<Timing> m_timings{};
+    double m_frame_time_ns = 0.0;
+};
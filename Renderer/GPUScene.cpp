@@ -0,0 +1,1258 @@
+#include "stdafx.h"
+#include "GPUScene.h"
+#include "BindlessHeap.h"
+#include "DescriptorAllocator.h"
+#include "DrawConstants.h"
+#include "DrawList.h"
+#include "UploadQueue.h"
+
+#include <glm/glm/gtc/matrix_transform.hpp>
+
+static const uint32_t CULL_GROUP_SIZE = 64; //local_size_x in Cull.comp
+static const uint32_t BATCH_GROUP_SIZE = 64; //local_size_x in Batch.comp
+static const uint32_t MESHLET_VERTEX_BITS = 6; //meshlet vertex in the low bits of a meshlet index, see ClusterCull.comp
+static const uint32_t MAX_INDEX_VALUE = 1 << 24; //the least maxDrawIndexedIndexValue devices have to support
+static const uint32_t TEXTURE_TABLE_BINDING = 6; //of the draw set, in both modes, see Simple.frag
+static const uint32_t BINDLESS_SET = 2; //of the draw pipelines
+
+static_assert(MeshletData::MAX_VERTICES <= (1 << MESHLET_VERTEX_BITS), "meshlet vertices don't fit the index encoding");
+
+void GPUScene::Init
+(
+    const vk::PhysicalDevice physical_device,
+    const vk::Device device,
+    DescriptorAllocator& descriptor_allocator,
+    UploadQueue& upload_queue,
+    const Limits& limits,
+    const uint32_t frames_in_flight,
+    const bool draw_indirect_count,
+    const bool meshlets
+)
+{
+    Assert(physical_device);
+    Assert(device);
+    Assert(frames_in_flight > 0);
+    Assert(!meshlets || ((limits.max_visible_meshlets << MESHLET_VERTEX_BITS) <= MAX_INDEX_VALUE));
+
+    m_physical_device = physical_device;
+    m_device = device;
+    m_upload_queue = &upload_queue;
+    m_limits = limits;
+    m_draw_indirect_count = draw_indirect_count;
+    m_meshlets = meshlets;
+
+    const vk::MemoryPropertyFlags host_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    m_vertex_buffer = CreateBuffer
+    (
+        m_physical_device,
+        m_device,
+        sizeof(PackedVertex) * m_limits.max_vertices,
+        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+    m_index_buffer = CreateBuffer
+    (
+        m_physical_device,
+        m_device,
+        sizeof(uint32_t) * m_limits.max_indices,
+        vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+    m_mesh_buffer = CreateBuffer(m_physical_device, m_device, sizeof(GPUMesh) * m_limits.max_meshes, vk::BufferUsageFlagBits::eStorageBuffer, host_flags);
+    m_draw_buffer = CreateBuffer
+    (
+        m_physical_device,
+        m_device,
+        sizeof(vk::DrawIndexedIndirectCommand) * m_limits.max_meshes, //a draw per batch
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+    m_count_buffer = CreateBuffer
+    (
+        m_physical_device,
+        m_device,
+        sizeof(uint32_t),
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+    m_instance_buffer = CreateBuffer(m_physical_device, m_device, sizeof(uint32_t) * m_limits.max_objects, vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    m_batch_count_buffer = CreateBuffer
+    (
+        m_physical_device,
+        m_device,
+        sizeof(uint32_t) * m_limits.max_meshes,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+    //the count and then the objects
+    m_visible_object_buffer = CreateBuffer
+    (
+        m_physical_device,
+        m_device,
+        sizeof(uint32_t) * (m_limits.max_objects + 1),
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+    m_meshlet_dispatch_buffer = CreateBuffer
+    (
+        m_physical_device,
+        m_device,
+        sizeof(vk::DispatchIndirectCommand),
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+    if(m_meshlets)
+    {
+        m_meshlet_buffer = CreateBuffer
+        (
+            m_physical_device,
+            m_device,
+            sizeof(Meshlet) * m_limits.max_meshlets,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        );
+        m_meshlet_vertex_buffer = CreateBuffer
+        (
+            m_physical_device,
+            m_device,
+            sizeof(uint32_t) * m_limits.max_meshlet_vertices,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        );
+        //a meshlet never has more triangles than its mesh
+        m_meshlet_triangle_buffer = CreateBuffer
+        (
+            m_physical_device,
+            m_device,
+            sizeof(uint32_t) * (m_limits.max_indices / 3),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        );
+        m_visible_meshlet_buffer = CreateBuffer
+        (
+            m_physical_device,
+            m_device,
+            sizeof(glm::uvec2) * m_limits.max_visible_meshlets,
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        );
+        m_meshlet_draw_buffer = CreateBuffer
+        (
+            m_physical_device,
+            m_device,
+            sizeof(MeshletDraw),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        );
+        //room for every visible meshlet to be full, the cull pass stops at max_visible_meshlets
+        m_meshlet_index_buffer = CreateBuffer
+        (
+            m_physical_device,
+            m_device,
+            sizeof(uint32_t) * 3 * MeshletData::MAX_TRIANGLES * m_limits.max_visible_meshlets,
+            vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        );
+    }
+
+    //objects, batches, batch counts, instances, params, depth pyramid, texture feedback, visible objects, meshlet dispatch
+    const std::vector<vk::DescriptorSetLayoutBinding> cull_bindings =
+    {
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(5, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(7, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(8, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute)
+    };
+    m_cull_set_layout = descriptor_allocator.GetLayout(cull_bindings);
+
+    //meshes, batches, batch counts, draws, count
+    const std::vector<vk::DescriptorSetLayoutBinding> batch_bindings =
+    {
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute)
+    };
+    m_batch_set_layout = descriptor_allocator.GetLayout(batch_bindings);
+
+    //batch mode: objects, instances, meshes
+    //meshlet mode: objects, visible meshlets, meshlets, meshlet vertices, vertices, meshes
+    //both: the texture table at TEXTURE_TABLE_BINDING, only read with a bindless heap
+    const uint32_t draw_binding_count = m_meshlets ? 6 : 3;
+    std::vector<vk::DescriptorSetLayoutBinding> draw_bindings;
+    for(uint32_t binding = 0; binding < draw_binding_count; ++binding)
+    {
+        draw_bindings.emplace_back(binding, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex);
+    }
+    draw_bindings.emplace_back(TEXTURE_TABLE_BINDING, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment);
+    m_draw_set_layout = descriptor_allocator.GetLayout(draw_bindings);
+
+    //objects, meshes, meshlets, meshlet triangles, visible objects, visible meshlets, meshlet draw, meshlet indices, params, depth pyramid
+    if(m_meshlets)
+    {
+        std::vector<vk::DescriptorSetLayoutBinding> meshlet_cull_bindings;
+        for(uint32_t binding = 0; binding < 8; ++binding)
+        {
+            meshlet_cull_bindings.emplace_back(binding, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute);
+        }
+        meshlet_cull_bindings.emplace_back(8, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute);
+        meshlet_cull_bindings.emplace_back(9, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute);
+        m_meshlet_cull_set_layout = descriptor_allocator.GetLayout(meshlet_cull_bindings);
+    }
+
+    m_vertex_ranges.Init(m_limits.max_vertices);
+    m_index_ranges.Init(m_limits.max_indices);
+    if(m_meshlets)
+    {
+        m_meshlet_ranges.Init(m_limits.max_meshlets);
+        m_meshlet_vertex_ranges.Init(m_limits.max_meshlet_vertices);
+        m_meshlet_triangle_ranges.Init(m_limits.max_indices / 3);
+    }
+    m_retired_ranges.resize(frames_in_flight);
+
+    m_frames.resize(frames_in_flight);
+    for(auto& frame : m_frames)
+    {
+        frame.objects = CreateBuffer(m_physical_device, m_device, sizeof(GPUObject) * m_limits.max_objects, vk::BufferUsageFlagBits::eStorageBuffer, host_flags);
+        frame.batches = CreateBuffer(m_physical_device, m_device, sizeof(uint32_t) * m_limits.max_meshes, vk::BufferUsageFlagBits::eStorageBuffer, host_flags);
+        frame.cull_params = CreateBuffer(m_physical_device, m_device, sizeof(CullParams), vk::BufferUsageFlagBits::eUniformBuffer, host_flags);
+        frame.texture_feedback = CreateBuffer(m_physical_device, m_device, sizeof(uint32_t) * std::max(m_limits.max_textures, 1u), vk::BufferUsageFlagBits::eStorageBuffer, host_flags);
+        memset(frame.texture_feedback.mapped, 0, sizeof(uint32_t) * std::max(m_limits.max_textures, 1u));
+
+        //the depth pyramid is written by SetDepthPyramid(), the texture table by SetTextureTables()
+        DescriptorAllocator::SetDesc cull_desc;
+        cull_desc.layout = m_cull_set_layout;
+        cull_desc.Buffer(0, vk::DescriptorType::eStorageBuffer, frame.objects.buffer, 0, VK_WHOLE_SIZE);
+        cull_desc.Buffer(1, vk::DescriptorType::eStorageBuffer, frame.batches.buffer, 0, VK_WHOLE_SIZE);
+        cull_desc.Buffer(2, vk::DescriptorType::eStorageBuffer, m_batch_count_buffer.buffer, 0, VK_WHOLE_SIZE);
+        cull_desc.Buffer(3, vk::DescriptorType::eStorageBuffer, m_instance_buffer.buffer, 0, VK_WHOLE_SIZE);
+        cull_desc.Buffer(4, vk::DescriptorType::eUniformBuffer, frame.cull_params.buffer, 0, VK_WHOLE_SIZE);
+        cull_desc.Buffer(6, vk::DescriptorType::eStorageBuffer, frame.texture_feedback.buffer, 0, VK_WHOLE_SIZE);
+        cull_desc.Buffer(7, vk::DescriptorType::eStorageBuffer, m_visible_object_buffer.buffer, 0, VK_WHOLE_SIZE);
+        cull_desc.Buffer(8, vk::DescriptorType::eStorageBuffer, m_meshlet_dispatch_buffer.buffer, 0, VK_WHOLE_SIZE);
+        frame.cull_set = descriptor_allocator.AllocatePersistent(cull_desc);
+
+        DescriptorAllocator::SetDesc batch_desc;
+        batch_desc.layout = m_batch_set_layout;
+        batch_desc.Buffer(0, vk::DescriptorType::eStorageBuffer, m_mesh_buffer.buffer, 0, VK_WHOLE_SIZE);
+        batch_desc.Buffer(1, vk::DescriptorType::eStorageBuffer, frame.batches.buffer, 0, VK_WHOLE_SIZE);
+        batch_desc.Buffer(2, vk::DescriptorType::eStorageBuffer, m_batch_count_buffer.buffer, 0, VK_WHOLE_SIZE);
+        batch_desc.Buffer(3, vk::DescriptorType::eStorageBuffer, m_draw_buffer.buffer, 0, VK_WHOLE_SIZE);
+        batch_desc.Buffer(4, vk::DescriptorType::eStorageBuffer, m_count_buffer.buffer, 0, VK_WHOLE_SIZE);
+        frame.batch_set = descriptor_allocator.AllocatePersistent(batch_desc);
+
+        const vk::Buffer instance_draw_buffers[3] = {frame.objects.buffer, m_instance_buffer.buffer, m_mesh_buffer.buffer};
+        const vk::Buffer meshlet_draw_buffers[6] =
+        {
+            frame.objects.buffer,
+            m_visible_meshlet_buffer.buffer,
+            m_meshlet_buffer.buffer,
+            m_meshlet_vertex_buffer.buffer,
+            m_vertex_buffer.buffer,
+            m_mesh_buffer.buffer
+        };
+        DescriptorAllocator::SetDesc draw_desc;
+        draw_desc.layout = m_draw_set_layout;
+        for(uint32_t binding = 0; binding < draw_binding_count; ++binding)
+        {
+            draw_desc.Buffer(binding, vk::DescriptorType::eStorageBuffer, m_meshlets ? meshlet_draw_buffers[binding] : instance_draw_buffers[binding], 0, VK_WHOLE_SIZE);
+        }
+        frame.draw_set = descriptor_allocator.AllocatePersistent(draw_desc);
+
+        if(!m_meshlets)
+        {
+            continue;
+        }
+        const vk::Buffer meshlet_cull_buffers[8] =
+        {
+            frame.objects.buffer,
+            m_mesh_buffer.buffer,
+            m_meshlet_buffer.buffer,
+            m_meshlet_triangle_buffer.buffer,
+            m_visible_object_buffer.buffer,
+            m_visible_meshlet_buffer.buffer,
+            m_meshlet_draw_buffer.buffer,
+            m_meshlet_index_buffer.buffer
+        };
+        DescriptorAllocator::SetDesc meshlet_cull_desc;
+        meshlet_cull_desc.layout = m_meshlet_cull_set_layout;
+        for(uint32_t binding = 0; binding < 8; ++binding)
+        {
+            meshlet_cull_desc.Buffer(binding, vk::DescriptorType::eStorageBuffer, meshlet_cull_buffers[binding], 0, VK_WHOLE_SIZE);
+        }
+        meshlet_cull_desc.Buffer(8, vk::DescriptorType::eUniformBuffer, frame.cull_params.buffer, 0, VK_WHOLE_SIZE);
+        frame.meshlet_cull_set = descriptor_allocator.AllocatePersistent(meshlet_cull_desc);
+    }
+
+    m_texture_feedback.assign(m_limits.max_textures, 0);
+
+    m_cull_pipeline_layout = Get(m_device.createPipelineLayout(vk::PipelineLayoutCreateInfo({}, 1, &m_cull_set_layout, 0, nullptr)));
+    const vk::PushConstantRange batch_push_constants(vk::ShaderStageFlagBits::eCompute, 0, sizeof(BatchConstants));
+    m_batch_pipeline_layout = Get(m_device.createPipelineLayout(vk::PipelineLayoutCreateInfo({}, 1, &m_batch_set_layout, 1, &batch_push_constants)));
+
+    const vk::ShaderModule cull_module = LoadShaderModule(m_device, "./Resources/Shaders/Cull.comp.spv");
+    const vk::ComputePipelineCreateInfo cull_pipeline_info
+    (
+        {},
+        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, cull_module, "main"),
+        m_cull_pipeline_layout
+    );
+    m_cull_pipeline = Get(m_device.createComputePipeline(vk::PipelineCache(), cull_pipeline_info));
+    m_device.destroyShaderModule(cull_module);
+
+    const vk::ShaderModule batch_module = LoadShaderModule(m_device, "./Resources/Shaders/Batch.comp.spv");
+    const vk::ComputePipelineCreateInfo batch_pipeline_info
+    (
+        {},
+        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, batch_module, "main"),
+        m_batch_pipeline_layout
+    );
+    m_batch_pipeline = Get(m_device.createComputePipeline(vk::PipelineCache(), batch_pipeline_info));
+    m_device.destroyShaderModule(batch_module);
+
+    if(m_meshlets)
+    {
+        m_meshlet_cull_pipeline_layout = Get(m_device.createPipelineLayout(vk::PipelineLayoutCreateInfo({}, 1, &m_meshlet_cull_set_layout, 0, nullptr)));
+        const vk::ShaderModule meshlet_cull_module = LoadShaderModule(m_device, "./Resources/Shaders/ClusterCull.comp.spv");
+        const vk::ComputePipelineCreateInfo meshlet_cull_pipeline_info
+        (
+            {},
+            vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, meshlet_cull_module, "main"),
+            m_meshlet_cull_pipeline_layout
+        );
+        m_meshlet_cull_pipeline = Get(m_device.createComputePipeline(vk::PipelineCache(), meshlet_cull_pipeline_info));
+        m_device.destroyShaderModule(meshlet_cull_module);
+    }
+}
+
+void GPUScene::InitPipelines
+(
+    PipelineManager& pipelines,
+    const vk::RenderPass render_pass,
+    const uint32_t subpass,
+    const vk::SampleCountFlagBits samples,
+    const vk::DescriptorSetLayout lighting_set_layout,
+    const BindlessHeap* bindless_heap
+)
+{
+    Assert(m_device);
+    Assert(render_pass);
+    Assert(lighting_set_layout);
+
+    m_bindless_heap = bindless_heap;
+    const vk::DescriptorSetLayout set_layouts[3] = {m_draw_set_layout, lighting_set_layout, m_bindless_heap ? m_bindless_heap->GetLayout() : vk::DescriptorSetLayout()};
+    const vk::PushConstantRange draw_push_constants(vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4));
+    m_draw_pipeline_layout = Get(m_device.createPipelineLayout(vk::PipelineLayoutCreateInfo({}, m_bindless_heap ? 3 : 2, set_layouts, 1, &draw_push_constants)));
+
+    PipelineManager::GraphicsDesc desc;
+    //the textured build declares the heap's arrays, which devices without descriptor indexing can't even load
+    desc.fragment_shader = m_bindless_heap ? "./Resources/Shaders/Simple.bindless.frag.spv" : "./Resources/Shaders/Simple.frag.spv";
+    if(m_meshlets)
+    {
+        //vertices are pulled from storage buffers
+        desc.vertex_shader = "./Resources/Shaders/Meshlet.vert.spv";
+    }
+    else
+    {
+        desc.vertex_shader = "./Resources/Shaders/Indirect.vert.spv";
+        desc.vertex_bindings = {vk::VertexInputBindingDescription(0, sizeof(PackedVertex), vk::VertexInputRate::eVertex)};
+        desc.vertex_attributes =
+        {
+            vk::VertexInputAttributeDescription(0, 0, vk::Format::eR16G16B16A16Unorm, offsetof(PackedVertex, position_xy)),
+            vk::VertexInputAttributeDescription(1, 0, vk::Format::eR8G8B8A8Unorm, offsetof(PackedVertex, colour)),
+            vk::VertexInputAttributeDescription(2, 0, vk::Format::eR8G8B8A8Snorm, offsetof(PackedVertex, normal_tangent)),
+            vk::VertexInputAttributeDescription(3, 0, vk::Format::eR16G16Sfloat, offsetof(PackedVertex, uv))
+        };
+    }
+    desc.samples = samples;
+    desc.layout = m_draw_pipeline_layout;
+    desc.render_pass = render_pass;
+    desc.subpass = subpass;
+    m_draw_pipelines.Init(pipelines, desc, SHADER_FEATURE_LINEAR_TO_SRGB | SHADER_FEATURE_OBJECT_COLOUR | SHADER_FEATURE_CLUSTERED_LIGHTING);
+}
+
+void GPUScene::Shutdown()
+{
+    if(!m_device)
+    {
+        return;
+    }
+
+    m_device.destroyPipeline(m_meshlet_cull_pipeline);
+    m_device.destroyPipeline(m_batch_pipeline);
+    m_device.destroyPipeline(m_cull_pipeline);
+    m_device.destroyPipelineLayout(m_meshlet_cull_pipeline_layout);
+    m_device.destroyPipelineLayout(m_draw_pipeline_layout);
+    m_device.destroyPipelineLayout(m_batch_pipeline_layout);
+    m_device.destroyPipelineLayout(m_cull_pipeline_layout);
+    //sets and layouts go with the descriptor allocator
+    m_meshlet_cull_set_layout = vk::DescriptorSetLayout();
+    m_draw_set_layout = vk::DescriptorSetLayout();
+    m_batch_set_layout = vk::DescriptorSetLayout();
+    m_cull_set_layout = vk::DescriptorSetLayout();
+
+    for(auto& frame : m_frames)
+    {
+        DestroyBuffer(m_device, frame.texture_feedback);
+        DestroyBuffer(m_device, frame.cull_params);
+        DestroyBuffer(m_device, frame.batches);
+        DestroyBuffer(m_device, frame.objects);
+    }
+    m_frames.clear();
+
+    DestroyBuffer(m_device, m_meshlet_index_buffer);
+    DestroyBuffer(m_device, m_meshlet_draw_buffer);
+    DestroyBuffer(m_device, m_visible_meshlet_buffer);
+    DestroyBuffer(m_device, m_meshlet_triangle_buffer);
+    DestroyBuffer(m_device, m_meshlet_vertex_buffer);
+    DestroyBuffer(m_device, m_meshlet_buffer);
+    DestroyBuffer(m_device, m_meshlet_dispatch_buffer);
+    DestroyBuffer(m_device, m_visible_object_buffer);
+    DestroyBuffer(m_device, m_batch_count_buffer);
+    DestroyBuffer(m_device, m_instance_buffer);
+    DestroyBuffer(m_device, m_count_buffer);
+    DestroyBuffer(m_device, m_draw_buffer);
+    DestroyBuffer(m_device, m_mesh_buffer);
+    DestroyBuffer(m_device, m_index_buffer);
+    DestroyBuffer(m_device, m_vertex_buffer);
+
+    m_meshes.clear();
+    m_mesh_ready.clear();
+    m_mesh_object_counts.clear();
+    m_pending_meshes.clear();
+    m_objects.clear();
+    m_free_objects.clear();
+    m_texture_feedback.clear();
+    m_changed_bounds.clear();
+    m_mesh_allocations.clear();
+    m_free_meshes.clear();
+    m_queued_moves.clear();
+    m_retired_ranges.clear();
+    m_vertex_ranges.Init(0);
+    m_index_ranges.Init(0);
+    m_meshlet_ranges.Init(0);
+    m_meshlet_vertex_ranges.Init(0);
+    m_meshlet_triangle_ranges.Init(0);
+    m_frame_index = 0;
+    m_pyramid_extent = vk::Extent2D();
+    m_pyramid_mips = 0;
+    m_upload_queue = nullptr;
+    m_bindless_heap = nullptr;
+    m_draw_pipelines.Shutdown();
+    m_device = vk::Device();
+}
+
+uint32_t GPUScene::AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+    return AddMesh(PackVertices(vertices), indices);
+}
+
+uint32_t GPUScene::AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const MeshletData& meshlets)
+{
+    return AddMesh(PackVertices(vertices), indices, meshlets);
+}
+
+uint32_t GPUScene::AddMesh(const PackedVertices& packed, const std::vector<uint32_t>& indices)
+{
+    if(!m_meshlets)
+    {
+        return AddMesh(packed, indices, MeshletData());
+    }
+
+    //bounds from the positions the GPU will see, not the ones before quantization
+    std::vector<glm::vec3> positions;
+    positions.reserve(packed.vertices.size());
+    for(const auto& vertex : packed.vertices)
+    {
+        positions.push_back(UnpackPosition(vertex, packed.quantization));
+    }
+    return AddMesh(packed, indices, BuildMeshlets(positions, indices));
+}
+
+uint32_t GPUScene::AddMesh(const PackedVertices& packed, const std::vector<uint32_t>& indices, const MeshletData& meshlets)
+{
+    const std::vector<PackedVertex>& vertices = packed.vertices;
+    Assert(!vertices.empty() && !indices.empty());
+    Assert(!m_meshlets || !meshlets.meshlets.empty());
+
+    //out of space, or too fragmented for the mesh without a Defragment()
+    const uint32_t vertex_offset = m_vertex_ranges.Allocate(static_cast<uint32_t>(vertices.size()));
+    const uint32_t first_index = m_index_ranges.Allocate(static_cast<uint32_t>(indices.size()));
+    Assert(vertex_offset != RangeAllocator::INVALID_OFFSET);
+    Assert(first_index != RangeAllocator::INVALID_OFFSET);
+
+    m_upload_queue->UploadBuffer(m_vertex_buffer.buffer, sizeof(PackedVertex) * vertex_offset, vertices.data(), sizeof(PackedVertex) * vertices.size());
+    uint64_t upload = m_upload_queue->UploadBuffer(m_index_buffer.buffer, sizeof(uint32_t) * first_index, indices.data(), sizeof(uint32_t) * indices.size());
+
+    MeshAllocation allocation{};
+    allocation.live = true;
+    allocation.vertex_count = static_cast<uint32_t>(vertices.size());
+
+    //offsets into the scene's meshlet buffers, meshlet vertices stay relative to the mesh's
+    //vertex_offset so the vertices can move without them
+    uint32_t first_meshlet = 0;
+    if(m_meshlets)
+    {
+        first_meshlet = m_meshlet_ranges.Allocate(static_cast<uint32_t>(meshlets.meshlets.size()));
+        allocation.meshlet_vertex_offset = m_meshlet_vertex_ranges.Allocate(static_cast<uint32_t>(meshlets.vertices.size()));
+        allocation.meshlet_vertex_count = static_cast<uint32_t>(meshlets.vertices.size());
+        allocation.meshlet_triangle_offset = m_meshlet_triangle_ranges.Allocate(static_cast<uint32_t>(meshlets.triangles.size()));
+        allocation.meshlet_triangle_count = static_cast<uint32_t>(meshlets.triangles.size());
+        Assert(first_meshlet != RangeAllocator::INVALID_OFFSET);
+        Assert(allocation.meshlet_vertex_offset != RangeAllocator::INVALID_OFFSET);
+        Assert(allocation.meshlet_triangle_offset != RangeAllocator::INVALID_OFFSET);
+
+        std::vector<Meshlet> scene_meshlets(meshlets.meshlets);
+        for(auto& meshlet : scene_meshlets)
+        {
+            meshlet.vertex_offset += allocation.meshlet_vertex_offset;
+            meshlet.triangle_offset += allocation.meshlet_triangle_offset;
+        }
+
+        m_upload_queue->UploadBuffer(m_meshlet_buffer.buffer, sizeof(Meshlet) * first_meshlet, scene_meshlets.data(), sizeof(Meshlet) * scene_meshlets.size());
+        m_upload_queue->UploadBuffer
+        (
+            m_meshlet_vertex_buffer.buffer,
+            sizeof(uint32_t) * allocation.meshlet_vertex_offset,
+            meshlets.vertices.data(),
+            sizeof(uint32_t) * meshlets.vertices.size()
+        );
+        upload = m_upload_queue->UploadBuffer
+        (
+            m_meshlet_triangle_buffer.buffer,
+            sizeof(uint32_t) * allocation.meshlet_triangle_offset,
+            meshlets.triangles.data(),
+            sizeof(uint32_t) * meshlets.triangles.size()
+        );
+    }
+
+    glm::vec3 min_position = UnpackPosition(vertices[0], packed.quantization);
+    glm::vec3 max_position = min_position;
+    for(const auto& vertex : vertices)
+    {
+        const glm::vec3 position = UnpackPosition(vertex, packed.quantization);
+        min_position = glm::min(min_position, position);
+        max_position = glm::max(max_position, position);
+    }
+    const glm::vec3 center = (min_position + max_position) * 0.5f;
+    float radius = 0.0f;
+    for(const auto& vertex : vertices)
+    {
+        radius = std::max(radius, glm::length(UnpackPosition(vertex, packed.quantization) - center));
+    }
+
+    GPUMesh mesh{};
+    mesh.index_count = static_cast<uint32_t>(indices.size());
+    mesh.first_index = first_index;
+    mesh.vertex_offset = static_cast<int32_t>(vertex_offset);
+    mesh.first_meshlet = first_meshlet;
+    mesh.sphere = glm::vec4(center, radius);
+    mesh.position_offset = packed.quantization.offset;
+    mesh.position_scale = packed.quantization.scale;
+    mesh.meshlet_count = m_meshlets ? static_cast<uint32_t>(meshlets.meshlets.size()) : 0;
+
+    //a removed mesh's id first, nothing refers to it anymore
+    uint32_t mesh_index = static_cast<uint32_t>(m_meshes.size());
+    if(!m_free_meshes.empty())
+    {
+        mesh_index = m_free_meshes.back();
+        m_free_meshes.pop_back();
+        m_meshes[mesh_index] = mesh;
+        m_mesh_allocations[mesh_index] = allocation;
+    }
+    else
+    {
+        Assert(m_meshes.size() < m_limits.max_meshes);
+        m_meshes.push_back(mesh);
+        m_mesh_allocations.push_back(allocation);
+        m_mesh_ready.push_back(false);
+        m_mesh_object_counts.push_back(0);
+    }
+
+    //published without indices, Update() fills in the counts once the upload is complete
+    GPUMesh unready = mesh;
+    unready.index_count = 0;
+    unready.meshlet_count = 0;
+    memcpy(static_cast<GPUMesh*>(m_mesh_buffer.mapped) + mesh_index, &unready, sizeof(GPUMesh));
+    m_pending_meshes.push_back({mesh_index, upload});
+
+    return mesh_index;
+}
+
+void GPUScene::RemoveMesh(const uint32_t mesh)
+{
+    Assert(mesh < m_meshes.size());
+    Assert(m_mesh_allocations[mesh].live && m_mesh_ready[mesh]);
+    Assert(m_mesh_object_counts[mesh] == 0);
+
+    //a move that hasn't completed gives back its destination too
+    MeshAllocation& allocation = m_mesh_allocations[mesh];
+    if(allocation.moving)
+    {
+        auto cancel = [this, mesh](std::vector<MeshMove>& moves)
+        {
+            auto moved = std::stable_partition(moves.begin(), moves.end(), [mesh](const MeshMove& move) { return move.mesh != mesh; });
+            std::for_each(moved, moves.end(), [this](const MeshMove& move) { RetireMove(move); });
+            moves.erase(moved, moves.end());
+        };
+        cancel(m_queued_moves);
+        for(auto& frame : m_frames)
+        {
+            cancel(frame.moves);
+        }
+    }
+
+    GPUMesh& gpu_mesh = m_meshes[mesh];
+    Retire(m_vertex_ranges, static_cast<uint32_t>(gpu_mesh.vertex_offset), allocation.vertex_count);
+    Retire(m_index_ranges, gpu_mesh.first_index, gpu_mesh.index_count);
+    if(m_meshlets)
+    {
+        Retire(m_meshlet_ranges, gpu_mesh.first_meshlet, gpu_mesh.meshlet_count);
+        Retire(m_meshlet_vertex_ranges, allocation.meshlet_vertex_offset, allocation.meshlet_vertex_count);
+        Retire(m_meshlet_triangle_ranges, allocation.meshlet_triangle_offset, allocation.meshlet_triangle_count);
+    }
+
+    //draws nothing from here on, no object is left to draw it anyway
+    gpu_mesh.index_count = 0;
+    gpu_mesh.meshlet_count = 0;
+    GPUMesh* mapped = static_cast<GPUMesh*>(m_mesh_buffer.mapped) + mesh;
+    mapped->index_count = 0;
+    mapped->meshlet_count = 0;
+
+    allocation = MeshAllocation();
+    m_mesh_ready[mesh] = false;
+    m_free_meshes.push_back(mesh);
+}
+
+void GPUScene::Defragment(const vk::DeviceSize max_bytes)
+{
+    if(m_vertex_ranges.IsCompact() && m_index_ranges.IsCompact())
+    {
+        return;
+    }
+
+    //the meshes furthest back first, they have the most holes in front of them
+    std::vector<uint32_t> candidates;
+    for(uint32_t mesh = 0; mesh < m_meshes.size(); ++mesh)
+    {
+        if(m_mesh_allocations[mesh].live && !m_mesh_allocations[mesh].moving && m_mesh_ready[mesh])
+        {
+            candidates.push_back(mesh);
+        }
+    }
+    std::sort
+    (
+        candidates.begin(),
+        candidates.end(),
+        [this](const uint32_t a, const uint32_t b) { return m_meshes[a].vertex_offset > m_meshes[b].vertex_offset; }
+    );
+
+    //first fit hands out the lowest range that fits, anything at or past the current one is no gain
+    auto move_down = [](RangeAllocator& ranges, const uint32_t offset, const uint32_t size)
+    {
+        const uint32_t new_offset = ranges.Allocate(size);
+        if(new_offset == RangeAllocator::INVALID_OFFSET)
+        {
+            return offset;
+        }
+        if(new_offset > offset)
+        {
+            ranges.Free(new_offset, size);
+            return offset;
+        }
+        return new_offset;
+    };
+
+    vk::DeviceSize bytes = 0;
+    for(const uint32_t mesh : candidates)
+    {
+        const GPUMesh& gpu_mesh = m_meshes[mesh];
+        MeshAllocation& allocation = m_mesh_allocations[mesh];
+        const vk::DeviceSize vertex_bytes = sizeof(PackedVertex) * allocation.vertex_count;
+        const vk::DeviceSize index_bytes = sizeof(uint32_t) * gpu_mesh.index_count;
+        if(bytes + vertex_bytes + index_bytes > max_bytes)
+        {
+            continue;
+        }
+
+        MeshMove move{};
+        move.mesh = mesh;
+        move.vertex_offset = move_down(m_vertex_ranges, static_cast<uint32_t>(gpu_mesh.vertex_offset), allocation.vertex_count);
+        move.first_index = move_down(m_index_ranges, gpu_mesh.first_index, gpu_mesh.index_count);
+        const bool vertices_move = (move.vertex_offset != static_cast<uint32_t>(gpu_mesh.vertex_offset));
+        const bool indices_move = (move.first_index != gpu_mesh.first_index);
+        if(!vertices_move && !indices_move)
+        {
+            continue;
+        }
+
+        bytes += (vertices_move ? vertex_bytes : 0) + (indices_move ? index_bytes : 0);
+        allocation.moving = true;
+        m_queued_moves.push_back(move);
+    }
+}
+
+uint32_t GPUScene::AddObject(const uint32_t mesh, const glm::mat4& transform, const uint32_t colour, const uint32_t texture)
+{
+    Assert((mesh < m_meshes.size()) && m_mesh_allocations[mesh].live);
+    Assert((texture == NO_TEXTURE) || (texture < m_limits.max_textures));
+
+    GPUObject object{};
+    object.transform = transform;
+    object.mesh = mesh;
+    object.colour = colour;
+    object.texture = texture;
+    UpdateSphere(object);
+
+    //a removed object's id first, every frame's copy of it is overwritten through MarkDirty()
+    uint32_t object_index = static_cast<uint32_t>(m_objects.size());
+    if(!m_free_objects.empty())
+    {
+        object_index = m_free_objects.back();
+        m_free_objects.pop_back();
+        m_objects[object_index] = object;
+    }
+    else
+    {
+        Assert(m_objects.size() < m_limits.max_objects);
+        m_objects.push_back(object);
+    }
+    MarkDirty(object_index);
+    if(m_mesh_ready[mesh])
+    {
+        m_changed_bounds.push_back(object.sphere);
+    }
+
+    //the batch grew, every instance range after it moves
+    ++m_mesh_object_counts[mesh];
+    for(auto& frame : m_frames)
+    {
+        frame.batches_dirty = true;
+    }
+
+    return object_index;
+}
+
+void GPUScene::RemoveObject(const uint32_t object)
+{
+    Assert((object < m_objects.size()) && (m_objects[object].mesh != NO_MESH));
+
+    const uint32_t mesh = m_objects[object].mesh;
+    if(m_mesh_ready[mesh])
+    {
+        m_changed_bounds.push_back(m_objects[object].sphere);
+    }
+
+    //the slot stays in the object buffer, the cull pass skips it
+    m_objects[object].mesh = NO_MESH;
+    MarkDirty(object);
+    m_free_objects.push_back(object);
+
+    //the batch shrank, every instance range after it moves
+    --m_mesh_object_counts[mesh];
+    for(auto& frame : m_frames)
+    {
+        frame.batches_dirty = true;
+    }
+}
+
+void GPUScene::SetTransform(const uint32_t object, const glm::mat4& transform)
+{
+    Assert((object < m_objects.size()) && (m_objects[object].mesh != NO_MESH));
+
+    const glm::vec4 previous_sphere = m_objects[object].sphere;
+    m_objects[object].transform = transform;
+    UpdateSphere(m_objects[object]);
+    MarkDirty(object);
+    if(m_mesh_ready[m_objects[object].mesh])
+    {
+        m_changed_bounds.push_back(previous_sphere);
+        m_changed_bounds.push_back(m_objects[object].sphere);
+    }
+}
+
+void GPUScene::SetColour(const uint32_t object, const uint32_t colour)
+{
+    Assert((object < m_objects.size()) && (m_objects[object].mesh != NO_MESH));
+
+    m_objects[object].colour = colour;
+    MarkDirty(object);
+}
+
+void GPUScene::SetDepthPyramid(const vk::ImageView view, const vk::Sampler sampler, const vk::Extent2D& extent, const uint32_t mip_count)
+{
+    Assert(view);
+    Assert(sampler);
+
+    m_pyramid_extent = extent;
+    m_pyramid_mips = mip_count;
+
+    //before the first frame or after a device idle, no cull set is in use
+    const vk::DescriptorImageInfo pyramid_info(sampler, view, vk::ImageLayout::eShaderReadOnlyOptimal);
+    for(auto& frame : m_frames)
+    {
+        const vk::WriteDescriptorSet writes[2] =
+        {
+            vk::WriteDescriptorSet(frame.cull_set, 5, 0, 1, vk::DescriptorType::eCombinedImageSampler, &pyramid_info),
+            vk::WriteDescriptorSet(frame.meshlet_cull_set, 9, 0, 1, vk::DescriptorType::eCombinedImageSampler, &pyramid_info)
+        };
+        m_device.updateDescriptorSets(m_meshlets ? 2 : 1, writes, 0, nullptr);
+    }
+}
+
+void GPUScene::SetTextureTables(const std::vector<vk::Buffer>& tables)
+{
+    Assert(tables.size() == m_frames.size());
+
+    //before the first frame or after a device idle, no draw set is in use
+    for(uint32_t i = 0; i < m_frames.size(); ++i)
+    {
+        const vk::DescriptorBufferInfo table_info(tables[i], 0, VK_WHOLE_SIZE);
+        const vk::WriteDescriptorSet write(m_frames[i].draw_set, TEXTURE_TABLE_BINDING, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &table_info);
+        m_device.updateDescriptorSets(1, &write, 0, nullptr);
+    }
+}
+
+void GPUScene::SetTexture(const uint32_t object, const uint32_t texture)
+{
+    Assert((object < m_objects.size()) && (m_objects[object].mesh != NO_MESH));
+    Assert((texture == NO_TEXTURE) || (texture < m_limits.max_textures));
+
+    m_objects[object].texture = texture;
+    MarkDirty(object);
+}
+
+void GPUScene::Update(const uint32_t frame_index, const vk::Extent2D& extent)
+{
+    m_frame_index = frame_index;
+    FrameData& frame = m_frames[frame_index];
+
+    //the last submission of this frame is done, and with it every frame that could read these
+    for(const auto& retired : m_retired_ranges[frame_index])
+    {
+        retired.allocator->Free(retired.offset, retired.size);
+    }
+    m_retired_ranges[frame_index].clear();
+
+    //so are the copies it recorded, meshes switch over while frames in flight keep the old copy
+    for(const auto& move : frame.moves)
+    {
+        GPUMesh& mesh = m_meshes[move.mesh];
+        const MeshMove previous{move.mesh, static_cast<uint32_t>(mesh.vertex_offset), mesh.first_index};
+        mesh.vertex_offset = static_cast<int32_t>(move.vertex_offset);
+        mesh.first_index = move.first_index;
+        //single aligned words, either copy is complete
+        GPUMesh* mapped = static_cast<GPUMesh*>(m_mesh_buffer.mapped) + move.mesh;
+        mapped->vertex_offset = mesh.vertex_offset;
+        mapped->first_index = mesh.first_index;
+        RetireMove(previous);
+        m_mesh_allocations[move.mesh].moving = false;
+    }
+    frame.moves.swap(m_queued_moves);
+    m_queued_moves.clear();
+
+    auto ready = std::remove_if
+    (
+        m_pending_meshes.begin(),
+        m_pending_meshes.end(),
+        [this](const PendingMesh& pending)
+        {
+            if(!m_upload_queue->IsComplete(pending.upload))
+            {
+                return false;
+            }
+            //single aligned words, frames still in flight see either zero or the real count
+            GPUMesh* mapped = static_cast<GPUMesh*>(m_mesh_buffer.mapped) + pending.mesh;
+            mapped->index_count = m_meshes[pending.mesh].index_count;
+            mapped->meshlet_count = m_meshes[pending.mesh].meshlet_count;
+            m_mesh_ready[pending.mesh] = true;
+            for(const auto& object : m_objects)
+            {
+                if(object.mesh == pending.mesh)
+                {
+                    m_changed_bounds.push_back(object.sphere);
+                }
+            }
+            return true;
+        }
+    );
+    m_pending_meshes.erase(ready, m_pending_meshes.end());
+
+    frame.object_count = static_cast<uint32_t>(m_objects.size());
+    frame.batch_count = static_cast<uint32_t>(m_meshes.size());
+
+    //what the cull pass wrote the last time this frame's buffers were used, cleared for this frame
+    if(m_limits.max_textures > 0)
+    {
+        memcpy(m_texture_feedback.data(), frame.texture_feedback.mapped, sizeof(uint32_t) * m_limits.max_textures);
+        memset(frame.texture_feedback.mapped, 0, sizeof(uint32_t) * m_limits.max_textures);
+    }
+
+    CullParams params{};
+    GetFrustumPlanes(m_view_projection, params.planes);
+    params.view_projection = m_view_projection;
+    //the pyramid this frame culls against is built at the end of the previous frame
+    params.previous_view_projection = m_previous_view_projection;
+    params.pyramid_size = glm::vec2(static_cast<float>(m_pyramid_extent.width), static_cast<float>(m_pyramid_extent.height));
+    params.object_count = frame.object_count;
+    params.pyramid_mips = m_pyramid_mips;
+    params.screen_size = glm::vec2(static_cast<float>(extent.width), static_cast<float>(extent.height));
+    params.texture_count = m_limits.max_textures;
+    params.meshlets = m_meshlets ? 1 : 0;
+    //perspective only, the camera is the point the projection sends to w = 0
+    const glm::vec4 camera = glm::inverse(m_view_projection) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+    params.camera_position = glm::vec4(glm::vec3(camera) / camera.w, 1.0f);
+    params.max_visible_meshlets = m_limits.max_visible_meshlets;
+    memcpy(frame.cull_params.mapped, &params, sizeof(CullParams));
+    m_previous_view_projection = m_view_projection;
+
+    //instance ranges are packed in mesh order, sized for every object before culling
+    if(frame.batches_dirty)
+    {
+        uint32_t* first_instances = static_cast<uint32_t*>(frame.batches.mapped);
+        uint32_t first_instance = 0;
+        for(uint32_t mesh = 0; mesh < frame.batch_count; ++mesh)
+        {
+            first_instances[mesh] = first_instance;
+            first_instance += m_mesh_object_counts[mesh];
+        }
+        frame.batches_dirty = false;
+    }
+
+    if(frame.dirty_begin >= frame.dirty_end)
+    {
+        return;
+    }
+
+    memcpy
+    (
+        static_cast<GPUObject*>(frame.objects.mapped) + frame.dirty_begin,
+        &m_objects[frame.dirty_begin],
+        (frame.dirty_end - frame.dirty_begin) * sizeof(GPUObject)
+    );
+    frame.dirty_begin = UINT32_MAX;
+    frame.dirty_end = 0;
+}
+
+std::vector<glm::vec4> GPUScene::TakeChangedBounds()
+{
+    std::vector<glm::vec4> changed_bounds;
+    changed_bounds.swap(m_changed_bounds);
+    return changed_bounds;
+}
+
+void GPUScene::RecordReset(const vk::CommandBuffer command_buffer) const
+{
+    RecordMoves(command_buffer);
+
+    if(!m_meshlets)
+    {
+        command_buffer.fillBuffer(m_count_buffer.buffer, 0, sizeof(uint32_t), 0);
+        command_buffer.fillBuffer(m_batch_count_buffer.buffer, 0, VK_WHOLE_SIZE, 0);
+        return;
+    }
+
+    //the cull pass only ever grows the dispatch, nothing visible is an empty one
+    const vk::DispatchIndirectCommand dispatch(0, 0, 1);
+    MeshletDraw draw{};
+    draw.draw.instanceCount = 1;
+    command_buffer.fillBuffer(m_visible_object_buffer.buffer, 0, sizeof(uint32_t), 0);
+    command_buffer.updateBuffer(m_meshlet_dispatch_buffer.buffer, 0, sizeof(dispatch), &dispatch);
+    command_buffer.updateBuffer(m_meshlet_draw_buffer.buffer, 0, sizeof(draw), &draw);
+}
+
+void GPUScene::RecordCull(const vk::CommandBuffer command_buffer, const uint32_t frame_index) const
+{
+    const FrameData& frame = m_frames[frame_index];
+    if(frame.object_count == 0)
+    {
+        return;
+    }
+    Assert(m_pyramid_mips > 0);
+
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_cull_pipeline);
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_cull_pipeline_layout, 0, frame.cull_set, nullptr);
+    command_buffer.dispatch((frame.object_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    //the texture feedback is read on the host once the frame's fence is waited on
+    const vk::BufferMemoryBarrier barrier
+    (
+        vk::AccessFlagBits::eShaderWrite,
+        vk::AccessFlagBits::eHostRead,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        frame.texture_feedback.buffer,
+        0,
+        VK_WHOLE_SIZE
+    );
+    command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {}, nullptr, barrier, nullptr);
+}
+
+void GPUScene::RecordBatch(const vk::CommandBuffer command_buffer, const uint32_t frame_index) const
+{
+    const FrameData& frame = m_frames[frame_index];
+    if(frame.batch_count == 0)
+    {
+        return;
+    }
+
+    BatchConstants constants{};
+    constants.batch_count = frame.batch_count;
+    constants.compact = m_draw_indirect_count ? 1 : 0;
+
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_batch_pipeline);
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_batch_pipeline_layout, 0, frame.batch_set, nullptr);
+    command_buffer.pushConstants(m_batch_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(BatchConstants), &constants);
+    command_buffer.dispatch((frame.batch_count + BATCH_GROUP_SIZE - 1) / BATCH_GROUP_SIZE, 1, 1);
+}
+
+void GPUScene::RecordMeshletCull(const vk::CommandBuffer command_buffer, const uint32_t frame_index) const
+{
+    const FrameData& frame = m_frames[frame_index];
+    if(frame.object_count == 0)
+    {
+        return;
+    }
+
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_meshlet_cull_pipeline);
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_meshlet_cull_pipeline_layout, 0, frame.meshlet_cull_set, nullptr);
+    command_buffer.dispatchIndirect(m_meshlet_dispatch_buffer.buffer, 0);
+}
+
+void GPUScene::RecordDraw(const vk::CommandBuffer command_buffer, const uint32_t frame_index, const vk::Extent2D& extent, const vk::DescriptorSet lighting_set) const
+{
+    //nothing is drawn until the pipeline has been compiled in the background
+    const FrameData& frame = m_frames[frame_index];
+    const vk::Pipeline draw_pipeline = m_draw_pipelines.GetVariantCount() > 0 ? m_draw_pipelines.Get(m_features) : vk::Pipeline();
+    if((frame.object_count == 0) || !draw_pipeline)
+    {
+        return;
+    }
+
+    const vk::Viewport viewport(0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f);
+    const vk::Rect2D scissor({0, 0}, extent);
+    const vk::DeviceSize vertex_offset = 0;
+
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, draw_pipeline);
+    command_buffer.setViewport(0, viewport);
+    command_buffer.setScissor(0, scissor);
+    const vk::DescriptorSet sets[2] = {frame.draw_set, lighting_set};
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_draw_pipeline_layout, 0, 2, sets, 0, nullptr);
+    if(m_bindless_heap)
+    {
+        m_bindless_heap->Bind(command_buffer, vk::PipelineBindPoint::eGraphics, m_draw_pipeline_layout, BINDLESS_SET);
+    }
+    command_buffer.pushConstants(m_draw_pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4), &m_view_projection);
+
+    //every visible meshlet in one draw, its index count comes from the meshlet cull pass
+    if(m_meshlets)
+    {
+        command_buffer.bindIndexBuffer(m_meshlet_index_buffer.buffer, 0, vk::IndexType::eUint32);
+        command_buffer.drawIndexedIndirect(m_meshlet_draw_buffer.buffer, 0, 1, sizeof(MeshletDraw));
+        return;
+    }
+
+    command_buffer.bindVertexBuffers(0, 1, &m_vertex_buffer.buffer, &vertex_offset);
+    command_buffer.bindIndexBuffer(m_index_buffer.buffer, 0, vk::IndexType::eUint32);
+
+    //without drawIndirectCount the batch pass keeps every slot and leaves empty batches with no instances
+    if(m_draw_indirect_count)
+    {
+        command_buffer.drawIndexedIndirectCount(m_draw_buffer.buffer, 0, m_count_buffer.buffer, 0, frame.batch_count, sizeof(vk::DrawIndexedIndirectCommand));
+    }
+    else
+    {
+        command_buffer.drawIndexedIndirect(m_draw_buffer.buffer, 0, frame.batch_count, sizeof(vk::DrawIndexedIndirectCommand));
+    }
+}
+
+void GPUScene::SubmitDepth
+(
+    DrawList& draws,
+    const uint32_t thread,
+    const uint32_t pass,
+    const uint32_t layer,
+    const PipelineManager::Handle pipeline,
+    const vk::PipelineLayout layout,
+    DrawConstants& draw_constants,
+    const glm::mat4& view_projection,
+    const glm::mat4& view
+) const
+{
+    Assert(draw_constants.GetSize() == sizeof(DepthConstants));
+
+    glm::vec4 planes[6];
+    GetFrustumPlanes(view_projection, planes);
+
+    DrawList::Draw draw{};
+    draw.pipeline = pipeline;
+    draw.layout = layout;
+    draw.vertex_buffer = m_vertex_buffer.buffer;
+    draw.index_buffer = m_index_buffer.buffer;
+    draw.constants = &draw_constants;
+
+    for(const auto& object : m_objects)
+    {
+        if((object.mesh == NO_MESH) || !m_mesh_ready[object.mesh] || !InFrustum(planes, object.sphere))
+        {
+            continue;
+        }
+
+        //the vertex stage gets quantized positions, dequantizing is one more transform
+        const GPUMesh& mesh = m_meshes[object.mesh];
+        const glm::mat4 dequantize = glm::scale(glm::translate(glm::mat4(1.0f), mesh.position_offset), mesh.position_scale);
+        DepthConstants constants{};
+        constants.clip = view_projection * object.transform * dequantize;
+        constants.view = view * object.transform * dequantize;
+
+        //nearest first, what they hide fails the depth test early
+        const float depth = glm::length(glm::vec3(view * glm::vec4(glm::vec3(object.sphere), 1.0f)));
+        draw.key = DrawList::MakeKey(pass, layer, pipeline, 0, depth);
+        draw.index_count = mesh.index_count;
+        draw.first_index = mesh.first_index;
+        draw.vertex_offset = mesh.vertex_offset;
+        draws.Submit(thread, draw, &constants);
+    }
+}
+
+void GPUScene::GetFrustumPlanes(const glm::mat4& view_projection, glm::vec4 (&planes)[6])
+{
+    //straight from the rows of the view projection matrix
+    const glm::mat4& m = view_projection;
+    const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    planes[0] = row3 + row0;
+    planes[1] = row3 - row0;
+    planes[2] = row3 + row1;
+    planes[3] = row3 - row1;
+    planes[4] = row2;
+    planes[5] = row3 - row2;
+    for(auto& plane : planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+bool GPUScene::InFrustum(const glm::vec4 (&planes)[6], const glm::vec4& sphere)
+{
+    for(const auto& plane : planes)
+    {
+        if(glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w <= -sphere.w)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void GPUScene::UpdateSphere(GPUObject& object) const
+{
+    const glm::vec4& local_sphere = m_meshes[object.mesh].sphere;
+    const glm::vec3 center(object.transform * glm::vec4(glm::vec3(local_sphere), 1.0f));
+    const float scale = std::max
+    ({
+        glm::length(glm::vec3(object.transform[0])),
+        glm::length(glm::vec3(object.transform[1])),
+        glm::length(glm::vec3(object.transform[2]))
+    });
+    object.sphere = glm::vec4(center, local_sphere.w * scale);
+}
+
+void GPUScene::Retire(RangeAllocator& allocator, const uint32_t offset, const uint32_t size)
+{
+    if(size > 0)
+    {
+        m_retired_ranges[m_frame_index].push_back({&allocator, offset, size});
+    }
+}
+
+void GPUScene::RetireMove(const MeshMove& move)
+{
+    const GPUMesh& mesh = m_meshes[move.mesh];
+    if(move.vertex_offset != static_cast<uint32_t>(mesh.vertex_offset))
+    {
+        Retire(m_vertex_ranges, move.vertex_offset, m_mesh_allocations[move.mesh].vertex_count);
+    }
+    if(move.first_index != mesh.first_index)
+    {
+        Retire(m_index_ranges, move.first_index, mesh.index_count);
+    }
+}
+
+void GPUScene::RecordMoves(const vk::CommandBuffer command_buffer) const
+{
+    const FrameData& frame = m_frames[m_frame_index];
+    if(frame.moves.empty())
+    {
+        return;
+    }
+
+    std::vector<vk::BufferCopy> vertex_copies;
+    std::vector<vk::BufferCopy> index_copies;
+    for(const auto& move : frame.moves)
+    {
+        const GPUMesh& mesh = m_meshes[move.mesh];
+        if(move.vertex_offset != static_cast<uint32_t>(mesh.vertex_offset))
+        {
+            vertex_copies.emplace_back
+            (
+                sizeof(PackedVertex) * static_cast<uint32_t>(mesh.vertex_offset),
+                sizeof(PackedVertex) * move.vertex_offset,
+                sizeof(PackedVertex) * m_mesh_allocations[move.mesh].vertex_count
+            );
+        }
+        if(move.first_index != mesh.first_index)
+        {
+            index_copies.emplace_back(sizeof(uint32_t) * mesh.first_index, sizeof(uint32_t) * move.first_index, sizeof(uint32_t) * mesh.index_count);
+        }
+    }
+
+    //whatever wrote the sources, their uploads included
+    const vk::MemoryBarrier before(vk::AccessFlagBits::eMemoryWrite, vk::AccessFlagBits::eTransferRead);
+    command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer, {}, before, nullptr, nullptr);
+
+    //sources and destinations never overlap, both are allocated at the same time
+    if(!vertex_copies.empty())
+    {
+        command_buffer.copyBuffer(m_vertex_buffer.buffer, m_vertex_buffer.buffer, vertex_copies);
+    }
+    if(!index_copies.empty())
+    {
+        command_buffer.copyBuffer(m_index_buffer.buffer, m_index_buffer.buffer, index_copies);
+    }
+
+    //nothing reads the destinations before Update() switches to them frames later, the barrier
+    //covers every later submission on the queue
+    const vk::MemoryBarrier after
+    (
+        vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead
+    );
+    command_buffer.pipelineBarrier
+    (
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eTransfer,
+        {},
+        after,
+        nullptr,
+        nullptr
+    );
+}
+
+void GPUScene::MarkDirty(const uint32_t object)
+{
+    for(auto& frame : m_frames)
+    {
+        frame.dirty_begin = std::min(frame.dirty_begin, object);
+        frame.dirty_end = std::max(frame.dirty_end, object + 1);
+    }
+}
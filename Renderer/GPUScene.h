@@ -0,0 +1,348 @@
+#pragma once
+
+#include "Meshlets.h"
+#include "RangeAllocator.h"
+#include "ShaderPermutations.h"
+#include "VertexFormat.h"
+#include "VKUtils.h"
+
+class BindlessHeap;
+class DescriptorAllocator;
+class DrawConstants;
+class DrawList;
+class UploadQueue;
+
+//GPU driven path: meshes, objects and their bounds live in GPU buffers, a compute pass
+//frustum and occlusion culls every object and appends the visible ones to their batch's instance list,
+//a second one turns every batch into one instanced indirect draw plus the draw count, the
+//main pass then draws everything visible with one drawIndexedIndirectCount
+//objects sharing a mesh are one batch, so a thousand copies of a prop are a single draw
+//CPU cost per frame only depends on how many objects changed, not on how many there are
+//mesh data goes through the upload queue, a mesh draws nothing until its upload has landed
+//occlusion is tested against the previous frame's depth pyramid with the previous frame's camera,
+//so an object that comes out from behind an occluder shows up a frame late
+//visible objects with a texture also report how many pixels they cover, the largest per texture
+//is read back once the frame is done and drives texture streaming, see TextureStreamer
+//with a bindless heap the draw pipelines bind it once as set 2 and sample every object's texture
+//from it, no per draw descriptors; the heap slot of every texture id comes from a per frame
+//texture table, see SetTextureTables()
+//meshlet mode replaces batches: visible objects go on to a second pass that culls every one of
+//their meshlets on its own (frustum, normal cone, Hi-Z) and writes the triangles of the survivors
+//into one index buffer, drawn by a single drawIndexedIndirect that pulls its vertices from storage
+//buffers, so triangles of a mostly hidden object that would never reach a pixel never reach the rasterizer
+//vertices are stored packed, see VertexFormat.h, every mesh keeps its own position quantization
+//all meshes share one vertex and one index buffer, sub-allocated through free lists, a draw only
+//carries offsets into them; RemoveMesh() leaves holes that Defragment() closes by copying meshes
+//further down on the GPU, a moved mesh switches to its new offsets once the copy has completed and
+//frames still in flight keep drawing the old copy, which is freed after them
+
+class GPUScene
+{
+public:
+    static constexpr uint32_t NO_TEXTURE = UINT32_MAX;
+
+    using Vertex = SourceVertex;
+
+    struct Limits
+    {
+        uint32_t max_objects;
+        uint32_t max_meshes;
+        uint32_t max_vertices;
+        uint32_t max_indices;
+        uint32_t max_textures; //texture ids objects can refer to
+        //meshlet mode only
+        uint32_t max_meshlets;
+        uint32_t max_meshlet_vertices;
+        uint32_t max_visible_meshlets; //per frame, the index buffer is sized for all of them to be full
+    };
+
+    void Init
+    (
+        const vk::PhysicalDevice physical_device,
+        const vk::Device device,
+        DescriptorAllocator& descriptor_allocator,
+        UploadQueue& upload_queue,
+        const Limits& limits,
+        const uint32_t frames_in_flight,
+        const bool draw_indirect_count,
+        const bool meshlets
+    );
+    //needs the render pass from the compiled render graph, every draw pipeline variant compiles in the background
+    //lighting_set_layout is set 1 of the draw pipelines, see ClusteredLighting
+    //bindless_heap is set 2, objects are drawn untextured without one
+    void InitPipelines
+    (
+        PipelineManager& pipelines,
+        const vk::RenderPass render_pass,
+        const uint32_t subpass,
+        const vk::SampleCountFlagBits samples,
+        const vk::DescriptorSetLayout lighting_set_layout,
+        const BindlessHeap* bindless_heap
+    );
+    void Shutdown();
+
+    //meshlet mode splits the mesh into meshlets here, pass them in when the asset already has them
+    //vertices are packed here too, pass PackedVertices when the asset was packed offline
+    uint32_t AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+    uint32_t AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const MeshletData& meshlets);
+    uint32_t AddMesh(const PackedVertices& vertices, const std::vector<uint32_t>& indices);
+    uint32_t AddMesh(const PackedVertices& vertices, const std::vector<uint32_t>& indices, const MeshletData& meshlets);
+    //no object may use the mesh and its upload has to be complete, a later AddMesh() reuses the id
+    void RemoveMesh(const uint32_t mesh);
+    //moves meshes towards the start of the vertex and index buffers, at most max_bytes of copies
+    //recorded by the next RecordReset(), nothing to do without holes; meshlets don't move
+    void Defragment(const vk::DeviceSize max_bytes);
+    //colour is an RGBA8 tint, red in the lowest byte
+    uint32_t AddObject(const uint32_t mesh, const glm::mat4& transform, const uint32_t colour = 0xFFFFFFFF, const uint32_t texture = NO_TEXTURE);
+    //a later AddObject() reuses the id, once a mesh has no objects left it can be removed
+    void RemoveObject(const uint32_t object);
+    void SetTransform(const uint32_t object, const glm::mat4& transform);
+    void SetColour(const uint32_t object, const uint32_t colour);
+    void SetTexture(const uint32_t object, const uint32_t texture);
+    void SetViewProjection(const glm::mat4& view_projection) { m_view_projection = view_projection; }
+    //Hi-Z for occlusion culling, see DepthPyramid, has to be set before the first frame is culled
+    void SetDepthPyramid(const vk::ImageView view, const vk::Sampler sampler, const vk::Extent2D& extent, const uint32_t mip_count);
+    //per frame in flight: the sampler's heap slot followed by the image slot of every texture id,
+    //NO_TEXTURE where nothing is resident yet; has to be set before the first frame is drawn with a heap
+    void SetTextureTables(const std::vector<vk::Buffer>& tables);
+    //ShaderFeature bits the draw pipeline is specialized on
+    void SetFeatures(const uint32_t features) { m_features = features; }
+
+    //host side, before the frame is recorded, extent is the size of the render target
+    void Update(const uint32_t frame_index, const vk::Extent2D& extent);
+    //world space spheres objects were added, moved from or moved to since the last call, and
+    //those of objects whose mesh finished uploading, for caching anything rendered from the scene
+    std::vector<glm::vec4> TakeChangedBounds();
+    //largest screen size in pixels of every texture, from the last frame Update() collected, 0 if unseen
+    const std::vector<uint32_t>& GetTextureFeedback() const { return m_texture_feedback; }
+
+    //render graph passes, in this order
+    void RecordReset(const vk::CommandBuffer command_buffer) const;
+    void RecordCull(const vk::CommandBuffer command_buffer, const uint32_t frame_index) const;
+    void RecordBatch(const vk::CommandBuffer command_buffer, const uint32_t frame_index) const; //batch mode
+    void RecordMeshletCull(const vk::CommandBuffer command_buffer, const uint32_t frame_index) const; //meshlet mode
+    void RecordDraw(const vk::CommandBuffer command_buffer, const uint32_t frame_index, const vk::Extent2D& extent, const vk::DescriptorSet lighting_set) const;
+    //CPU culled draws of every loaded object in the frustum of view_projection, for passes that
+    //only render parts of the scene now and then, the pipeline takes the quantized position of a
+    //PackedVertex at binding 0 and DepthConstants, which include its dequantization, through
+    //draw_constants, layout has to come from its CreatePipelineLayout(); keyed front to back inside
+    //their pass and layer
+    void SubmitDepth
+    (
+        DrawList& draws,
+        const uint32_t thread,
+        const uint32_t pass,
+        const uint32_t layer,
+        const PipelineManager::Handle pipeline,
+        const vk::PipelineLayout layout,
+        DrawConstants& draw_constants,
+        const glm::mat4& view_projection,
+        const glm::mat4& view
+    ) const;
+
+    struct DepthConstants
+    {
+        glm::mat4 clip; //object to clip space
+        glm::mat4 view; //object to view space
+    };
+
+    //normalized planes of a [0, w] clip space frustum, pointing inwards
+    static void GetFrustumPlanes(const glm::mat4& view_projection, glm::vec4 (&planes)[6]);
+    static bool InFrustum(const glm::vec4 (&planes)[6], const glm::vec4& sphere);
+
+    vk::Buffer GetDrawBuffer() const { return m_draw_buffer.buffer; }
+    vk::Buffer GetCountBuffer() const { return m_count_buffer.buffer; }
+    vk::Buffer GetInstanceBuffer() const { return m_instance_buffer.buffer; }
+    vk::Buffer GetBatchCountBuffer() const { return m_batch_count_buffer.buffer; }
+    bool UsesMeshlets() const { return m_meshlets; }
+    vk::Buffer GetVisibleObjectBuffer() const { return m_visible_object_buffer.buffer; }
+    vk::Buffer GetMeshletDispatchBuffer() const { return m_meshlet_dispatch_buffer.buffer; }
+    vk::Buffer GetVisibleMeshletBuffer() const { return m_visible_meshlet_buffer.buffer; }
+    vk::Buffer GetMeshletDrawBuffer() const { return m_meshlet_draw_buffer.buffer; }
+    vk::Buffer GetMeshletIndexBuffer() const { return m_meshlet_index_buffer.buffer; }
+
+private:
+    //std430 layouts shared with Cull.comp, Batch.comp, ClusterCull.comp, Indirect.vert and Meshlet.vert
+    static constexpr uint32_t NO_MESH = UINT32_MAX;
+
+    struct GPUObject
+    {
+        glm::mat4 transform;
+        glm::vec4 sphere; //world space, w is the radius
+        uint32_t mesh; //also its batch, NO_MESH once removed
+        uint32_t colour;
+        uint32_t texture;
+        uint32_t pad;
+    };
+    static_assert(sizeof(GPUObject) == 96, "GPUObject layout");
+
+    struct GPUMesh
+    {
+        uint32_t index_count;
+        uint32_t first_index;
+        int32_t vertex_offset;
+        uint32_t first_meshlet;
+        glm::vec4 sphere; //object space
+        glm::vec3 position_offset; //VertexQuantization
+        uint32_t meshlet_count;
+        glm::vec3 position_scale;
+        uint32_t pad;
+    };
+    static_assert(sizeof(GPUMesh) == 64, "GPUMesh layout");
+
+    //the indirect draw and how many meshlets passed, which can be more than fit
+    struct MeshletDraw
+    {
+        vk::DrawIndexedIndirectCommand draw;
+        uint32_t visible_meshlet_count;
+    };
+
+    //std140, Cull.comp and ClusterCull.comp
+    struct CullParams
+    {
+        glm::vec4 planes[6];
+        glm::mat4 view_projection;
+        glm::mat4 previous_view_projection; //what the depth pyramid was rendered with
+        glm::vec2 pyramid_size;
+        uint32_t object_count;
+        uint32_t pyramid_mips;
+        glm::vec2 screen_size;
+        uint32_t texture_count;
+        uint32_t meshlets;
+        glm::vec4 camera_position;
+        uint32_t max_visible_meshlets;
+        uint32_t pad[3];
+    };
+    static_assert(sizeof(CullParams) == 288, "CullParams layout");
+
+    struct BatchConstants
+    {
+        uint32_t batch_count;
+        uint32_t compact;
+    };
+
+    //destination of a defragmenting copy, the source where it is when unchanged
+    struct MeshMove
+    {
+        uint32_t mesh;
+        uint32_t vertex_offset;
+        uint32_t first_index;
+    };
+
+    //freed once the frames in flight that could still read it are done
+    struct RetiredRange
+    {
+        RangeAllocator* allocator;
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    struct FrameData
+    {
+        BufferAllocation objects{};
+        BufferAllocation batches{}; //first instance of every batch
+        BufferAllocation cull_params{};
+        BufferAllocation texture_feedback{}; //written by the cull pass, see GetTextureFeedback()
+        vk::DescriptorSet cull_set{};
+        vk::DescriptorSet batch_set{};
+        vk::DescriptorSet draw_set{};
+        vk::DescriptorSet meshlet_cull_set{};
+        //objects uploaded to this frame's buffer, culled and drawn
+        uint32_t object_count = 0;
+        uint32_t batch_count = 0;
+        bool batches_dirty = false;
+        //objects written since this frame's buffer was last updated
+        uint32_t dirty_begin = UINT32_MAX;
+        uint32_t dirty_end = 0;
+        //copied by this frame's RecordReset(), done when the frame comes around again
+        std::vector<MeshMove> moves{};
+    };
+
+    struct PendingMesh
+    {
+        uint32_t mesh;
+        uint64_t upload;
+    };
+
+    //what a mesh holds in the sub-allocated buffers besides the ranges in its GPUMesh
+    struct MeshAllocation
+    {
+        bool live = false;
+        bool moving = false;
+        uint32_t vertex_count = 0;
+        //meshlet mode
+        uint32_t meshlet_vertex_offset = 0;
+        uint32_t meshlet_vertex_count = 0;
+        uint32_t meshlet_triangle_offset = 0;
+        uint32_t meshlet_triangle_count = 0;
+    };
+
+    void UpdateSphere(GPUObject& object) const;
+    void MarkDirty(const uint32_t object);
+    void Retire(RangeAllocator& allocator, const uint32_t offset, const uint32_t size);
+    void RetireMove(const MeshMove& move);
+    void RecordMoves(const vk::CommandBuffer command_buffer) const;
+
+    vk::PhysicalDevice m_physical_device{};
+    vk::Device m_device{};
+    UploadQueue* m_upload_queue = nullptr;
+    const BindlessHeap* m_bindless_heap = nullptr;
+    Limits m_limits{};
+    bool m_draw_indirect_count = false;
+    bool m_meshlets = false;
+
+    BufferAllocation m_vertex_buffer{};
+    BufferAllocation m_index_buffer{};
+    BufferAllocation m_mesh_buffer{};
+    BufferAllocation m_draw_buffer{};
+    BufferAllocation m_count_buffer{};
+    BufferAllocation m_instance_buffer{};
+    BufferAllocation m_batch_count_buffer{};
+    BufferAllocation m_visible_object_buffer{};
+    BufferAllocation m_meshlet_dispatch_buffer{};
+    //meshlet mode only
+    BufferAllocation m_meshlet_buffer{};
+    BufferAllocation m_meshlet_vertex_buffer{}; //mesh vertex of every meshlet vertex, relative to its vertex_offset
+    BufferAllocation m_meshlet_triangle_buffer{};
+    BufferAllocation m_visible_meshlet_buffer{};
+    BufferAllocation m_meshlet_draw_buffer{};
+    BufferAllocation m_meshlet_index_buffer{};
+    std::vector<FrameData> m_frames{};
+
+    std::vector<GPUMesh> m_meshes{};
+    std::vector<MeshAllocation> m_mesh_allocations{};
+    std::vector<uint32_t> m_free_meshes{};
+    std::vector<bool> m_mesh_ready{};
+    std::vector<uint32_t> m_mesh_object_counts{}; //batch sizes before culling
+    std::vector<PendingMesh> m_pending_meshes{};
+    std::vector<GPUObject> m_objects{};
+    std::vector<uint32_t> m_free_objects{};
+    std::vector<uint32_t> m_texture_feedback{};
+    std::vector<glm::vec4> m_changed_bounds{};
+    RangeAllocator m_vertex_ranges{};
+    RangeAllocator m_index_ranges{};
+    RangeAllocator m_meshlet_ranges{};
+    RangeAllocator m_meshlet_vertex_ranges{};
+    RangeAllocator m_meshlet_triangle_ranges{};
+    std::vector<MeshMove> m_queued_moves{}; //for the next frame
+    std::vector<std::vector<RetiredRange>> m_retired_ranges{}; //per frame in flight
+    uint32_t m_frame_index = 0;
+    glm::mat4 m_view_projection{1.0f};
+    glm::mat4 m_previous_view_projection{1.0f};
+    vk::Extent2D m_pyramid_extent{};
+    uint32_t m_pyramid_mips = 0;
+
+    vk::DescriptorSetLayout m_cull_set_layout{};
+    vk::DescriptorSetLayout m_batch_set_layout{};
+    vk::DescriptorSetLayout m_draw_set_layout{};
+    vk::DescriptorSetLayout m_meshlet_cull_set_layout{};
+    vk::PipelineLayout m_cull_pipeline_layout{};
+    vk::PipelineLayout m_batch_pipeline_layout{};
+    vk::PipelineLayout m_draw_pipeline_layout{};
+    vk::PipelineLayout m_meshlet_cull_pipeline_layout{};
+    vk::Pipeline m_cull_pipeline{};
+    vk::Pipeline m_batch_pipeline{};
+    vk::Pipeline m_meshlet_cull_pipeline{};
+    ShaderPermutations m_draw_pipelines{};
+    uint32_t m_features = 0;
+};
@@ -0,0 +1,177 @@
+#include "stdafx.h"
+#include "Meshlets.h"
+
+static const uint8_t NOT_IN_MESHLET = 0xFF;
+
+static void ComputeBounds(const std::vector<glm::vec3>& positions, const MeshletData& data, Meshlet& meshlet)
+{
+    glm::vec3 min_position = positions[data.vertices[meshlet.vertex_offset]];
+    glm::vec3 max_position = min_position;
+    for(uint32_t v = 0; v < meshlet.vertex_count; ++v)
+    {
+        const glm::vec3& position = positions[data.vertices[meshlet.vertex_offset + v]];
+        min_position = glm::min(min_position, position);
+        max_position = glm::max(max_position, position);
+    }
+    const glm::vec3 center = (min_position + max_position) * 0.5f;
+    float radius = 0.0f;
+    for(uint32_t v = 0; v < meshlet.vertex_count; ++v)
+    {
+        radius = std::max(radius, glm::length(positions[data.vertices[meshlet.vertex_offset + v]] - center));
+    }
+    meshlet.sphere = glm::vec4(center, radius);
+
+    //counter-clockwise front faces, degenerate triangles don't face anywhere
+    std::vector<glm::vec3> normals;
+    glm::vec3 normal_sum(0.0f);
+    for(uint32_t t = 0; t < meshlet.triangle_count; ++t)
+    {
+        const uint32_t packed = data.triangles[meshlet.triangle_offset + t];
+        const glm::vec3& a = positions[data.vertices[meshlet.vertex_offset + (packed & 0xFF)]];
+        const glm::vec3& b = positions[data.vertices[meshlet.vertex_offset + ((packed >> 8) & 0xFF)]];
+        const glm::vec3& c = positions[data.vertices[meshlet.vertex_offset + ((packed >> 16) & 0xFF)]];
+        const glm::vec3 normal = glm::cross(b - a, c - a);
+        const float length = glm::length(normal);
+        if(length > 0.0f)
+        {
+            normals.push_back(normal / length);
+            normal_sum += normals.back();
+        }
+    }
+
+    //no cone when the normals spread over a half space or more, some triangle always faces the camera
+    meshlet.cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    const float sum_length = glm::length(normal_sum);
+    if(sum_length < 1e-6f)
+    {
+        return;
+    }
+    const glm::vec3 axis = normal_sum / sum_length;
+    float min_dot = 1.0f;
+    for(const auto& normal : normals)
+    {
+        min_dot = std::min(min_dot, glm::dot(normal, axis));
+    }
+    if(min_dot > 0.0f)
+    {
+        meshlet.cone = glm::vec4(axis, std::sqrt(1.0f - min_dot * min_dot));
+    }
+}
+
+MeshletData BuildMeshlets(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+{
+    Assert(indices.size() % 3 == 0);
+
+    const uint32_t vertex_count = static_cast<uint32_t>(positions.size());
+    const uint32_t triangle_count = static_cast<uint32_t>(indices.size() / 3);
+
+    //triangles around every vertex
+    std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+    for(const uint32_t index : indices)
+    {
+        Assert(index < vertex_count);
+        ++adjacency_offsets[index + 1];
+    }
+    for(uint32_t v = 0; v < vertex_count; ++v)
+    {
+        adjacency_offsets[v + 1] += adjacency_offsets[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> cursors(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+    for(uint32_t i = 0; i < indices.size(); ++i)
+    {
+        adjacency[cursors[indices[i]]++] = i / 3;
+    }
+
+    MeshletData data;
+    std::vector<bool> used(triangle_count, false);
+    std::vector<uint8_t> local_index(vertex_count, NOT_IN_MESHLET);
+    Meshlet meshlet{};
+    uint32_t next_seed = 0;
+
+    auto new_vertices = [&](const uint32_t triangle)
+    {
+        const uint32_t a = indices[triangle * 3];
+        const uint32_t b = indices[triangle * 3 + 1];
+        const uint32_t c = indices[triangle * 3 + 2];
+        return uint32_t(local_index[a] == NOT_IN_MESHLET)
+            + uint32_t((local_index[b] == NOT_IN_MESHLET) && (b != a))
+            + uint32_t((local_index[c] == NOT_IN_MESHLET) && (c != a) && (c != b));
+    };
+
+    auto finish = [&]()
+    {
+        ComputeBounds(positions, data, meshlet);
+        data.meshlets.push_back(meshlet);
+        for(uint32_t v = 0; v < meshlet.vertex_count; ++v)
+        {
+            local_index[data.vertices[meshlet.vertex_offset + v]] = NOT_IN_MESHLET;
+        }
+        meshlet = Meshlet{};
+        meshlet.vertex_offset = static_cast<uint32_t>(data.vertices.size());
+        meshlet.triangle_offset = static_cast<uint32_t>(data.triangles.size());
+    };
+
+    for(uint32_t remaining = triangle_count; remaining > 0;)
+    {
+        uint32_t best = UINT32_MAX;
+        uint32_t best_new = 4;
+        for(uint32_t v = 0; (v < meshlet.vertex_count) && (best_new > 0); ++v)
+        {
+            const uint32_t vertex = data.vertices[meshlet.vertex_offset + v];
+            for(uint32_t a = adjacency_offsets[vertex]; a < adjacency_offsets[vertex + 1]; ++a)
+            {
+                const uint32_t triangle = adjacency[a];
+                if(used[triangle])
+                {
+                    continue;
+                }
+                const uint32_t added = new_vertices(triangle);
+                if(added < best_new)
+                {
+                    best = triangle;
+                    best_new = added;
+                }
+            }
+        }
+
+        //nothing connected left, carry on with the next triangle in index order
+        if(best == UINT32_MAX)
+        {
+            while(used[next_seed])
+            {
+                ++next_seed;
+            }
+            best = next_seed;
+            best_new = new_vertices(best);
+        }
+
+        if((meshlet.vertex_count + best_new > MeshletData::MAX_VERTICES) || (meshlet.triangle_count == MeshletData::MAX_TRIANGLES))
+        {
+            finish();
+            continue;
+        }
+
+        uint32_t packed = 0;
+        for(uint32_t corner = 0; corner < 3; ++corner)
+        {
+            const uint32_t vertex = indices[best * 3 + corner];
+            if(local_index[vertex] == NOT_IN_MESHLET)
+            {
+                local_index[vertex] = static_cast<uint8_t>(meshlet.vertex_count++);
+                data.vertices.push_back(vertex);
+            }
+            packed |= uint32_t(local_index[vertex]) << (corner * 8);
+        }
+        data.triangles.push_back(packed);
+        ++meshlet.triangle_count;
+        used[best] = true;
+        --remaining;
+    }
+    if(meshlet.triangle_count > 0)
+    {
+        finish();
+    }
+
+    return data;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+//meshlets: a mesh split into small clusters of triangles that are culled one by one on the GPU
+//every meshlet references at most MAX_VERTICES of the mesh's vertices and holds at most
+//MAX_TRIANGLES triangles as 8 bit indices into that list, so a whole cluster's indices fit in
+//a few hundred bytes and its vertices in one 6 bit id
+//bounds are a sphere and a normal cone, the cone lets a cluster whose triangles all face away
+//from the camera be dropped without looking at a single one of them
+//building is meant for asset tools, meshes without prebuilt meshlets are split at load time
+
+struct Meshlet
+{
+    glm::vec4 sphere; //object space, w is the radius
+    glm::vec4 cone; //xyz axis, w sine of the cone's half angle, 1 if the triangles face every way
+    uint32_t vertex_offset; //into MeshletData::vertices
+    uint32_t triangle_offset; //into MeshletData::triangles
+    uint32_t vertex_count;
+    uint32_t triangle_count;
+};
+static_assert(sizeof(Meshlet) == 48, "Meshlet layout");
+
+struct MeshletData
+{
+    static constexpr uint32_t MAX_VERTICES = 64;
+    static constexpr uint32_t MAX_TRIANGLES = 124;
+
+    std::vector<Meshlet> meshlets{};
+    std::vector<uint32_t> vertices{}; //indices into the mesh's vertices
+    std::vector<uint32_t> triangles{}; //three 8 bit indices into the meshlet's vertices, the first in the lowest byte
+};
+
+//greedy: every meshlet grows by whichever triangle next to it adds the fewest new vertices
+MeshletData BuildMeshlets(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices);
@@ -0,0 +1,360 @@
+#include "stdafx.h"
+#include "PipelineManager.h"
+#include "VKUtils.h"
+
+#include <fstream>
+#include <iterator>
+
+void PipelineManager::Init(const vk::Device device, const std::string& cache_path, const uint32_t worker_count)
+{
+    Assert(device);
+    Assert(worker_count > 0);
+
+    m_device = device;
+    m_cache_path = cache_path;
+
+    //the driver checks the header and ignores data from another device or driver version
+    std::vector<char> cache_data;
+    std::ifstream file(m_cache_path, std::ios::binary);
+    if(file)
+    {
+        cache_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    const vk::PipelineCacheCreateInfo cache_info({}, cache_data.size(), cache_data.data());
+    m_cache = Get(m_device.createPipelineCache(cache_info));
+
+    m_stop = false;
+    for(uint32_t i = 0; i < worker_count; ++i)
+    {
+        m_workers.emplace_back(&PipelineManager::WorkerLoop, this);
+    }
+}
+
+void PipelineManager::Shutdown()
+{
+    if(!m_device)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_stop = true;
+        m_queue.clear();
+    }
+    m_queue_cv.notify_all();
+    for(auto& worker : m_workers)
+    {
+        worker.join();
+    }
+    m_workers.clear();
+
+    for(auto& entry : m_entries)
+    {
+        m_device.destroyPipeline(vk::Pipeline(entry.pipeline.load()));
+    }
+    m_entries.clear();
+    m_lookup.clear();
+    m_pending = 0;
+
+    for(auto& module : m_modules)
+    {
+        m_device.destroyShaderModule(module.second);
+    }
+    m_modules.clear();
+
+    const auto& cache_data = Get(m_device.getPipelineCacheData(m_cache));
+    std::ofstream file(m_cache_path, std::ios::binary | std::ios::trunc);
+    if(file)
+    {
+        file.write(reinterpret_cast<const char*>(cache_data.data()), cache_data.size());
+    }
+    m_device.destroyPipelineCache(m_cache);
+
+    m_device = vk::Device();
+}
+
+PipelineManager::Handle PipelineManager::Request(const GraphicsDesc& desc, const Handle fallback)
+{
+    bool added = false;
+    const Handle handle = FindOrAdd(desc, fallback, added);
+    if(added)
+    {
+        ++m_pending;
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            m_queue.push_back(handle);
+        }
+        m_queue_cv.notify_one();
+    }
+    return handle;
+}
+
+PipelineManager::Handle PipelineManager::RequestNow(const GraphicsDesc& desc)
+{
+    bool added = false;
+    const Handle handle = FindOrAdd(desc, INVALID_HANDLE, added);
+
+    Entry* entry = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_entries_mutex);
+        entry = &m_entries[handle];
+    }
+
+    if(!entry->claimed.exchange(true))
+    {
+        Compile(*entry);
+    }
+    else
+    {
+        //a worker got there first, it won't be long
+        while(!entry->pipeline.load())
+        {
+            std::this_thread::yield();
+        }
+    }
+    return handle;
+}
+
+vk::Pipeline PipelineManager::Get(const Handle handle) const
+{
+    std::lock_guard<std::mutex> lock(m_entries_mutex);
+    for(Handle current = handle; current != INVALID_HANDLE; current = m_entries[current].fallback)
+    {
+        const VkPipeline pipeline = m_entries[current].pipeline.load();
+        if(pipeline)
+        {
+            return vk::Pipeline(pipeline);
+        }
+    }
+    return vk::Pipeline();
+}
+
+bool PipelineManager::IsReady(const Handle handle) const
+{
+    std::lock_guard<std::mutex> lock(m_entries_mutex);
+    return m_entries[handle].pipeline.load() != VK_NULL_HANDLE;
+}
+
+size_t PipelineManager::DescHash::operator()(const GraphicsDesc& desc) const
+{
+    size_t seed = 0;
+    HashCombine(seed, desc.vertex_shader);
+    HashCombine(seed, desc.fragment_shader);
+    HashCombine(seed, desc.features);
+    for(const auto& binding : desc.vertex_bindings)
+    {
+        HashCombine(seed, binding.binding);
+        HashCombine(seed, binding.stride);
+        HashCombine(seed, binding.inputRate);
+    }
+    for(const auto& attribute : desc.vertex_attributes)
+    {
+        HashCombine(seed, attribute.location);
+        HashCombine(seed, attribute.binding);
+        HashCombine(seed, attribute.format);
+        HashCombine(seed, attribute.offset);
+    }
+    HashCombine(seed, desc.topology);
+    HashCombine(seed, static_cast<VkCullModeFlags>(desc.cull_mode));
+    HashCombine(seed, desc.front_face);
+    HashCombine(seed, desc.depth_test);
+    HashCombine(seed, desc.depth_write);
+    HashCombine(seed, desc.depth_compare);
+    HashCombine(seed, desc.blend);
+    HashCombine(seed, desc.color_attachments);
+    HashCombine(seed, desc.samples);
+    for(const auto state : desc.dynamic_states)
+    {
+        HashCombine(seed, state);
+    }
+    HashCombine(seed, static_cast<VkPipelineLayout>(desc.layout));
+    HashCombine(seed, static_cast<VkRenderPass>(desc.render_pass));
+    HashCombine(seed, desc.subpass);
+    return seed;
+}
+
+bool PipelineManager::DescEqual::operator()(const GraphicsDesc& a, const GraphicsDesc& b) const
+{
+    return
+        (a.vertex_shader == b.vertex_shader)
+        && (a.fragment_shader == b.fragment_shader)
+        && (a.features == b.features)
+        && (a.vertex_bindings == b.vertex_bindings)
+        && (a.vertex_attributes == b.vertex_attributes)
+        && (a.topology == b.topology)
+        && (a.cull_mode == b.cull_mode)
+        && (a.front_face == b.front_face)
+        && (a.depth_test == b.depth_test)
+        && (a.depth_write == b.depth_write)
+        && (a.depth_compare == b.depth_compare)
+        && (a.blend == b.blend)
+        && (a.color_attachments == b.color_attachments)
+        && (a.samples == b.samples)
+        && (a.dynamic_states == b.dynamic_states)
+        && (a.layout == b.layout)
+        && (a.render_pass == b.render_pass)
+        && (a.subpass == b.subpass);
+}
+
+PipelineManager::Handle PipelineManager::FindOrAdd(const GraphicsDesc& desc, const Handle fallback, bool& added)
+{
+    Assert(m_device);
+    Assert(desc.layout);
+    Assert(desc.render_pass);
+    Assert(!desc.vertex_shader.empty());
+
+    std::lock_guard<std::mutex> lock(m_entries_mutex);
+    Assert((fallback == INVALID_HANDLE) || (fallback < m_entries.size()));
+
+    const auto found = m_lookup.find(desc);
+    if(found != m_lookup.end())
+    {
+        added = false;
+        return found->second;
+    }
+
+    const Handle handle = static_cast<Handle>(m_entries.size());
+    m_entries.emplace_back();
+    m_entries.back().desc = desc;
+    m_entries.back().fallback = fallback;
+    m_lookup.emplace(desc, handle);
+    added = true;
+    return handle;
+}
+
+void PipelineManager::Compile(Entry& entry)
+{
+    const GraphicsDesc& desc = entry.desc;
+
+    //every feature is passed, constants a shader doesn't declare are ignored
+    std::array<VkBool32, SHADER_FEATURE_COUNT> feature_values;
+    std::array<vk::SpecializationMapEntry, SHADER_FEATURE_COUNT> feature_entries;
+    for(uint32_t i = 0; i < SHADER_FEATURE_COUNT; ++i)
+    {
+        feature_values[i] = (desc.features >> i) & 1;
+        feature_entries[i] = vk::SpecializationMapEntry(i, i * sizeof(VkBool32), sizeof(VkBool32));
+    }
+    const vk::SpecializationInfo specialization
+    (
+        static_cast<uint32_t>(feature_entries.size()),
+        feature_entries.data(),
+        sizeof(feature_values),
+        feature_values.data()
+    );
+
+    std::vector<vk::PipelineShaderStageCreateInfo> stages;
+    stages.emplace_back(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eVertex, GetShaderModule(desc.vertex_shader), "main", &specialization);
+    if(!desc.fragment_shader.empty())
+    {
+        stages.emplace_back(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eFragment, GetShaderModule(desc.fragment_shader), "main", &specialization);
+    }
+
+    const vk::PipelineVertexInputStateCreateInfo vertex_input
+    (
+        {},
+        static_cast<uint32_t>(desc.vertex_bindings.size()),
+        desc.vertex_bindings.data(),
+        static_cast<uint32_t>(desc.vertex_attributes.size()),
+        desc.vertex_attributes.data()
+    );
+    const vk::PipelineInputAssemblyStateCreateInfo input_assembly({}, desc.topology);
+    const vk::PipelineViewportStateCreateInfo viewport_state({}, 1, nullptr, 1, nullptr);
+    const vk::PipelineRasterizationStateCreateInfo rasterization
+    (
+        {},
+        VK_FALSE,
+        VK_FALSE,
+        vk::PolygonMode::eFill,
+        desc.cull_mode,
+        desc.front_face,
+        VK_FALSE,
+        0.0f,
+        0.0f,
+        0.0f,
+        1.0f
+    );
+    const vk::PipelineMultisampleStateCreateInfo multisample({}, desc.samples);
+    const vk::PipelineDepthStencilStateCreateInfo depth_stencil({}, desc.depth_test, desc.depth_write, desc.depth_compare);
+    const vk::PipelineColorBlendAttachmentState blend_attachment
+    (
+        desc.blend,
+        vk::BlendFactor::eOne,
+        desc.blend ? vk::BlendFactor::eOneMinusSrcAlpha : vk::BlendFactor::eZero,
+        vk::BlendOp::eAdd,
+        vk::BlendFactor::eOne,
+        desc.blend ? vk::BlendFactor::eOneMinusSrcAlpha : vk::BlendFactor::eZero,
+        vk::BlendOp::eAdd,
+        vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA
+    );
+    Assert(desc.color_attachments <= 1);
+    const vk::PipelineColorBlendStateCreateInfo color_blend({}, VK_FALSE, vk::LogicOp::eCopy, desc.color_attachments, &blend_attachment);
+    const vk::PipelineDynamicStateCreateInfo dynamic_state({}, static_cast<uint32_t>(desc.dynamic_states.size()), desc.dynamic_states.data());
+
+    const vk::GraphicsPipelineCreateInfo pipeline_info
+    (
+        {},
+        static_cast<uint32_t>(stages.size()),
+        stages.data(),
+        &vertex_input,
+        &input_assembly,
+        nullptr,
+        &viewport_state,
+        &rasterization,
+        &multisample,
+        &depth_stencil,
+        &color_blend,
+        &dynamic_state,
+        desc.layout,
+        desc.render_pass,
+        desc.subpass
+    );
+    //the cache is internally synchronized, workers share it
+    const vk::Pipeline pipeline = Get(m_device.createGraphicsPipeline(m_cache, pipeline_info));
+    entry.pipeline.store(static_cast<VkPipeline>(pipeline));
+}
+
+vk::ShaderModule PipelineManager::GetShaderModule(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(m_modules_mutex);
+
+    const auto found = m_modules.find(path);
+    if(found != m_modules.end())
+    {
+        return found->second;
+    }
+
+    const vk::ShaderModule module = LoadShaderModule(m_device, path);
+    m_modules.emplace(path, module);
+    return module;
+}
+
+void PipelineManager::WorkerLoop()
+{
+    for(;;)
+    {
+        Handle handle = INVALID_HANDLE;
+        {
+            std::unique_lock<std::mutex> lock(m_queue_mutex);
+            m_queue_cv.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+            if(m_stop)
+            {
+                return;
+            }
+            handle = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        Entry* entry = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_entries_mutex);
+            entry = &m_entries[handle];
+        }
+
+        if(!entry->claimed.exchange(true))
+        {
+            Compile(*entry);
+        }
+        --m_pending;
+    }
+}
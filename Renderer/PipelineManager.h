@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "ShaderFeatures.h"
+
+//graphics pipelines compiled off the render thread
+//a request is keyed by its whole description, asking twice for the same pipeline returns the same
+//handle, new ones are compiled by worker threads through one VkPipelineCache that is kept on disk
+//until a pipeline is ready Get() returns its fallback, or nothing if it has none, so callers
+//skip or substitute their draws instead of stalling the frame
+
+class PipelineManager
+{
+public:
+    using Handle = uint32_t;
+    static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+    //everything that ends up in the pipeline, render pass compatibility is by handle and subpass
+    struct GraphicsDesc
+    {
+        std::string vertex_shader{}; //SPIR-V paths, modules are loaded and kept by the manager
+        std::string fragment_shader{};
+        uint32_t features = 0; //ShaderFeature bits, specialization constants of both stages
+        std::vector<vk::VertexInputBindingDescription> vertex_bindings{};
+        std::vector<vk::VertexInputAttributeDescription> vertex_attributes{};
+        vk::PrimitiveTopology topology{vk::PrimitiveTopology::eTriangleList};
+        vk::CullModeFlags cull_mode{vk::CullModeFlagBits::eBack};
+        vk::FrontFace front_face{vk::FrontFace::eCounterClockwise};
+        bool depth_test = true;
+        bool depth_write = true;
+        vk::CompareOp depth_compare{vk::CompareOp::eLess};
+        bool blend = false; //premultiplied alpha
+        uint32_t color_attachments = 1; //0 for depth only subpasses
+        vk::SampleCountFlagBits samples{vk::SampleCountFlagBits::e1};
+        std::vector<vk::DynamicState> dynamic_states{vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+        vk::PipelineLayout layout{};
+        vk::RenderPass render_pass{};
+        uint32_t subpass = 0;
+    };
+
+    void Init(const vk::Device device, const std::string& cache_path, const uint32_t worker_count);
+    //waits for the workers, writes the cache back
+    void Shutdown();
+
+    //the fallback has to be compatible with the request: same layout, vertex input and render pass
+    Handle Request(const GraphicsDesc& desc, const Handle fallback = INVALID_HANDLE);
+    //compiles on the calling thread if it isn't ready yet, for pipelines that are needed before the first frame
+    Handle RequestNow(const GraphicsDesc& desc);
+
+    //the pipeline, else its fallback's, else nothing
+    vk::Pipeline Get(const Handle handle) const;
+    bool IsReady(const Handle handle) const;
+    size_t GetPendingCount() const { return m_pending; }
+
+private:
+    struct DescHash
+    {
+        size_t operator()(const GraphicsDesc& desc) const;
+    };
+
+    struct DescEqual
+    {
+        bool operator()(const GraphicsDesc& a, const GraphicsDesc& b) const;
+    };
+
+    struct Entry
+    {
+        GraphicsDesc desc{};
+        Handle fallback = INVALID_HANDLE;
+        std::atomic<VkPipeline> pipeline{VK_NULL_HANDLE};
+        std::atomic<bool> claimed{false}; //a thread started compiling it
+    };
+
+    Handle FindOrAdd(const GraphicsDesc& desc, const Handle fallback, bool& added);
+    void Compile(Entry& entry);
+    vk::ShaderModule GetShaderModule(const std::string& path);
+    void WorkerLoop();
+
+    vk::Device m_device{};
+    vk::PipelineCache m_cache{};
+    std::string m_cache_path{};
+
+    //entries never move, handles index them
+    mutable std::mutex m_entries_mutex{};
+    std::deque<Entry> m_entries{};
+    std::unordered_map<GraphicsDesc, Handle, DescHash, DescEqual> m_lookup{};
+
+    std::mutex m_modules_mutex{};
+    std::unordered_map<std::string, vk::ShaderModule> m_modules{};
+
+    std::mutex m_queue_mutex{};
+    std::condition_variable m_queue_cv{};
+    std::deque<Handle> m_queue{};
+    std::atomic<size_t> m_pending{0};
+    bool m_stop = false;
+    std::vector<std::thread> m_workers{};
+};
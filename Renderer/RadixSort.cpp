@@ -0,0 +1,142 @@
+#include "stdafx.h"
+#include "RadixSort.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static const size_t PARALLEL_SORT_MIN = 16384; //entries per sort thread, fewer cost more to start than they save
+static const uint32_t RADIX_BITS = 8;
+static const uint32_t RADIX_SIZE = 1 << RADIX_BITS;
+
+//reusable, every thread waits until all of them have arrived
+class SortBarrier
+{
+public:
+    explicit SortBarrier(const uint32_t count) : m_count(count) {}
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const uint64_t generation = m_generation;
+        if(++m_arrived == m_count)
+        {
+            m_arrived = 0;
+            ++m_generation;
+            m_condition.notify_all();
+            return;
+        }
+        m_condition.wait(lock, [this, generation]() { return m_generation != generation; });
+    }
+
+private:
+    std::mutex m_mutex{};
+    std::condition_variable m_condition{};
+    const uint32_t m_count;
+    uint32_t m_arrived = 0;
+    uint64_t m_generation = 0;
+};
+
+void RadixSort::Init(const uint32_t sort_threads)
+{
+    Assert(sort_threads > 0);
+
+    m_sort_threads = sort_threads;
+}
+
+void RadixSort::Sort(std::vector<Entry>& entries)
+{
+    if(entries.empty())
+    {
+        return;
+    }
+    m_entries = &entries;
+    m_scratch.resize(entries.size());
+
+    const uint32_t worker_count = static_cast<uint32_t>(std::min<size_t>(m_sort_threads, std::max<size_t>(entries.size() / PARALLEL_SORT_MIN, 1)));
+    m_histograms.resize(worker_count);
+    if(worker_count == 1)
+    {
+        SortWorker(0, 1, []() {});
+    }
+    else
+    {
+        //the calling thread is worker 0
+        SortBarrier barrier(worker_count);
+        const std::function<void()> sync = [&barrier]() { barrier.Wait(); };
+        std::vector<std::thread> workers;
+        for(uint32_t worker = 1; worker < worker_count; ++worker)
+        {
+            workers.emplace_back([this, worker, worker_count, &sync]() { SortWorker(worker, worker_count, sync); });
+        }
+        SortWorker(0, worker_count, sync);
+        for(auto& thread : workers)
+        {
+            thread.join();
+        }
+    }
+
+    if(m_sorted_in_scratch)
+    {
+        entries.swap(m_scratch);
+    }
+    m_entries = nullptr;
+}
+
+void RadixSort::SortWorker(const uint32_t worker, const uint32_t worker_count, const std::function<void()>& sync)
+{
+    //least significant digit first, stable, so every pass keeps the order of the ones before it
+    const size_t count = m_entries->size();
+    const size_t begin = count * worker / worker_count;
+    const size_t end = count * (worker + 1) / worker_count;
+    std::vector<Entry>* source = m_entries;
+    std::vector<Entry>* destination = &m_scratch;
+
+    for(uint32_t shift = 0; shift < 64; shift += RADIX_BITS)
+    {
+        auto& histogram = m_histograms[worker];
+        histogram.fill(0);
+        for(size_t i = begin; i < end; ++i)
+        {
+            ++histogram[((*source)[i].key >> shift) & (RADIX_SIZE - 1)];
+        }
+        sync();
+
+        //every worker comes to the same totals, and to where its share of each digit goes:
+        //after the smaller digits, and after the same digit from the workers before it
+        uint32_t offsets[RADIX_SIZE];
+        size_t digit_start = 0;
+        bool one_digit = false;
+        for(uint32_t digit = 0; digit < RADIX_SIZE; ++digit)
+        {
+            size_t digit_count = 0;
+            size_t before = 0;
+            for(uint32_t w = 0; w < worker_count; ++w)
+            {
+                before += (w < worker) ? m_histograms[w][digit] : 0;
+                digit_count += m_histograms[w][digit];
+            }
+            one_digit = one_digit || (digit_count == count);
+            offsets[digit] = static_cast<uint32_t>(digit_start + before);
+            digit_start += digit_count;
+        }
+
+        //every key has the same digit here, nothing would move, the top bits of sort keys mostly do
+        if(!one_digit)
+        {
+            for(size_t i = begin; i < end; ++i)
+            {
+                const Entry& entry = (*source)[i];
+                (*destination)[offsets[(entry.key >> shift) & (RADIX_SIZE - 1)]++] = entry;
+            }
+            std::swap(source, destination);
+        }
+        //histograms are only rewritten once everyone has read them and the scatter is complete
+        sync();
+    }
+
+    if(worker == 0)
+    {
+        m_sorted_in_scratch = (source == &m_scratch);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <functional>
+
+//stable least significant digit radix sort of 64 bit keys, 8 bits a pass, passes where every key
+//has the same digit are skipped
+//large inputs are split between threads: each one counts the digits of its share, they all come to
+//the same offsets, and each one scatters its own share, the only waiting is between those phases
+
+class RadixSort
+{
+public:
+    struct Entry
+    {
+        uint64_t key;
+        uint64_t value; //carried along, never compared
+    };
+
+    //sort_threads: at most this many sort large inputs, 1 always sorts on the calling thread
+    void Init(const uint32_t sort_threads);
+
+    //by key, entries with equal keys keep their order
+    void Sort(std::vector<Entry>& entries);
+
+private:
+    //every worker sorts its share of the entries, sync waits for all of them between phases
+    void SortWorker(const uint32_t worker, const uint32_t worker_count, const std::function<void()>& sync);
+
+    uint32_t m_sort_threads = 1;
+
+    std::vector<Entry>* m_entries = nullptr; //during Sort()
+    std::vector<Entry> m_scratch{};
+    std::vector<std::array<uint32_t, 256>> m_histograms{}; //per sort worker
+    bool m_sorted_in_scratch = false;
+};
@@ -0,0 +1,80 @@
+#include "stdafx.h"
+#include "RangeAllocator.h"
+
+void RangeAllocator::Init(const uint32_t capacity)
+{
+    m_capacity = capacity;
+    m_free_count = capacity;
+    m_free.clear();
+    if(capacity > 0)
+    {
+        m_free.push_back({0, capacity});
+    }
+}
+
+uint32_t RangeAllocator::Allocate(const uint32_t size)
+{
+    Assert(size > 0);
+
+    for(auto range = m_free.begin(); range != m_free.end(); ++range)
+    {
+        if(range->size < size)
+        {
+            continue;
+        }
+
+        const uint32_t offset = range->offset;
+        range->offset += size;
+        range->size -= size;
+        if(range->size == 0)
+        {
+            m_free.erase(range);
+        }
+        m_free_count -= size;
+        return offset;
+    }
+    return INVALID_OFFSET;
+}
+
+void RangeAllocator::Free(const uint32_t offset, const uint32_t size)
+{
+    Assert(size > 0);
+    Assert((offset < m_capacity) && (size <= m_capacity - offset));
+
+    auto next = std::lower_bound
+    (
+        m_free.begin(),
+        m_free.end(),
+        offset,
+        [](const Range& range, const uint32_t value) { return range.offset < value; }
+    );
+    Assert((next == m_free.end()) || (offset + size <= next->offset));
+    Assert((next == m_free.begin()) || (std::prev(next)->offset + std::prev(next)->size <= offset));
+    m_free_count += size;
+
+    const bool merge_previous = (next != m_free.begin()) && (std::prev(next)->offset + std::prev(next)->size == offset);
+    const bool merge_next = (next != m_free.end()) && (offset + size == next->offset);
+    if(merge_previous && merge_next)
+    {
+        std::prev(next)->size += size + next->size;
+        m_free.erase(next);
+    }
+    else if(merge_previous)
+    {
+        std::prev(next)->size += size;
+    }
+    else if(merge_next)
+    {
+        next->offset = offset;
+        next->size += size;
+    }
+    else
+    {
+        m_free.insert(next, {offset, size});
+    }
+}
+
+bool RangeAllocator::IsCompact() const
+{
+    return m_free.empty() || ((m_free.size() == 1) && (m_free[0].offset + m_free[0].size == m_capacity));
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+//first fit free list over a range of elements, for sub-allocating large buffers
+//free ranges are kept sorted by offset and merge with their neighbours when freed, so a hole
+//only lasts as long as something sits between it and the next one
+//it only hands out offsets, what lives at them and moving it around is up to the owner
+
+class RangeAllocator
+{
+public:
+    static constexpr uint32_t INVALID_OFFSET = UINT32_MAX;
+
+    void Init(const uint32_t capacity);
+
+    //INVALID_OFFSET when no free range is large enough, even if enough is free in total
+    uint32_t Allocate(const uint32_t size);
+    void Free(const uint32_t offset, const uint32_t size);
+
+    uint32_t GetCapacity() const { return m_capacity; }
+    uint32_t GetFreeCount() const { return m_free_count; }
+    //everything free is one range at the end, there are no holes to close
+    bool IsCompact() const;
+
+private:
+    struct Range
+    {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    uint32_t m_capacity = 0;
+    uint32_t m_free_count = 0;
+    std::vector<Range> m_free{}; //by offset, never touching
+};
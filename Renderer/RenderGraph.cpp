@@ -0,0 +1,1489 @@
+#include "stdafx.h"
+#include "RenderGraph.h"
+#include "GPUProfiler.h"
+#include "VKUtils.h"
+
+static const vk::AccessFlags WRITE_ACCESS =
+    vk::AccessFlagBits::eShaderWrite
+    | vk::AccessFlagBits::eColorAttachmentWrite
+    | vk::AccessFlagBits::eDepthStencilAttachmentWrite
+    | vk::AccessFlagBits::eTransferWrite
+    | vk::AccessFlagBits::eMemoryWrite;
+
+//what a compute only queue's barriers and semaphore waits may name
+static const vk::PipelineStageFlags COMPUTE_QUEUE_STAGES =
+    vk::PipelineStageFlagBits::eTopOfPipe
+    | vk::PipelineStageFlagBits::eDrawIndirect
+    | vk::PipelineStageFlagBits::eComputeShader
+    | vk::PipelineStageFlagBits::eTransfer
+    | vk::PipelineStageFlagBits::eHost
+    | vk::PipelineStageFlagBits::eBottomOfPipe
+    | vk::PipelineStageFlagBits::eAllCommands;
+
+static bool IsAttachment(const RenderGraph::Access access)
+{
+    switch(access)
+    {
+        case RenderGraph::Access::ColorAttachment:
+        case RenderGraph::Access::DepthAttachment:
+        case RenderGraph::Access::DepthRead:
+        case RenderGraph::Access::InputAttachment:
+        case RenderGraph::Access::Resolve:
+            return true;
+        default:
+            return false;
+    }
+}
+
+RenderGraph::Pass& RenderGraph::Pass::Read(const ResourceHandle resource, const Access access)
+{
+    Assert(resource < m_graph.m_resources.size());
+    Assert(!FindUse(resource));
+    Assert(m_type == PassType::Graphics || !IsAttachment(access));
+    m_uses.push_back({resource, access, false});
+    return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::Write(const ResourceHandle resource, const Access access)
+{
+    Assert(resource < m_graph.m_resources.size());
+    Assert(!FindUse(resource));
+    Assert(m_type == PassType::Graphics || !IsAttachment(access));
+    Assert
+    (
+        (access != Access::DepthRead)
+        && (access != Access::InputAttachment)
+        && (access != Access::Sampled)
+        && (access != Access::StorageRead)
+        && (access != Access::TransferSrc)
+        && (access != Access::IndirectRead)
+        && (access != Access::IndexRead)
+    );
+    m_uses.push_back({resource, access, true});
+    return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::Clear(const ResourceHandle resource, const vk::ClearValue& clear_value)
+{
+    m_clears.emplace_back(resource, clear_value);
+    return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::SetExecute(ExecuteFunc execute)
+{
+    m_execute = std::move(execute);
+    return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::SetSideEffects()
+{
+    m_side_effects = true;
+    return *this;
+}
+
+vk::RenderPass RenderGraph::Pass::GetRenderPass() const
+{
+    Assert(!m_culled && m_group < m_graph.m_groups.size());
+    return m_graph.m_groups[m_group].render_pass;
+}
+
+const RenderGraph::Pass::Use* RenderGraph::Pass::FindUse(const ResourceHandle resource) const
+{
+    for(const auto& use : m_uses)
+    {
+        if(use.resource == resource)
+        {
+            return &use;
+        }
+    }
+    return nullptr;
+}
+
+const vk::ClearValue* RenderGraph::Pass::FindClear(const ResourceHandle resource) const
+{
+    for(const auto& clear : m_clears)
+    {
+        if(clear.first == resource)
+        {
+            return &clear.second;
+        }
+    }
+    return nullptr;
+}
+
+bool RenderGraph::Pass::LoadsContents(const Use& use) const
+{
+    if(!use.write)
+    {
+        return false;
+    }
+    if(use.access == Access::StorageWrite)
+    {
+        return true;
+    }
+    return IsAttachment(use.access) && (use.access != Access::Resolve) && !FindClear(use.resource);
+}
+
+RenderGraph::ResourceHandle RenderGraph::ImportImage
+(
+    const std::string& name,
+    const ImageDesc& desc,
+    const std::vector<vk::Image>& images,
+    const std::vector<vk::ImageView>& image_views,
+    const vk::ImageLayout initial_layout,
+    const vk::ImageLayout final_layout,
+    const bool preserve_contents
+)
+{
+    Assert(!images.empty() && (images.size() == image_views.size()));
+
+    Resource resource{};
+    resource.name = name;
+    resource.desc = desc;
+    resource.imported = true;
+    resource.preserve_contents = preserve_contents;
+    resource.initial_layout = initial_layout;
+    resource.final_layout = final_layout;
+    resource.images = images;
+    resource.image_views = image_views;
+    m_resources.push_back(std::move(resource));
+    return static_cast<ResourceHandle>(m_resources.size() - 1);
+}
+
+RenderGraph::ResourceHandle RenderGraph::ImportBuffer(const std::string& name, const vk::Buffer buffer)
+{
+    Assert(buffer);
+
+    Resource resource{};
+    resource.name = name;
+    resource.imported = true;
+    resource.preserve_contents = true;
+    resource.buffer = buffer;
+    m_resources.push_back(std::move(resource));
+    return static_cast<ResourceHandle>(m_resources.size() - 1);
+}
+
+RenderGraph::ResourceHandle RenderGraph::CreateImage(const std::string& name, const ImageDesc& desc)
+{
+    Resource resource{};
+    resource.name = name;
+    resource.desc = desc;
+    m_resources.push_back(std::move(resource));
+    return static_cast<ResourceHandle>(m_resources.size() - 1);
+}
+
+RenderGraph::Pass& RenderGraph::AddPass(const std::string& name, const PassType type)
+{
+    m_passes.push_back(std::unique_ptr<Pass>(new Pass(*this, name, type)));
+    return *m_passes.back();
+}
+
+void RenderGraph::SetOutput(const ResourceHandle resource)
+{
+    Assert(resource < m_resources.size());
+    m_resources[resource].output = true;
+}
+
+void RenderGraph::Compile
+(
+    const vk::PhysicalDevice physical_device,
+    const vk::Device device,
+    const QueueSetup& graphics,
+    const QueueSetup& async_compute,
+    const uint32_t frames_in_flight
+)
+{
+    Assert(physical_device);
+    Assert(device);
+    Assert(graphics.queue);
+    Assert(frames_in_flight > 0);
+    Assert(!m_device); //compile once
+
+    m_device = device;
+    m_async_compute = async_compute.queue && (async_compute.family != graphics.family);
+    m_queues = {graphics.queue, m_async_compute ? async_compute.queue : vk::Queue()};
+    m_queue_families = {graphics.family, m_async_compute ? async_compute.family : graphics.family};
+
+    CullPasses();
+    BuildGroups();
+    AllocateTransients(physical_device);
+    BuildBarriersAndRenderPasses();
+    BuildCommands(frames_in_flight);
+}
+
+uint64_t RenderGraph::Submit(const FrameSubmit& submit)
+{
+    Assert(m_device);
+    Assert(submit.frame_index < m_frame_commands.size());
+
+    FrameCommands& commands = m_frame_commands[submit.frame_index];
+    for(const auto& pool : commands.pools)
+    {
+        if(pool)
+        {
+            Assert(m_device.resetCommandPool(pool, {}) == vk::Result::eSuccess);
+        }
+    }
+
+    //the frame's first async work must not overwrite what the previous frame's graphics work still reads
+    const uint64_t previous_frame_value = m_timeline_values[GRAPHICS_QUEUE];
+    bool first_graphics = true;
+    bool first_compute = true;
+
+    for(uint32_t b = 0; b < m_batches.size(); ++b)
+    {
+        const Batch& batch = m_batches[b];
+        const bool last = (b + 1) == m_batches.size();
+        const vk::CommandBuffer command_buffer = commands.command_buffers[b];
+
+        std::vector<vk::Semaphore> wait_semaphores;
+        std::vector<uint64_t> wait_values;
+        std::vector<vk::PipelineStageFlags> wait_stages;
+        const auto add_wait = [&](const vk::Semaphore semaphore, const uint64_t value, const vk::PipelineStageFlags stages)
+        {
+            wait_semaphores.push_back(semaphore);
+            wait_values.push_back(value);
+            wait_stages.push_back(stages);
+        };
+
+        const vk::CommandBufferBeginInfo begin_info(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+        Assert(command_buffer.begin(begin_info) == vk::Result::eSuccess);
+
+        if((batch.queue == GRAPHICS_QUEUE) && first_graphics)
+        {
+            first_graphics = false;
+            if(submit.prologue)
+            {
+                submit.prologue(command_buffer);
+            }
+            for(const auto& wait : submit.waits)
+            {
+                add_wait(wait.semaphore, wait.value, wait.stages);
+            }
+        }
+        if((batch.queue == ASYNC_COMPUTE_QUEUE) && first_compute)
+        {
+            first_compute = false;
+            add_wait(m_timelines[GRAPHICS_QUEUE], previous_frame_value, vk::PipelineStageFlagBits::eAllCommands);
+        }
+        if(batch.wait_batch != NO_BATCH)
+        {
+            add_wait(m_timelines[m_batches[batch.wait_batch].queue], m_batch_values[batch.wait_batch], batch.wait_stages);
+        }
+
+        for(const uint32_t group_index : batch.groups)
+        {
+            RecordGroup(command_buffer, m_groups[group_index], submit.image_index);
+        }
+        if(last)
+        {
+            RecordBarriers(command_buffer, m_final_barriers, submit.image_index);
+        }
+        Assert(command_buffer.end() == vk::Result::eSuccess);
+
+        m_batch_values[b] = ++m_timeline_values[batch.queue];
+        std::vector<vk::Semaphore> signal_semaphores = {m_timelines[batch.queue]};
+        std::vector<uint64_t> signal_values = {m_batch_values[b]};
+        if(last && submit.signal)
+        {
+            signal_semaphores.push_back(submit.signal);
+            signal_values.push_back(0); //binary semaphores ignore their value
+        }
+
+        const vk::TimelineSemaphoreSubmitInfo timeline_info
+        (
+            static_cast<uint32_t>(wait_values.size()),
+            wait_values.data(),
+            static_cast<uint32_t>(signal_values.size()),
+            signal_values.data()
+        );
+        vk::SubmitInfo submit_info
+        (
+            static_cast<uint32_t>(wait_semaphores.size()),
+            wait_semaphores.data(),
+            wait_stages.data(),
+            1,
+            &command_buffer,
+            static_cast<uint32_t>(signal_semaphores.size()),
+            signal_semaphores.data()
+        );
+        submit_info.pNext = &timeline_info;
+        Assert(m_queues[batch.queue].submit(1, &submit_info, vk::Fence()) == vk::Result::eSuccess);
+    }
+
+    //see BuildBarriersAndRenderPasses(), the last batch is always on the graphics queue
+    return m_timeline_values[GRAPHICS_QUEUE];
+}
+
+void RenderGraph::Wait(const uint64_t value) const
+{
+    Assert(m_device);
+
+    const vk::SemaphoreWaitInfo wait_info({}, 1, &m_timelines[GRAPHICS_QUEUE], &value);
+    Assert(m_device.waitSemaphores(wait_info, UINT64_MAX) == vk::Result::eSuccess);
+}
+
+void RenderGraph::RecordGroup(const vk::CommandBuffer command_buffer, const Group& group, const uint32_t image_index) const
+{
+    RecordBarriers(command_buffer, group.barriers, image_index);
+
+    const uint32_t queue_family = m_queue_families[group.queue];
+
+    if(group.render_pass)
+    {
+        //subpasses overlap on the GPU, the render pass is timed as a whole
+        const uint32_t scope = m_profiler ? m_profiler->BeginScope(command_buffer, queue_family, group.name) : GPUProfiler::NO_SCOPE;
+
+        const vk::RenderPassBeginInfo begin_info
+        (
+            group.render_pass,
+            group.framebuffers.size() == 1 ? group.framebuffers[0] : group.framebuffers[image_index],
+            vk::Rect2D({0, 0}, group.extent),
+            static_cast<uint32_t>(group.clear_values.size()),
+            group.clear_values.data()
+        );
+        command_buffer.beginRenderPass(begin_info, vk::SubpassContents::eInline);
+
+        for(size_t i = 0; i < group.passes.size(); ++i)
+        {
+            if(i > 0)
+            {
+                command_buffer.nextSubpass(vk::SubpassContents::eInline);
+            }
+
+            const Pass& pass = *m_passes[group.passes[i]];
+            if(pass.m_execute)
+            {
+                pass.m_execute(command_buffer);
+            }
+        }
+
+        command_buffer.endRenderPass();
+        if(m_profiler)
+        {
+            m_profiler->EndScope(command_buffer, scope);
+        }
+    }
+    else
+    {
+        for(const uint32_t pass_index : group.passes)
+        {
+            const Pass& pass = *m_passes[pass_index];
+            if(pass.m_execute)
+            {
+                const uint32_t scope = m_profiler ? m_profiler->BeginScope(command_buffer, queue_family, pass.m_name) : GPUProfiler::NO_SCOPE;
+                pass.m_execute(command_buffer);
+                if(m_profiler)
+                {
+                    m_profiler->EndScope(command_buffer, scope);
+                }
+            }
+        }
+    }
+}
+
+void RenderGraph::Shutdown()
+{
+    if(m_device)
+    {
+        for(auto& group : m_groups)
+        {
+            for(auto& framebuffer : group.framebuffers)
+            {
+                m_device.destroyFramebuffer(framebuffer);
+            }
+            if(group.render_pass)
+            {
+                m_device.destroyRenderPass(group.render_pass);
+            }
+        }
+
+        for(auto& resource : m_resources)
+        {
+            if(resource.imported)
+            {
+                continue;
+            }
+            for(auto& image_view : resource.image_views)
+            {
+                m_device.destroyImageView(image_view);
+            }
+            for(auto& image : resource.images)
+            {
+                m_device.destroyImage(image);
+            }
+        }
+
+        for(auto& memory : m_transient_memory)
+        {
+            m_device.freeMemory(memory);
+        }
+
+        for(auto& commands : m_frame_commands)
+        {
+            for(auto& pool : commands.pools)
+            {
+                if(pool)
+                {
+                    m_device.destroyCommandPool(pool);
+                }
+            }
+        }
+        for(auto& timeline : m_timelines)
+        {
+            m_device.destroySemaphore(timeline);
+        }
+    }
+
+    m_device = vk::Device();
+    m_resources.clear();
+    m_passes.clear();
+    m_groups.clear();
+    m_final_barriers.clear();
+    m_transient_memory.clear();
+    m_transient_memory_size = 0;
+
+    m_async_compute = false;
+    m_queues = {};
+    m_queue_families = {};
+    m_timelines = {};
+    m_timeline_values = {};
+    m_batches.clear();
+    m_batch_values.clear();
+    m_frame_commands.clear();
+}
+
+RenderGraph::AccessInfo RenderGraph::GetAccessInfo(const Access access, const PassType type) const
+{
+    const vk::PipelineStageFlags shader_stages = (type != PassType::Graphics)
+        ? vk::PipelineStageFlags(vk::PipelineStageFlagBits::eComputeShader)
+        : (vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader);
+    const vk::PipelineStageFlags depth_stages = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+
+    switch(access)
+    {
+        case Access::ColorAttachment:
+            return
+            {
+                vk::ImageLayout::eColorAttachmentOptimal,
+                vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+                vk::ImageUsageFlagBits::eColorAttachment,
+                true
+            };
+        case Access::DepthAttachment:
+            return
+            {
+                vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                depth_stages,
+                vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                vk::ImageUsageFlagBits::eDepthStencilAttachment,
+                true
+            };
+        case Access::DepthRead:
+            return
+            {
+                vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+                depth_stages,
+                vk::AccessFlagBits::eDepthStencilAttachmentRead,
+                vk::ImageUsageFlagBits::eDepthStencilAttachment,
+                true
+            };
+        case Access::InputAttachment:
+            return
+            {
+                vk::ImageLayout::eShaderReadOnlyOptimal,
+                vk::PipelineStageFlagBits::eFragmentShader,
+                vk::AccessFlagBits::eInputAttachmentRead,
+                vk::ImageUsageFlagBits::eInputAttachment,
+                true
+            };
+        case Access::Resolve:
+            return
+            {
+                vk::ImageLayout::eColorAttachmentOptimal,
+                vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                vk::AccessFlagBits::eColorAttachmentWrite,
+                vk::ImageUsageFlagBits::eColorAttachment,
+                true
+            };
+        case Access::Sampled:
+            return {vk::ImageLayout::eShaderReadOnlyOptimal, shader_stages, vk::AccessFlagBits::eShaderRead, vk::ImageUsageFlagBits::eSampled, false};
+        case Access::StorageRead:
+            return {vk::ImageLayout::eGeneral, shader_stages, vk::AccessFlagBits::eShaderRead, vk::ImageUsageFlagBits::eStorage, false};
+        case Access::StorageWrite:
+            return {vk::ImageLayout::eGeneral, shader_stages, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::ImageUsageFlagBits::eStorage, false};
+        case Access::TransferSrc:
+            return {vk::ImageLayout::eTransferSrcOptimal, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead, vk::ImageUsageFlagBits::eTransferSrc, false};
+        case Access::TransferDst:
+            return {vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::ImageUsageFlagBits::eTransferDst, false};
+        case Access::IndirectRead:
+            return {vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eDrawIndirect, vk::AccessFlagBits::eIndirectCommandRead, {}, false};
+        case Access::IndexRead:
+            return {vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eIndexRead, {}, false};
+    }
+
+    Assert(false);
+    return {};
+}
+
+vk::Image RenderGraph::GetImage(const ResourceHandle resource, const uint32_t image_index) const
+{
+    const auto& images = m_resources[resource].images;
+    return images.size() == 1 ? images[0] : images[image_index];
+}
+
+vk::ImageView RenderGraph::GetImageView(const ResourceHandle resource, const uint32_t image_index) const
+{
+    const auto& image_views = m_resources[resource].image_views;
+    return image_views.size() == 1 ? image_views[0] : image_views[image_index];
+}
+
+void RenderGraph::CullPasses()
+{
+    for(auto& resource : m_resources)
+    {
+        resource.writers.clear();
+        resource.ref_count = resource.output ? 1 : 0;
+    }
+
+    for(uint32_t i = 0; i < m_passes.size(); ++i)
+    {
+        Pass& pass = *m_passes[i];
+        pass.m_culled = false;
+        pass.m_group = UINT32_MAX;
+        pass.m_ref_count = pass.m_side_effects ? 1 : 0;
+
+        for(const auto& use : pass.m_uses)
+        {
+            if(use.write)
+            {
+                ++pass.m_ref_count;
+                m_resources[use.resource].writers.push_back(i);
+            }
+            if(!use.write || pass.LoadsContents(use))
+            {
+                ++m_resources[use.resource].ref_count;
+            }
+        }
+    }
+
+    //walk back from every resource nobody reads, a pass goes once none of its writes are read
+    std::vector<ResourceHandle> unreferenced;
+    for(ResourceHandle r = 0; r < m_resources.size(); ++r)
+    {
+        if(m_resources[r].ref_count == 0)
+        {
+            unreferenced.push_back(r);
+        }
+    }
+
+    while(!unreferenced.empty())
+    {
+        const ResourceHandle r = unreferenced.back();
+        unreferenced.pop_back();
+
+        for(const uint32_t writer : m_resources[r].writers)
+        {
+            Pass& pass = *m_passes[writer];
+            if(pass.m_ref_count == 0 || --pass.m_ref_count > 0)
+            {
+                continue;
+            }
+
+            pass.m_culled = true;
+            for(const auto& use : pass.m_uses)
+            {
+                if((!use.write || pass.LoadsContents(use)) && (--m_resources[use.resource].ref_count == 0))
+                {
+                    unreferenced.push_back(use.resource);
+                }
+            }
+        }
+    }
+}
+
+void RenderGraph::BuildGroups()
+{
+    m_groups.clear();
+    for(auto& resource : m_resources)
+    {
+        resource.first_group = UINT32_MAX;
+        resource.last_group = 0;
+    }
+
+    for(uint32_t i = 0; i < m_passes.size(); ++i)
+    {
+        Pass& pass = *m_passes[i];
+        if(pass.m_culled)
+        {
+            continue;
+        }
+
+        bool has_attachments = false;
+        vk::Extent2D extent{};
+        for(const auto& use : pass.m_uses)
+        {
+            if(IsAttachment(use.access))
+            {
+                Assert(!has_attachments || (extent == m_resources[use.resource].desc.extent));
+                has_attachments = true;
+                extent = m_resources[use.resource].desc.extent;
+            }
+        }
+
+        //subpasses share one framebuffer, anything that is not an attachment access
+        //to an image the render pass touches needs a real barrier and breaks the merge
+        bool merge = !m_groups.empty() && has_attachments && m_groups.back().has_attachments && (m_groups.back().extent == extent);
+        if(merge)
+        {
+            for(const auto& use : pass.m_uses)
+            {
+                for(const uint32_t other_index : m_groups.back().passes)
+                {
+                    const Pass::Use* other = m_passes[other_index]->FindUse(use.resource);
+                    if
+                    (
+                        other
+                        && (!IsAttachment(use.access) || !IsAttachment(other->access))
+                        && !((use.access == other->access) && !use.write && !other->write)
+                    )
+                    {
+                        merge = false;
+                    }
+                }
+            }
+        }
+
+        if(!merge)
+        {
+            Group group{};
+            group.has_attachments = has_attachments;
+            group.extent = extent;
+            group.queue = (m_async_compute && (pass.m_type == PassType::AsyncCompute)) ? ASYNC_COMPUTE_QUEUE : GRAPHICS_QUEUE;
+            m_groups.push_back(std::move(group));
+        }
+
+        const uint32_t group_index = static_cast<uint32_t>(m_groups.size() - 1);
+        Group& group = m_groups[group_index];
+        group.passes.push_back(i);
+        group.name += (group.name.empty() ? "" : "+") + pass.m_name;
+        pass.m_group = group_index;
+        pass.m_subpass = static_cast<uint32_t>(group.passes.size() - 1);
+
+        for(const auto& use : pass.m_uses)
+        {
+            Resource& resource = m_resources[use.resource];
+            resource.first_group = std::min(resource.first_group, group_index);
+            resource.last_group = std::max(resource.last_group, group_index);
+        }
+    }
+}
+
+void RenderGraph::AllocateTransients(const vk::PhysicalDevice physical_device)
+{
+    for(const auto& pass : m_passes)
+    {
+        if(pass->m_culled)
+        {
+            continue;
+        }
+        for(const auto& use : pass->m_uses)
+        {
+            m_resources[use.resource].usage |= GetAccessInfo(use.access, pass->m_type).usage;
+            m_resources[use.resource].queues |= 1u << m_groups[pass->m_group].queue;
+        }
+    }
+
+    const auto& mem_properties = physical_device.getMemoryProperties();
+    const vk::ImageUsageFlags attachment_usage =
+        vk::ImageUsageFlagBits::eColorAttachment
+        | vk::ImageUsageFlagBits::eDepthStencilAttachment
+        | vk::ImageUsageFlagBits::eInputAttachment;
+
+    std::vector<ResourceHandle> transients;
+    for(ResourceHandle r = 0; r < m_resources.size(); ++r)
+    {
+        Resource& resource = m_resources[r];
+        if(resource.imported || (resource.first_group == UINT32_MAX))
+        {
+            continue;
+        }
+        Assert(!resource.buffer);
+
+        //contents never leave the render pass, tilers can keep them on chip without ever backing them
+        const bool lazy =
+            (resource.first_group == resource.last_group)
+            && m_groups[resource.first_group].has_attachments
+            && !((resource.usage | resource.desc.usage) & ~attachment_usage);
+        if(lazy)
+        {
+            resource.usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+        }
+
+        //images both queues touch skip ownership transfers, the semaphores between batches order them
+        const bool shared = resource.queues == ((1u << GRAPHICS_QUEUE) | (1u << ASYNC_COMPUTE_QUEUE));
+        const vk::ImageCreateInfo image_info
+        (
+            {},
+            vk::ImageType::e2D,
+            resource.desc.format,
+            {resource.desc.extent.width, resource.desc.extent.height, 1},
+            1,
+            1,
+            resource.desc.samples,
+            vk::ImageTiling::eOptimal,
+            resource.usage | resource.desc.usage,
+            shared ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+            shared ? QUEUE_COUNT : 0,
+            shared ? m_queue_families.data() : nullptr,
+            vk::ImageLayout::eUndefined
+        );
+        resource.images = {Get(m_device.createImage(image_info))};
+        resource.mem_reqs = m_device.getImageMemoryRequirements(resource.images[0]);
+        resource.memory_type_index = UINT32_MAX;
+        if(lazy)
+        {
+            resource.memory_type_index = FindMemoryTypeIndex(mem_properties, resource.mem_reqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eLazilyAllocated);
+        }
+        if(resource.memory_type_index == UINT32_MAX)
+        {
+            resource.memory_type_index = FindMemoryTypeIndex(mem_properties, resource.mem_reqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        }
+        Assert(resource.memory_type_index != UINT32_MAX);
+
+        transients.push_back(r);
+    }
+
+    //largest first, each image goes to the lowest offset not used by an image alive at the same time
+    std::sort(transients.begin(), transients.end(), [this](const ResourceHandle a, const ResourceHandle b)
+    {
+        return m_resources[a].mem_reqs.size > m_resources[b].mem_reqs.size;
+    });
+
+    std::vector<vk::DeviceSize> heap_sizes(mem_properties.memoryTypeCount, 0);
+    for(size_t i = 0; i < transients.size(); ++i)
+    {
+        Resource& resource = m_resources[transients[i]];
+
+        std::vector<std::pair<vk::DeviceSize, vk::DeviceSize>> taken;
+        for(size_t j = 0; j < i; ++j)
+        {
+            const Resource& other = m_resources[transients[j]];
+            if
+            (
+                (other.memory_type_index == resource.memory_type_index)
+                && (other.first_group <= resource.last_group)
+                && (resource.first_group <= other.last_group)
+            )
+            {
+                taken.emplace_back(other.memory_offset, other.memory_offset + other.mem_reqs.size);
+            }
+        }
+        std::sort(taken.begin(), taken.end());
+
+        vk::DeviceSize offset = 0;
+        for(const auto& range : taken)
+        {
+            offset = AlignUp(offset, resource.mem_reqs.alignment);
+            if(offset + resource.mem_reqs.size <= range.first)
+            {
+                break;
+            }
+            offset = std::max(offset, range.second);
+        }
+        resource.memory_offset = AlignUp(offset, resource.mem_reqs.alignment);
+
+        vk::DeviceSize& heap_size = heap_sizes[resource.memory_type_index];
+        heap_size = std::max(heap_size, resource.memory_offset + resource.mem_reqs.size);
+    }
+
+    //images sharing memory with an earlier one have to wait for it to be done
+    for(const ResourceHandle r : transients)
+    {
+        Resource& resource = m_resources[r];
+        for(const ResourceHandle other_handle : transients)
+        {
+            const Resource& other = m_resources[other_handle];
+            if
+            (
+                (other.memory_type_index == resource.memory_type_index)
+                && (other.last_group < resource.first_group)
+                && (other.memory_offset < resource.memory_offset + resource.mem_reqs.size)
+                && (resource.memory_offset < other.memory_offset + other.mem_reqs.size)
+            )
+            {
+                resource.alias_predecessors.push_back(other_handle);
+            }
+        }
+    }
+
+    std::vector<vk::DeviceMemory> heaps(mem_properties.memoryTypeCount);
+    for(uint32_t memory_type_index = 0; memory_type_index < mem_properties.memoryTypeCount; ++memory_type_index)
+    {
+        if(heap_sizes[memory_type_index] == 0)
+        {
+            continue;
+        }
+
+        const vk::MemoryAllocateInfo alloc_info(heap_sizes[memory_type_index], memory_type_index);
+        heaps[memory_type_index] = Get(m_device.allocateMemory(alloc_info));
+        m_transient_memory.push_back(heaps[memory_type_index]);
+        m_transient_memory_size += heap_sizes[memory_type_index];
+    }
+
+    for(const ResourceHandle r : transients)
+    {
+        Resource& resource = m_resources[r];
+        Assert(m_device.bindImageMemory(resource.images[0], heaps[resource.memory_type_index], resource.memory_offset) == vk::Result::eSuccess);
+
+        const vk::ImageViewCreateInfo image_view_info
+        (
+            {},
+            resource.images[0],
+            vk::ImageViewType::e2D,
+            resource.desc.format,
+            vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eA),
+            vk::ImageSubresourceRange(GetImageAspect(resource.desc.format), 0, 1, 0, 1)
+        );
+        resource.image_views = {Get(m_device.createImageView(image_view_info))};
+    }
+}
+
+void RenderGraph::Transition(Group& group, State& state, const ResourceHandle resource, const AccessInfo& info, const bool write, const bool discard) const
+{
+    const bool is_buffer = !!m_resources[resource].buffer;
+    const bool layout_change = !is_buffer && (state.layout != info.layout);
+    const bool hazard = write
+        ? !!(state.write_stages | state.read_stages)
+        : (state.write_stages && (info.stages & ~state.read_stages));
+
+    //the other queue's part is covered by the batch's semaphore wait, see AssignBatch()
+    const uint32_t other_queue = QUEUE_COUNT - 1 - group.queue;
+    const bool cross_queue = (state.batches[other_queue] != NO_BATCH) && (write || layout_change || (state.write_queue == other_queue));
+
+    if(layout_change || (hazard && !(cross_queue && !write)))
+    {
+        vk::PipelineStageFlags src_stages = state.write_stages | state.read_stages;
+        vk::AccessFlags src_access = state.write_access;
+        if(cross_queue)
+        {
+            //chains onto the semaphore wait, which already made the other queue's writes visible
+            src_stages = vk::PipelineStageFlagBits::eAllCommands;
+            if(state.write_queue != group.queue)
+            {
+                src_access = {};
+            }
+        }
+        else if(group.queue == ASYNC_COMPUTE_QUEUE)
+        {
+            src_stages &= COMPUTE_QUEUE_STAGES;
+        }
+
+        group.barriers.push_back
+        ({
+            resource,
+            discard ? vk::ImageLayout::eUndefined : state.layout,
+            info.layout,
+            src_stages,
+            info.stages,
+            src_access,
+            info.access
+        });
+    }
+
+    if(write || layout_change)
+    {
+        state.batches.fill(NO_BATCH);
+        state.write_queue = group.queue;
+    }
+    state.batches[group.queue] = group.batch;
+
+    if(write)
+    {
+        state.write_stages = info.stages;
+        state.write_access = info.access & WRITE_ACCESS;
+        state.read_stages = {};
+        state.has_contents = true;
+    }
+    else if(layout_change)
+    {
+        //later readers in other stages chain through the transition
+        state.write_stages |= info.stages;
+        state.read_stages = info.stages;
+    }
+    else
+    {
+        state.read_stages |= info.stages;
+    }
+    if(!is_buffer)
+    {
+        state.layout = info.layout;
+    }
+}
+
+void RenderGraph::AssignBatch(Group& group, const std::vector<State>& states)
+{
+    const uint32_t other_queue = QUEUE_COUNT - 1 - group.queue;
+
+    //latest batch on the other queue this group depends on
+    uint32_t wait_batch = NO_BATCH;
+    vk::PipelineStageFlags wait_stages{};
+    for(const uint32_t pass_index : group.passes)
+    {
+        const Pass& pass = *m_passes[pass_index];
+        for(const auto& use : pass.m_uses)
+        {
+            const State& state = states[use.resource];
+            const AccessInfo info = GetAccessInfo(use.access, pass.m_type);
+            const bool layout_change = !m_resources[use.resource].buffer && (state.layout != info.layout);
+            if((state.batches[other_queue] != NO_BATCH) && (use.write || layout_change || (state.write_queue == other_queue)))
+            {
+                wait_batch = (wait_batch == NO_BATCH) ? state.batches[other_queue] : std::max(wait_batch, state.batches[other_queue]);
+                wait_stages |= info.stages;
+            }
+        }
+    }
+
+    //a new submission whenever the queue changes or this group has to wait on more than the current one does
+    const bool new_batch =
+        m_batches.empty()
+        || (m_batches.back().queue != group.queue)
+        || ((wait_batch != NO_BATCH) && ((m_batches.back().wait_batch == NO_BATCH) || (m_batches.back().wait_batch < wait_batch)));
+    if(new_batch)
+    {
+        Batch batch{};
+        batch.queue = group.queue;
+        m_batches.push_back(std::move(batch));
+    }
+
+    Batch& batch = m_batches.back();
+    if(wait_batch != NO_BATCH)
+    {
+        batch.wait_batch = (batch.wait_batch == NO_BATCH) ? wait_batch : std::max(batch.wait_batch, wait_batch);
+        batch.wait_stages |= (group.queue == ASYNC_COMPUTE_QUEUE) ? (wait_stages & COMPUTE_QUEUE_STAGES) : wait_stages;
+    }
+    batch.groups.push_back(static_cast<uint32_t>(&group - m_groups.data()));
+    group.batch = static_cast<uint32_t>(m_batches.size() - 1);
+}
+
+void RenderGraph::BuildCommands(const uint32_t frames_in_flight)
+{
+    const vk::SemaphoreTypeCreateInfo semaphore_type_info(vk::SemaphoreType::eTimeline, 0);
+    vk::SemaphoreCreateInfo semaphore_info;
+    semaphore_info.pNext = &semaphore_type_info;
+    for(uint32_t q = 0; q < QUEUE_COUNT; ++q)
+    {
+        if(m_queues[q])
+        {
+            m_timelines[q] = Get(m_device.createSemaphore(semaphore_info));
+        }
+    }
+
+    m_batch_values.resize(m_batches.size(), 0);
+    m_frame_commands.resize(frames_in_flight);
+    for(auto& commands : m_frame_commands)
+    {
+        for(uint32_t q = 0; q < QUEUE_COUNT; ++q)
+        {
+            if(m_queues[q])
+            {
+                const vk::CommandPoolCreateInfo pool_info(vk::CommandPoolCreateFlagBits::eTransient, m_queue_families[q]);
+                commands.pools[q] = Get(m_device.createCommandPool(pool_info));
+            }
+        }
+
+        for(const auto& batch : m_batches)
+        {
+            const vk::CommandBufferAllocateInfo allocate_info(commands.pools[batch.queue], vk::CommandBufferLevel::ePrimary, 1);
+            commands.command_buffers.push_back(Get(m_device.allocateCommandBuffers(allocate_info))[0]);
+        }
+    }
+}
+
+void RenderGraph::BuildBarriersAndRenderPasses()
+{
+    std::vector<State> states(m_resources.size());
+    for(ResourceHandle r = 0; r < m_resources.size(); ++r)
+    {
+        const Resource& resource = m_resources[r];
+        if(resource.imported && (resource.buffer || (resource.initial_layout != vk::ImageLayout::eUndefined)))
+        {
+            //we don't know what touched it last frame
+            states[r].layout = resource.initial_layout;
+            states[r].write_stages = vk::PipelineStageFlagBits::eAllCommands;
+            states[r].write_access = vk::AccessFlagBits::eMemoryWrite;
+            states[r].has_contents = resource.preserve_contents;
+        }
+    }
+
+    for(uint32_t g = 0; g < m_groups.size(); ++g)
+    {
+        Group& group = m_groups[g];
+
+        for(ResourceHandle r = 0; r < m_resources.size(); ++r)
+        {
+            if(m_resources[r].first_group != g)
+            {
+                continue;
+            }
+            for(const ResourceHandle predecessor : m_resources[r].alias_predecessors)
+            {
+                states[r].read_stages |= states[predecessor].write_stages | states[predecessor].read_stages;
+                for(uint32_t q = 0; q < QUEUE_COUNT; ++q)
+                {
+                    const uint32_t batch = states[predecessor].batches[q];
+                    if((batch != NO_BATCH) && ((states[r].batches[q] == NO_BATCH) || (states[r].batches[q] < batch)))
+                    {
+                        states[r].batches[q] = batch;
+                    }
+                }
+            }
+        }
+
+        AssignBatch(group, states);
+
+        for(const uint32_t pass_index : group.passes)
+        {
+            const Pass& pass = *m_passes[pass_index];
+            for(const auto& use : pass.m_uses)
+            {
+                if(!IsAttachment(use.access))
+                {
+                    State& state = states[use.resource];
+                    Transition(group, state, use.resource, GetAccessInfo(use.access, pass.m_type), use.write, !state.has_contents);
+                }
+            }
+        }
+
+        if(group.has_attachments)
+        {
+            BuildRenderPass(group, g, states);
+        }
+    }
+
+    //the last submission is on the graphics queue and waits for all async work, so its timeline value covers everything
+    uint32_t last_compute_batch = NO_BATCH;
+    for(uint32_t b = 0; b < m_batches.size(); ++b)
+    {
+        if(m_batches[b].queue == ASYNC_COMPUTE_QUEUE)
+        {
+            last_compute_batch = b;
+        }
+    }
+    const bool needs_final_batch =
+        m_batches.empty()
+        || (m_batches.back().queue != GRAPHICS_QUEUE)
+        || ((last_compute_batch != NO_BATCH) && ((m_batches.back().wait_batch == NO_BATCH) || (m_batches.back().wait_batch < last_compute_batch)));
+    if(needs_final_batch)
+    {
+        Batch batch{};
+        batch.queue = GRAPHICS_QUEUE;
+        if(last_compute_batch != NO_BATCH)
+        {
+            batch.wait_batch = last_compute_batch;
+            batch.wait_stages = vk::PipelineStageFlagBits::eAllCommands;
+        }
+        m_batches.push_back(std::move(batch));
+    }
+
+    for(ResourceHandle r = 0; r < m_resources.size(); ++r)
+    {
+        const Resource& resource = m_resources[r];
+        const State& state = states[r];
+        if
+        (
+            resource.imported
+            && (resource.first_group != UINT32_MAX)
+            && (resource.final_layout != vk::ImageLayout::eUndefined)
+            && (state.layout != resource.final_layout)
+        )
+        {
+            m_final_barriers.push_back
+            ({
+                r,
+                state.layout,
+                resource.final_layout,
+                state.write_stages | state.read_stages,
+                vk::PipelineStageFlagBits::eBottomOfPipe,
+                state.write_access,
+                {}
+            });
+        }
+    }
+}
+
+void RenderGraph::BuildRenderPass(Group& group, const uint32_t group_index, std::vector<State>& states)
+{
+    std::vector<ResourceHandle> attachments;
+    for(const uint32_t pass_index : group.passes)
+    {
+        for(const auto& use : m_passes[pass_index]->m_uses)
+        {
+            if(IsAttachment(use.access) && (std::find(attachments.begin(), attachments.end(), use.resource) == attachments.end()))
+            {
+                attachments.push_back(use.resource);
+            }
+        }
+    }
+
+    std::vector<vk::AttachmentDescription> descriptions;
+    group.clear_values.resize(attachments.size());
+
+    for(uint32_t a = 0; a < attachments.size(); ++a)
+    {
+        const ResourceHandle r = attachments[a];
+        const Resource& resource = m_resources[r];
+        State& state = states[r];
+
+        const Pass* first_pass = nullptr;
+        const Pass::Use* first_use = nullptr;
+        const Pass* last_pass = nullptr;
+        const Pass::Use* last_use = nullptr;
+        bool written = false;
+        vk::PipelineStageFlags write_stages{};
+        vk::AccessFlags write_access{};
+        vk::PipelineStageFlags read_stages{};
+        for(const uint32_t pass_index : group.passes)
+        {
+            const Pass& pass = *m_passes[pass_index];
+            const Pass::Use* use = pass.FindUse(r);
+            if(!use)
+            {
+                continue;
+            }
+            if(!first_use)
+            {
+                first_pass = &pass;
+                first_use = use;
+            }
+            last_pass = &pass;
+            last_use = use;
+
+            const AccessInfo info = GetAccessInfo(use->access, pass.m_type);
+            if(use->write)
+            {
+                written = true;
+                write_stages |= info.stages;
+                write_access |= info.access & WRITE_ACCESS;
+            }
+            else
+            {
+                read_stages |= info.stages;
+            }
+        }
+
+        const vk::ClearValue* clear_value = first_pass->FindClear(r);
+        const bool needs_contents = !first_use->write || first_pass->LoadsContents(*first_use);
+
+        vk::AttachmentLoadOp load_op = vk::AttachmentLoadOp::eDontCare;
+        if(clear_value)
+        {
+            load_op = vk::AttachmentLoadOp::eClear;
+            group.clear_values[a] = *clear_value;
+        }
+        else if(needs_contents && state.has_contents)
+        {
+            load_op = vk::AttachmentLoadOp::eLoad;
+        }
+
+        //anything that touched the image earlier in the frame gets a barrier into the first subpass layout,
+        //otherwise the render pass transitions it from undefined
+        vk::ImageLayout initial_layout = vk::ImageLayout::eUndefined;
+        if(state.write_stages || state.read_stages)
+        {
+            Transition(group, state, r, GetAccessInfo(first_use->access, first_pass->m_type), first_use->write, load_op != vk::AttachmentLoadOp::eLoad);
+            initial_layout = state.layout;
+        }
+
+        const bool used_later = resource.last_group > group_index;
+        const bool store = used_later || (resource.imported && resource.preserve_contents);
+
+        vk::ImageLayout final_layout = GetAccessInfo(last_use->access, last_pass->m_type).layout;
+        if(!used_later && resource.imported && (resource.final_layout != vk::ImageLayout::eUndefined))
+        {
+            final_layout = resource.final_layout;
+        }
+
+        const bool has_stencil = !!(GetImageAspect(resource.desc.format) & vk::ImageAspectFlagBits::eStencil);
+        const vk::AttachmentStoreOp store_op = store ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+        descriptions.emplace_back
+        (
+            vk::AttachmentDescriptionFlags(),
+            resource.desc.format,
+            resource.desc.samples,
+            load_op,
+            store_op,
+            has_stencil ? load_op : vk::AttachmentLoadOp::eDontCare,
+            has_stencil ? store_op : vk::AttachmentStoreOp::eDontCare,
+            initial_layout,
+            final_layout
+        );
+
+        if(written)
+        {
+            state.write_stages = write_stages;
+            state.write_access = write_access;
+            state.read_stages = {};
+            state.batches.fill(NO_BATCH);
+            state.write_queue = group.queue;
+        }
+        else
+        {
+            state.read_stages |= read_stages;
+        }
+        state.batches[group.queue] = group.batch;
+        state.has_contents = store && (written || state.has_contents);
+        state.layout = final_layout;
+    }
+
+    const size_t num_subpasses = group.passes.size();
+    std::vector<std::vector<vk::AttachmentReference>> color_refs(num_subpasses);
+    std::vector<std::vector<vk::AttachmentReference>> resolve_refs(num_subpasses);
+    std::vector<std::vector<vk::AttachmentReference>> input_refs(num_subpasses);
+    std::vector<std::vector<uint32_t>> preserve_refs(num_subpasses);
+    std::vector<vk::AttachmentReference> depth_refs(num_subpasses, vk::AttachmentReference(VK_ATTACHMENT_UNUSED, vk::ImageLayout::eUndefined));
+    std::vector<vk::SubpassDescription> subpasses(num_subpasses);
+    std::vector<vk::SubpassDependency> dependencies;
+
+    const vk::PipelineStageFlags attachment_stages =
+        vk::PipelineStageFlagBits::eColorAttachmentOutput
+        | vk::PipelineStageFlagBits::eEarlyFragmentTests
+        | vk::PipelineStageFlagBits::eLateFragmentTests;
+
+    //the previous frame's passes outside the render pass can still be using its attachments, e.g.
+    //the depth pyramid's compute reading depth, the first layout transitions and clears wait for them
+    vk::PipelineStageFlags external_stages = attachment_stages;
+    for(uint32_t pass_index = 0; pass_index < m_passes.size(); ++pass_index)
+    {
+        if(std::find(group.passes.begin(), group.passes.end(), pass_index) != group.passes.end())
+        {
+            continue;
+        }
+        for(const auto& use : m_passes[pass_index]->m_uses)
+        {
+            if(std::find(attachments.begin(), attachments.end(), use.resource) != attachments.end())
+            {
+                external_stages |= GetAccessInfo(use.access, m_passes[pass_index]->m_type).stages;
+            }
+        }
+    }
+
+    for(uint32_t s = 0; s < num_subpasses; ++s)
+    {
+        const Pass& pass = *m_passes[group.passes[s]];
+        for(const auto& use : pass.m_uses)
+        {
+            if(!IsAttachment(use.access))
+            {
+                continue;
+            }
+
+            const uint32_t index = static_cast<uint32_t>(std::find(attachments.begin(), attachments.end(), use.resource) - attachments.begin());
+            const vk::ImageLayout layout = GetAccessInfo(use.access, pass.m_type).layout;
+            switch(use.access)
+            {
+                case Access::ColorAttachment:
+                    color_refs[s].emplace_back(index, layout);
+                    break;
+                case Access::DepthAttachment:
+                case Access::DepthRead:
+                    depth_refs[s] = vk::AttachmentReference(index, layout);
+                    break;
+                case Access::InputAttachment:
+                    input_refs[s].emplace_back(index, layout);
+                    break;
+                case Access::Resolve:
+                    resolve_refs[s].emplace_back(index, layout);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        Assert(resolve_refs[s].size() <= color_refs[s].size());
+        if(!resolve_refs[s].empty())
+        {
+            resolve_refs[s].resize(color_refs[s].size(), vk::AttachmentReference(VK_ATTACHMENT_UNUSED, vk::ImageLayout::eUndefined));
+        }
+
+        //attachments produced before and consumed after this subpass have to survive it
+        for(uint32_t a = 0; a < attachments.size(); ++a)
+        {
+            if(pass.FindUse(attachments[a]))
+            {
+                continue;
+            }
+
+            bool used_before = false;
+            bool used_after = false;
+            for(uint32_t other = 0; other < num_subpasses; ++other)
+            {
+                if(m_passes[group.passes[other]]->FindUse(attachments[a]))
+                {
+                    (other < s ? used_before : used_after) = true;
+                }
+            }
+            if(used_before && used_after)
+            {
+                preserve_refs[s].push_back(a);
+            }
+        }
+
+        subpasses[s] = vk::SubpassDescription
+        (
+            {},
+            vk::PipelineBindPoint::eGraphics,
+            static_cast<uint32_t>(input_refs[s].size()),
+            input_refs[s].data(),
+            static_cast<uint32_t>(color_refs[s].size()),
+            color_refs[s].data(),
+            resolve_refs[s].empty() ? nullptr : resolve_refs[s].data(),
+            (depth_refs[s].attachment != VK_ATTACHMENT_UNUSED) ? &depth_refs[s] : nullptr,
+            static_cast<uint32_t>(preserve_refs[s].size()),
+            preserve_refs[s].data()
+        );
+
+        //orders the initial layout transitions and clears after previous frames' work on the attachments,
+        //reads only need the execution dependency
+        dependencies.emplace_back
+        (
+            VK_SUBPASS_EXTERNAL,
+            s,
+            external_stages,
+            attachment_stages,
+            vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+            vk::AccessFlagBits::eColorAttachmentRead
+            | vk::AccessFlagBits::eColorAttachmentWrite
+            | vk::AccessFlagBits::eDepthStencilAttachmentRead
+            | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+            vk::DependencyFlags()
+        );
+
+        for(uint32_t earlier = 0; earlier < s; ++earlier)
+        {
+            const Pass& earlier_pass = *m_passes[group.passes[earlier]];
+
+            vk::PipelineStageFlags src_stages{};
+            vk::PipelineStageFlags dst_stages{};
+            vk::AccessFlags src_access{};
+            vk::AccessFlags dst_access{};
+            for(const auto& use : pass.m_uses)
+            {
+                const Pass::Use* earlier_use = earlier_pass.FindUse(use.resource);
+                if(!earlier_use || !(earlier_use->write || use.write))
+                {
+                    continue;
+                }
+
+                const AccessInfo src_info = GetAccessInfo(earlier_use->access, earlier_pass.m_type);
+                const AccessInfo dst_info = GetAccessInfo(use.access, pass.m_type);
+                src_stages |= src_info.stages;
+                dst_stages |= dst_info.stages;
+                src_access |= src_info.access & WRITE_ACCESS;
+                dst_access |= dst_info.access;
+            }
+
+            if(src_stages)
+            {
+                dependencies.emplace_back(earlier, s, src_stages, dst_stages, src_access, dst_access, vk::DependencyFlagBits::eByRegion);
+            }
+        }
+    }
+
+    const vk::RenderPassCreateInfo render_pass_create_info
+    (
+        {},
+        static_cast<uint32_t>(descriptions.size()),
+        descriptions.data(),
+        static_cast<uint32_t>(subpasses.size()),
+        subpasses.data(),
+        static_cast<uint32_t>(dependencies.size()),
+        dependencies.data()
+    );
+    group.render_pass = Get(m_device.createRenderPass(render_pass_create_info));
+
+    size_t num_framebuffers = 1;
+    for(const ResourceHandle r : attachments)
+    {
+        num_framebuffers = std::max(num_framebuffers, m_resources[r].image_views.size());
+    }
+
+    for(uint32_t f = 0; f < num_framebuffers; ++f)
+    {
+        std::vector<vk::ImageView> views;
+        for(const ResourceHandle r : attachments)
+        {
+            views.push_back(GetImageView(r, f));
+        }
+
+        const vk::FramebufferCreateInfo framebuffer_info
+        (
+            {},
+            group.render_pass,
+            static_cast<uint32_t>(views.size()),
+            views.data(),
+            group.extent.width,
+            group.extent.height,
+            1
+        );
+        group.framebuffers.push_back(Get(m_device.createFramebuffer(framebuffer_info)));
+    }
+}
+
+void RenderGraph::RecordBarriers(const vk::CommandBuffer command_buffer, const std::vector<Barrier>& barriers, const uint32_t image_index) const
+{
+    if(barriers.empty())
+    {
+        return;
+    }
+
+    vk::PipelineStageFlags src_stages{};
+    vk::PipelineStageFlags dst_stages{};
+    std::vector<vk::ImageMemoryBarrier> image_barriers;
+    std::vector<vk::BufferMemoryBarrier> buffer_barriers;
+    for(const auto& barrier : barriers)
+    {
+        src_stages |= barrier.src_stages;
+        dst_stages |= barrier.dst_stages;
+
+        const vk::Buffer buffer = m_resources[barrier.resource].buffer;
+        if(buffer)
+        {
+            buffer_barriers.emplace_back
+            (
+                barrier.src_access,
+                barrier.dst_access,
+                VK_QUEUE_FAMILY_IGNORED,
+                VK_QUEUE_FAMILY_IGNORED,
+                buffer,
+                0,
+                VK_WHOLE_SIZE
+            );
+            continue;
+        }
+
+        image_barriers.emplace_back
+        (
+            barrier.src_access,
+            barrier.dst_access,
+            barrier.old_layout,
+            barrier.new_layout,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            GetImage(barrier.resource, image_index),
+            //imported images can carry a mip chain, layouts are tracked for the whole image
+            vk::ImageSubresourceRange(GetImageAspect(m_resources[barrier.resource].desc.format), 0, VK_REMAINING_MIP_LEVELS, 0, 1)
+        );
+    }
+
+    command_buffer.pipelineBarrier
+    (
+        src_stages ? src_stages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe),
+        dst_stages,
+        {},
+        nullptr,
+        buffer_barriers,
+        image_barriers
+    );
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+//frame graph: passes declare which images and buffers they read and write, Compile() then
+//- culls passes whose results are never consumed
+//- merges consecutive compatible graphics passes into subpasses of one render pass
+//- aliases transient images with disjoint lifetimes onto shared memory
+//- precomputes every layout transition and barrier
+//- runs async compute passes on the compute queue, splitting the frame into submissions with
+//  timeline semaphore waits wherever work crosses queues
+//passes run in declaration order, Submit() records and submits the whole frame and returns the
+//graphics timeline value that marks it as done, Wait() on it before reusing the frame's resources
+//with a profiler set every render pass and every compute pass is timed
+
+class GPUProfiler;
+
+class RenderGraph
+{
+public:
+    using ResourceHandle = uint32_t;
+    static constexpr ResourceHandle INVALID_RESOURCE = UINT32_MAX;
+
+    enum class PassType
+    {
+        Graphics,
+        Compute,
+        AsyncCompute //compute queue if there is one, images and buffers it shares with graphics need concurrent sharing
+    };
+
+    enum class Access
+    {
+        ColorAttachment,
+        DepthAttachment,
+        DepthRead,
+        InputAttachment,
+        Resolve, //the n-th resolve of a pass resolves its n-th color attachment
+        Sampled,
+        StorageRead,
+        StorageWrite, //may read what was there before
+        TransferSrc,
+        TransferDst,
+        IndirectRead, //buffers only
+        IndexRead //buffers only
+    };
+
+    struct ImageDesc
+    {
+        vk::Format format{};
+        vk::Extent2D extent{};
+        vk::SampleCountFlagBits samples{vk::SampleCountFlagBits::e1};
+        vk::ImageUsageFlags usage{}; //on top of what the accesses imply
+    };
+
+    using ExecuteFunc = std::function<void(vk::CommandBuffer)>;
+
+    struct QueueSetup
+    {
+        vk::Queue queue{};
+        uint32_t family = UINT32_MAX;
+    };
+
+    struct SemaphoreWait
+    {
+        vk::Semaphore semaphore{};
+        uint64_t value = 0; //ignored for binary semaphores
+        vk::PipelineStageFlags stages{};
+    };
+
+    struct FrameSubmit
+    {
+        uint32_t frame_index = 0; //its previous submission must have completed
+        uint32_t image_index = 0;
+        std::vector<SemaphoreWait> waits{}; //before the first graphics submission
+        ExecuteFunc prologue{}; //recorded first on the graphics queue
+        vk::Semaphore signal{}; //binary, for presenting, signalled once the whole frame is done
+    };
+
+    class Pass
+    {
+    public:
+        //attachment writes without Clear() load the previous contents
+        Pass& Read(const ResourceHandle resource, const Access access);
+        Pass& Write(const ResourceHandle resource, const Access access);
+        Pass& Clear(const ResourceHandle resource, const vk::ClearValue& clear_value);
+        Pass& SetExecute(ExecuteFunc execute);
+        Pass& SetSideEffects(); //never culled
+
+        //valid after Compile()
+        vk::RenderPass GetRenderPass() const;
+        uint32_t GetSubpass() const { return m_subpass; }
+        bool IsCulled() const { return m_culled; }
+
+    private:
+        friend class RenderGraph;
+
+        struct Use
+        {
+            ResourceHandle resource;
+            Access access;
+            bool write;
+        };
+
+        Pass(RenderGraph& graph, const std::string& name, const PassType type) : m_graph(graph), m_name(name), m_type(type) {}
+
+        const Use* FindUse(const ResourceHandle resource) const;
+        const vk::ClearValue* FindClear(const ResourceHandle resource) const;
+        //storage writes and attachment writes that keep what was there before, resolves overwrite everything
+        bool LoadsContents(const Use& use) const;
+
+        RenderGraph& m_graph;
+        std::string m_name;
+        PassType m_type;
+        std::vector<Use> m_uses{};
+        std::vector<std::pair<ResourceHandle, vk::ClearValue>> m_clears{};
+        ExecuteFunc m_execute{};
+        bool m_side_effects = false;
+
+        uint32_t m_ref_count = 0;
+        bool m_culled = false;
+        uint32_t m_group = UINT32_MAX;
+        uint32_t m_subpass = 0;
+    };
+
+    RenderGraph() = default;
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    //images owned outside the graph, one image per swapchain image or a single one
+    //preserve_contents: initial contents are loaded and the result is stored, otherwise both are discarded
+    ResourceHandle ImportImage
+    (
+        const std::string& name,
+        const ImageDesc& desc,
+        const std::vector<vk::Image>& images,
+        const std::vector<vk::ImageView>& image_views,
+        const vk::ImageLayout initial_layout,
+        const vk::ImageLayout final_layout,
+        const bool preserve_contents
+    );
+    //buffers owned outside the graph, their contents always carry over
+    ResourceHandle ImportBuffer(const std::string& name, const vk::Buffer buffer);
+    //transient images, created and aliased by Compile()
+    //the ones only ever used as attachments within one render pass get lazily allocated memory where available
+    ResourceHandle CreateImage(const std::string& name, const ImageDesc& desc);
+    Pass& AddPass(const std::string& name, const PassType type);
+    //keeps the producers of resource alive
+    void SetOutput(const ResourceHandle resource);
+
+    //without an async compute queue AsyncCompute passes run as Compute passes on the graphics queue
+    void Compile
+    (
+        const vk::PhysicalDevice physical_device,
+        const vk::Device device,
+        const QueueSetup& graphics,
+        const QueueSetup& async_compute,
+        const uint32_t frames_in_flight
+    );
+    //returns the graphics timeline value that marks the whole frame as done
+    uint64_t Submit(const FrameSubmit& submit);
+    //blocks until the graphics timeline has reached value, 0 returns at once
+    void Wait(const uint64_t value) const;
+    //nullptr stops profiling
+    void SetProfiler(GPUProfiler* profiler) { m_profiler = profiler; }
+    //destroys the compiled objects and all declarations
+    void Shutdown();
+
+    vk::DeviceSize GetTransientMemorySize() const { return m_transient_memory_size; }
+    size_t GetSubmissionCount() const { return m_batches.size(); }
+    //valid after Compile(), for binding images to descriptors, transient images have a single view
+    vk::ImageView GetImageView(const ResourceHandle resource, const uint32_t image_index) const;
+
+private:
+    static constexpr uint32_t GRAPHICS_QUEUE = 0;
+    static constexpr uint32_t ASYNC_COMPUTE_QUEUE = 1;
+    static constexpr uint32_t QUEUE_COUNT = 2;
+    static constexpr uint32_t NO_BATCH = UINT32_MAX;
+
+    struct AccessInfo
+    {
+        vk::ImageLayout layout;
+        vk::PipelineStageFlags stages;
+        vk::AccessFlags access;
+        vk::ImageUsageFlags usage;
+        bool attachment;
+    };
+
+    //tracked per resource while walking the groups in order
+    struct State
+    {
+        vk::ImageLayout layout{vk::ImageLayout::eUndefined};
+        vk::PipelineStageFlags write_stages{}; //last write
+        vk::AccessFlags write_access{};
+        vk::PipelineStageFlags read_stages{}; //reads since the last write that already see it
+        bool has_contents = false;
+        //latest batch per queue that touched it since and including the last write
+        std::array<uint32_t, QUEUE_COUNT> batches{{NO_BATCH, NO_BATCH}};
+        uint32_t write_queue = GRAPHICS_QUEUE;
+    };
+
+    struct Resource
+    {
+        std::string name;
+        ImageDesc desc;
+        bool imported = false;
+        bool preserve_contents = false;
+        bool output = false;
+        vk::ImageLayout initial_layout{vk::ImageLayout::eUndefined};
+        vk::ImageLayout final_layout{vk::ImageLayout::eUndefined};
+        std::vector<vk::Image> images{};
+        std::vector<vk::ImageView> image_views{};
+        vk::Buffer buffer{};
+
+        std::vector<uint32_t> writers{};
+        uint32_t ref_count = 0;
+        uint32_t first_group = UINT32_MAX;
+        uint32_t last_group = 0;
+        vk::ImageUsageFlags usage{};
+        uint32_t queues = 0; //bit per queue that uses it
+        vk::MemoryRequirements mem_reqs{};
+        uint32_t memory_type_index = UINT32_MAX;
+        vk::DeviceSize memory_offset = 0;
+        std::vector<ResourceHandle> alias_predecessors{};
+    };
+
+    struct Barrier
+    {
+        ResourceHandle resource;
+        vk::ImageLayout old_layout;
+        vk::ImageLayout new_layout;
+        vk::PipelineStageFlags src_stages;
+        vk::PipelineStageFlags dst_stages;
+        vk::AccessFlags src_access;
+        vk::AccessFlags dst_access;
+    };
+
+    struct Group
+    {
+        std::vector<uint32_t> passes{};
+        std::string name{}; //its passes joined by '+'
+        std::vector<Barrier> barriers{};
+        vk::RenderPass render_pass{};
+        std::vector<vk::Framebuffer> framebuffers{}; //indexed by image index if an attachment is per swapchain image
+        bool has_attachments = false;
+        vk::Extent2D extent{};
+        std::vector<vk::ClearValue> clear_values{};
+        uint32_t queue = GRAPHICS_QUEUE;
+        uint32_t batch = NO_BATCH;
+    };
+
+    //consecutive groups on one queue, submitted together
+    struct Batch
+    {
+        uint32_t queue = GRAPHICS_QUEUE;
+        std::vector<uint32_t> groups{};
+        uint32_t wait_batch = NO_BATCH; //on the other queue
+        vk::PipelineStageFlags wait_stages{};
+    };
+
+    struct FrameCommands
+    {
+        std::array<vk::CommandPool, QUEUE_COUNT> pools{};
+        std::vector<vk::CommandBuffer> command_buffers{}; //one per batch
+    };
+
+    AccessInfo GetAccessInfo(const Access access, const PassType type) const;
+    vk::Image GetImage(const ResourceHandle resource, const uint32_t image_index) const;
+
+    void CullPasses();
+    void BuildGroups();
+    void AllocateTransients(const vk::PhysicalDevice physical_device);
+    void BuildBarriersAndRenderPasses();
+    void BuildRenderPass(Group& group, const uint32_t group_index, std::vector<State>& states);
+    void AssignBatch(Group& group, const std::vector<State>& states);
+    void BuildCommands(const uint32_t frames_in_flight);
+    void Transition(Group& group, State& state, const ResourceHandle resource, const AccessInfo& info, const bool write, const bool discard) const;
+    void RecordGroup(const vk::CommandBuffer command_buffer, const Group& group, const uint32_t image_index) const;
+    void RecordBarriers(const vk::CommandBuffer command_buffer, const std::vector<Barrier>& barriers, const uint32_t image_index) const;
+
+    vk::Device m_device{};
+    GPUProfiler* m_profiler = nullptr;
+    std::vector<Resource> m_resources{};
+    std::vector<std::unique_ptr<Pass>> m_passes{};
+    std::vector<Group> m_groups{};
+    std::vector<Barrier> m_final_barriers{};
+
+    bool m_async_compute = false;
+    std::array<vk::Queue, QUEUE_COUNT> m_queues{};
+    std::array<uint32_t, QUEUE_COUNT> m_queue_families{};
+    std::array<vk::Semaphore, QUEUE_COUNT> m_timelines{};
+    std::array<uint64_t, QUEUE_COUNT> m_timeline_values{};
+    std::vector<Batch> m_batches{};
+    std::vector<uint64_t> m_batch_values{}; //signalled by each batch in the current frame
+    std::vector<FrameCommands> m_frame_commands{};
+    std::vector<vk::DeviceMemory> m_transient_memory{};
+    vk::DeviceSize m_transient_memory_size = 0;
+};
@@ -1,190 +1,372 @@
 #include "stdafx.h"
 #include "RendererFramework.h"
-
-#include <WindowFramework/WindowFramework.h>
-#include <WindowFramework/Window.h>
-
-#include <limits>
-#include <fstream>
+#include "BindlessHeap.h"
+#include "ClusteredLighting.h"
+#include "DepthPyramid.h"
+#include "DescriptorAllocator.h"
+#include "DynamicResolution.h"
+#include "DeviceSelection.h"
+#include "DrawConstants.h"
+#include "GPUProfiler.h"
+#include "GPUScene.h"
+#include "PipelineManager.h"
+#include "RenderGraph.h"
+#include "ShadowAtlas.h"
+#include "TextureStreamer.h"
+#include "UploadQueue.h"
+#include "VKUtils.h"
+
+#include <Base/Profiler.h>
+#ifdef _WIN32
+#  include <WindowFramework/WindowFramework.h>
+#  include <WindowFramework/Window.h>
+#endif
+
+#include <glm/glm/gtc/matrix_transform.hpp>
 
 class RendererFrameworkImpl : public RendererFramework
 {
 public:
-    RendererFrameworkImpl(WindowFramework& window_framework) : m_window_framework(window_framework) {}
+    RendererFrameworkImpl(WindowFramework* window_framework, const StartupConf& conf) : m_window_framework(window_framework), m_conf(conf) {}
     virtual void Init() override;
     virtual void Shutdown() override;
     virtual void StartUpdate(const double delta) override {}
-    virtual void FinishUpdate() override {}
-    virtual bool ShouldExit() override { return !m_window; }
+    virtual void FinishUpdate() override;
+    virtual bool ShouldExit() override;
+
+    virtual const Readback& GetReadback() const override { return m_readback; }
+    virtual double GetGPUFrameTime() const override { return m_caps.timestamps ? m_gpu_profiler.GetFrameTime() : 0.0; }
 
 private:
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+    static constexpr uint32_t MAX_TEXTURES = 1 << 12;
+    static constexpr vk::DeviceSize DEFRAGMENT_BYTES_PER_FRAME = 1 << 20; //of scene geometry copies
+
     void OnMainWindowClose();
 
     void SetupVKInstance();
     void SetupVKPhysicalDevice();
+    void SetupVKSampleCount();
+    void SetupVKQueueFamilies();
     void SetupVKDevice();
-    void SetupVKCommandPool();
-    void SetupVKCommandQueue();
+    void SetupVKSync();
+    void SetupDescriptorAllocator();
     void SetupVKSurface();
     void SetupVKSwapchain();
+    void SetupOffscreenTargets();
     void SetupVKImageViews();
     void SetupVKDepthBuffer();
-    void SetupVKUniformBuffer();
-    void SetupVKDescriptors();
-    void SetupVKPipeline();
-    void SetupVKDescriptorPool();
-    void SetupDescriptorSets();
-    void SetupRenderPass();
-    void SetupShaders();
-
-    WindowFramework& m_window_framework;
-
+    void SetupClusteredLighting();
+    void SetupDrawConstants();
+    void SetupUploadQueue();
+    void SetupBindlessHeap();
+    void SetupGPUScene();
+    void SetupDepthPyramid();
+    void SetupShadowAtlas();
+    void SetupTextureStreamer();
+    void SetupGPUProfiler();
+    void SetupPipelineManager();
+    void SetupDynamicResolution();
+    void SetupRenderGraph();
+    void SetupBenchmarkScene();
+
+    void DrawFrame();
+    void RecordReadback(const vk::CommandBuffer command_buffer) const;
+    void CollectReadback(const uint32_t frame_index);
+
+    WindowFramework* m_window_framework = nullptr; //not needed when headless
+    const StartupConf m_conf;
+
+#ifdef _WIN32
     std::unique_ptr<Window> m_window{};
+#endif
 
+    vk::DynamicLoader m_vk_loader{}; //keeps the Vulkan library loaded
     vk::Instance m_vk_instance{};
     vk::PhysicalDevice m_vk_physical_device{};
     vk::Device m_vk_device{};
-    vk::CommandPool m_vk_command_pool{};
-    vk::CommandBuffer m_vk_command_buffer{};
     vk::Extent2D m_vk_extent{};
     vk::SurfaceKHR m_vk_surface{};
     vk::Format m_vk_format{};
     vk::SwapchainKHR m_vk_swapchain{};
+    vk::SampleCountFlagBits m_sample_count{vk::SampleCountFlagBits::e1};
+
+    struct QueueFamilies
+    {
+        uint32_t graphics = UINT32_MAX;
+        uint32_t present = UINT32_MAX;
+        uint32_t transfer = UINT32_MAX; //graphics family if there is no separate one
+        uint32_t compute = UINT32_MAX; //async compute, graphics family if there is no separate one
+    } m_queue_families{};
+
+    //what the chosen device can do, the renderer picks its paths from the tier
+    DeviceCapabilities m_caps{};
+
+    vk::Queue m_vk_graphics_queue{};
+    vk::Queue m_vk_present_queue{};
+    vk::Queue m_vk_transfer_queue{};
+    vk::Queue m_vk_compute_queue{};
+
+    struct FrameData
+    {
+        //binary, the swapchain takes no timeline semaphores
+        vk::Semaphore image_available{};
+        vk::Semaphore render_finished{};
+        uint64_t done_value = 0; //graphics timeline value of its last submission
+    };
+    std::array<FrameData, MAX_FRAMES_IN_FLIGHT> m_frames{};
+    uint32_t m_frame_index = 0;
+    uint64_t m_frame_count = 0;
 
     struct ImageBuffer
     {
         //same index
         std::vector<vk::Image> images{};
         std::vector<vk::ImageView> image_views{};
+        std::vector<vk::DeviceMemory> memory{}; //headless only, swapchain images own theirs
     } m_image_buffer{};
 
+    //headless: every offscreen image is copied into its frame's buffer, picked up once the frame has been waited on again
+    struct ReadbackSlot
+    {
+        BufferAllocation buffer{};
+        uint64_t frame = 0; //0 when there is nothing to pick up
+    };
+    std::array<ReadbackSlot, MAX_FRAMES_IN_FLIGHT> m_readback_slots{};
+    Readback m_readback{};
+
     struct DepthBuffer
     {
+        vk::Format format{};
         vk::Image image{};
         vk::ImageView image_view{};
         vk::DeviceMemory memory{};
     } m_depth_buffer{};
 
-    struct UniformBuffer
-    {
-        vk::Buffer buffer{};
-        vk::DeviceMemory memory{};
-    } m_uniform_buffer{};
-
-    vk::DescriptorSetLayout m_vk_descriptor_set_layout{};
-    vk::PipelineLayout m_vk_pipeline_layout{};
-    vk::DescriptorPool m_vk_descriptor_pool{};
-    vk::DescriptorSet m_vk_descriptor_set{};
-    vk::RenderPass m_vk_render_pass{};
-    vk::ShaderModule m_vk_vertex_shader_module{};
-    vk::ShaderModule m_vk_fragment_shader_module{};
+    DescriptorAllocator m_descriptor_allocator{};
+    DrawConstants m_draw_constants{};
+    UploadQueue m_upload_queue{};
+    BindlessHeap m_bindless_heap{};
+    GPUScene m_gpu_scene{};
+    ClusteredLighting m_lighting{};
+    DepthPyramid m_depth_pyramid{};
+    ShadowAtlas m_shadow_atlas{};
+    DynamicResolution m_dynamic_resolution{};
+    TextureStreamer m_texture_streamer{};
+    GPUProfiler m_gpu_profiler{};
+    RenderGraph m_render_graph{};
+    RenderGraph::Pass* m_main_pass = nullptr;
+    RenderGraph::Pass* m_shadow_pass = nullptr;
+    RenderGraph::Pass* m_upscale_pass = nullptr;
+    PipelineManager m_pipeline_manager{};
+    uint32_t m_shader_features = 0;
 };
 
-template<typename T>
-static T Get(vk::ResultValue<T>&& res)
-{
-    Assert(res.result == vk::Result::eSuccess);
-    return res.value;
-}
-
 void RendererFrameworkImpl::Init()
 {
     // Create a window
-    m_window = m_window_framework.CreateWindow("Game", nullptr, std::bind(&RendererFrameworkImpl::OnMainWindowClose, this));
-    Assert(m_window);
-    m_window->Show();
+    if(!m_conf.headless)
+    {
+#ifdef _WIN32
+        Assert(m_window_framework);
+        m_window = m_window_framework->CreateWindow("Game", nullptr, std::bind(&RendererFrameworkImpl::OnMainWindowClose, this));
+        Assert(m_window);
+        m_window->Show();
+#else
+        Assert(false); //only headless without a window framework
+#endif
+    }
 
     // Vulkan stuff
     SetupVKInstance();
+    SetupVKSurface();
     SetupVKPhysicalDevice();
+    SetupVKSampleCount();
+    SetupVKQueueFamilies();
     SetupVKDevice();
-    SetupVKCommandPool();
-    SetupVKCommandQueue();
-    SetupVKSurface();
-    SetupVKSwapchain();
+    SetupVKSync();
+    SetupDescriptorAllocator();
+    if(m_conf.headless)
+    {
+        SetupOffscreenTargets();
+    }
+    else
+    {
+        SetupVKSwapchain();
+    }
     SetupVKImageViews();
     SetupVKDepthBuffer();
-    SetupVKUniformBuffer();
-    SetupVKDescriptors();
-    SetupVKPipeline();
-    SetupVKDescriptorPool();
-    SetupDescriptorSets();
-    SetupRenderPass();
-    SetupShaders();
+    SetupClusteredLighting();
+    SetupDrawConstants();
+    SetupUploadQueue();
+    SetupBindlessHeap();
+    SetupGPUScene();
+    SetupDepthPyramid();
+    SetupShadowAtlas();
+    SetupTextureStreamer();
+    SetupGPUProfiler();
+    SetupPipelineManager();
+    SetupDynamicResolution();
+    SetupRenderGraph();
+    SetupBenchmarkScene();
 }
 
 void RendererFrameworkImpl::Shutdown()
 {
+    Assert(m_vk_device);
+    Assert(m_vk_device.waitIdle() == vk::Result::eSuccess);
+
+    //workers may still be compiling against render passes and layouts destroyed below
+    m_pipeline_manager.Shutdown();
+
+    m_main_pass = nullptr;
+    m_shadow_pass = nullptr;
+    m_upscale_pass = nullptr;
+    m_render_graph.Shutdown();
+    m_dynamic_resolution.Shutdown();
+    m_gpu_profiler.Shutdown();
+    m_texture_streamer.Shutdown();
+    m_depth_pyramid.Shutdown();
+    m_shadow_atlas.Shutdown();
+    m_gpu_scene.Shutdown();
+    m_lighting.Shutdown();
+    m_bindless_heap.Shutdown();
+    m_upload_queue.Shutdown();
+
+    m_draw_constants.Shutdown();
+    m_descriptor_allocator.Shutdown();
+
+    m_vk_device.destroyImageView(m_depth_buffer.image_view);
+    m_vk_device.destroyImage(m_depth_buffer.image);
+    m_vk_device.freeMemory(m_depth_buffer.memory);
+
+    for(auto& image_view : m_image_buffer.image_views)
+    {
+        m_vk_device.destroyImageView(image_view);
+    }
+    if(m_vk_swapchain)
+    {
+        m_vk_device.destroySwapchainKHR(m_vk_swapchain);
+    }
+    else
+    {
+        for(size_t i = 0; i < m_image_buffer.images.size(); ++i)
+        {
+            m_vk_device.destroyImage(m_image_buffer.images[i]);
+            m_vk_device.freeMemory(m_image_buffer.memory[i]);
+        }
+    }
+    for(auto& slot : m_readback_slots)
+    {
+        DestroyBuffer(m_vk_device, slot.buffer);
+    }
+
+    for(auto& frame : m_frames)
+    {
+        m_vk_device.destroySemaphore(frame.image_available);
+        m_vk_device.destroySemaphore(frame.render_finished);
+    }
+
+    m_vk_device.destroy();
+    if(m_vk_surface)
+    {
+        m_vk_instance.destroySurfaceKHR(m_vk_surface);
+    }
+    m_vk_instance.destroy();
+}
+
+void RendererFrameworkImpl::FinishUpdate()
+{
+    if(!ShouldExit())
+    {
+        DrawFrame();
+    }
+}
+
+bool RendererFrameworkImpl::ShouldExit()
+{
+    if(m_conf.headless)
+    {
+        return (m_conf.frame_limit > 0) && (m_frame_count >= m_conf.frame_limit);
+    }
+#ifdef _WIN32
+    return !m_window;
+#else
+    return true;
+#endif
 }
 
 void RendererFrameworkImpl::OnMainWindowClose()
 {
+#ifdef _WIN32
     m_window.release();
+#endif
 }
 
 void RendererFrameworkImpl::SetupVKInstance()
 {
-    const vk::ApplicationInfo app_info;
+    //global functions first, instance ones once there is an instance, device ones in SetupVKDevice()
+    Assert(m_vk_loader.success());
+    VULKAN_HPP_DEFAULT_DISPATCHER.init(m_vk_loader.getProcAddress<PFN_vkGetInstanceProcAddr>("vkGetInstanceProcAddr"));
+
+    const vk::ApplicationInfo app_info(nullptr, 0, nullptr, 0, VK_API_VERSION_1_2);
 
-    const char* instance_extensions[] =
+    //headless needs no surface at all, so it also runs on ICDs without any WSI like lavapipe on a bare CI box
+    std::vector<const char*> instance_extensions;
+    if(!m_conf.headless)
     {
-        VK_KHR_SURFACE_EXTENSION_NAME,
-        VK_KHR_WIN32_SURFACE_EXTENSION_NAME
-    };
+        instance_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+#ifdef _WIN32
+        instance_extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+#endif
+    }
 
-    const vk::InstanceCreateInfo inst_info({}, &app_info, 0, nullptr, static_cast<uint32_t>(countof(instance_extensions)), instance_extensions);
+    const vk::InstanceCreateInfo inst_info({}, &app_info, 0, nullptr, static_cast<uint32_t>(instance_extensions.size()), instance_extensions.data());
     m_vk_instance = Get(vk::createInstance(inst_info));
+    VULKAN_HPP_DEFAULT_DISPATCHER.init(m_vk_instance);
 }
 
 void RendererFrameworkImpl::SetupVKPhysicalDevice()
 {
     Assert(m_vk_instance);
-    const auto& physical_devices = Get(m_vk_instance.enumeratePhysicalDevices());
-    Assert(!physical_devices.empty());
-    m_vk_physical_device = physical_devices[0];
+    const DeviceCandidate selected = SelectPhysicalDevice(m_vk_instance, m_vk_surface, m_conf.device_index);
+    m_vk_physical_device = selected.physical_device;
+    m_caps = selected.caps;
 }
 
-void RendererFrameworkImpl::SetupVKDevice()
+void RendererFrameworkImpl::SetupVKSampleCount()
 {
     Assert(m_vk_physical_device);
-    const char* device_extensions[] = 
-    {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME
-    };
-
-    const vk::DeviceCreateInfo device_info({}, 0, nullptr, 0, 0, static_cast<uint32_t>(countof(device_extensions)), device_extensions);
-    m_vk_device = Get(m_vk_physical_device.createDevice(device_info));
-}
 
-void RendererFrameworkImpl::SetupVKCommandPool()
-{
-    Assert(m_vk_device);
-    const vk::CommandPoolCreateInfo command_pool_info;
-    m_vk_command_pool = Get(m_vk_device.createCommandPool(command_pool_info));
-}
+    const auto& limits = m_vk_physical_device.getProperties().limits;
+    //the depth pyramid samples the multisampled depth buffer, see DepthPyramidCopyMS.comp
+    const vk::SampleCountFlags supported = limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts & limits.sampledImageDepthSampleCounts;
 
-void RendererFrameworkImpl::SetupVKCommandQueue()
-{
-    Assert(m_vk_device);
-    const vk::CommandBufferAllocateInfo command_buffer_info(m_vk_command_pool, vk::CommandBufferLevel::ePrimary, 1);
-    const auto& allocated_command_buffers = Get(m_vk_device.allocateCommandBuffers(command_buffer_info));
-    Assert(allocated_command_buffers.size() == 1);
-    m_vk_command_buffer = allocated_command_buffers[0];
-}
+    const vk::SampleCountFlagBits candidates[] =
+    {
+        vk::SampleCountFlagBits::e64,
+        vk::SampleCountFlagBits::e32,
+        vk::SampleCountFlagBits::e16,
+        vk::SampleCountFlagBits::e8,
+        vk::SampleCountFlagBits::e4,
+        vk::SampleCountFlagBits::e2
+    };
 
-void RendererFrameworkImpl::SetupVKSurface()
-{
-    Assert(m_window);
-    Assert(m_vk_instance);
-    const vk::Win32SurfaceCreateInfoKHR surface_create_info({}, m_window_framework.GetInstance(), m_window->GetHandle());
-    m_vk_surface = Get(m_vk_instance.createWin32SurfaceKHR(surface_create_info));
+    m_sample_count = vk::SampleCountFlagBits::e1;
+    for(const auto candidate : candidates)
+    {
+        if((static_cast<uint32_t>(candidate) <= m_conf.msaa_samples) && (supported & candidate))
+        {
+            m_sample_count = candidate;
+            break;
+        }
+    }
 }
 
-void RendererFrameworkImpl::SetupVKSwapchain()
+void RendererFrameworkImpl::SetupVKQueueFamilies()
 {
     Assert(m_vk_physical_device);
-    Assert(m_vk_surface);
-    Assert(m_vk_device);
+    Assert(m_vk_surface || m_conf.headless);
 
     const auto& queue_family_properties = m_vk_physical_device.getQueueFamilyProperties();
     Assert(!queue_family_properties.empty());
@@ -192,9 +374,12 @@ void RendererFrameworkImpl::SetupVKSwapchain()
     uint32_t graphics_queue_family_index = UINT32_MAX;
     uint32_t present_queue_family_index = UINT32_MAX;
 
+    //nothing is presented without a surface, present just aliases graphics
+    const auto supports_present = [this](const uint32_t family) { return !m_vk_surface || Get(m_vk_physical_device.getSurfaceSupportKHR(family, m_vk_surface)); };
+
     for(uint32_t i = 0; i < queue_family_properties.size(); ++i)
     {
-        if((queue_family_properties[i].queueFlags & vk::QueueFlagBits::eGraphics) && (Get(m_vk_physical_device.getSurfaceSupportKHR(i, m_vk_surface))))
+        if((queue_family_properties[i].queueFlags & vk::QueueFlagBits::eGraphics) && supports_present(i))
         {
             graphics_queue_family_index = i;
             present_queue_family_index = i;
@@ -215,7 +400,7 @@ void RendererFrameworkImpl::SetupVKSwapchain()
 
         for(uint32_t i = 0; i < queue_family_properties.size(); ++i)
         {
-            if(Get(m_vk_physical_device.getSurfaceSupportKHR(i, m_vk_surface)))
+            if(supports_present(i))
             {
                 present_queue_family_index = i;
                 break;
@@ -226,6 +411,147 @@ void RendererFrameworkImpl::SetupVKSwapchain()
     Assert(graphics_queue_family_index != UINT32_MAX);
     Assert(present_queue_family_index != UINT32_MAX);
 
+    m_queue_families.graphics = graphics_queue_family_index;
+    m_queue_families.present = present_queue_family_index;
+
+    //prefer a transfer only family (DMA engine), then anything without graphics
+    m_queue_families.transfer = m_queue_families.graphics;
+    for(const auto excluded : {vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute, vk::QueueFlags(vk::QueueFlagBits::eGraphics)})
+    {
+        for(uint32_t i = 0; i < queue_family_properties.size(); ++i)
+        {
+            const vk::QueueFlags flags = queue_family_properties[i].queueFlags;
+            if((flags & vk::QueueFlagBits::eTransfer) && !(flags & excluded))
+            {
+                m_queue_families.transfer = i;
+                break;
+            }
+        }
+        if(m_queue_families.transfer != m_queue_families.graphics)
+        {
+            break;
+        }
+    }
+
+    //async compute wants a compute family without graphics, it runs next to the graphics queue
+    m_queue_families.compute = m_queue_families.graphics;
+    for(uint32_t i = 0; i < queue_family_properties.size(); ++i)
+    {
+        const vk::QueueFlags flags = queue_family_properties[i].queueFlags;
+        if((flags & vk::QueueFlagBits::eCompute) && !(flags & vk::QueueFlagBits::eGraphics))
+        {
+            m_queue_families.compute = i;
+            break;
+        }
+    }
+}
+
+void RendererFrameworkImpl::SetupVKDevice()
+{
+    Assert(m_vk_physical_device);
+    Assert(m_queue_families.graphics != UINT32_MAX);
+
+    std::vector<const char*> device_extensions;
+    if(m_vk_surface)
+    {
+        device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+
+    //one queue per role, roles that share a family share its queues
+    const float queue_priority = 1.0f;
+    std::vector<vk::DeviceQueueCreateInfo> queue_infos;
+    for(const uint32_t family : {m_queue_families.graphics, m_queue_families.present, m_queue_families.transfer, m_queue_families.compute})
+    {
+        const auto found = std::find_if(queue_infos.begin(), queue_infos.end(), [family](const auto& info) { return info.queueFamilyIndex == family; });
+        if(found == queue_infos.end())
+        {
+            queue_infos.emplace_back(vk::DeviceQueueCreateFlags(), family, 1, &queue_priority);
+        }
+    }
+
+    //the device was only picked if it has everything the baseline tier needs
+    Assert(m_caps.Has(DeviceTier::Baseline));
+
+    vk::PhysicalDeviceFeatures2 features;
+    features.features.multiDrawIndirect = VK_TRUE;
+    features.features.drawIndirectFirstInstance = VK_TRUE;
+
+    vk::PhysicalDeviceVulkan12Features features_12;
+    features_12.timelineSemaphore = VK_TRUE;
+    features_12.hostQueryReset = m_caps.timestamps;
+    features_12.drawIndirectCount = m_caps.Has(DeviceTier::IndirectCount);
+    if(m_caps.Has(DeviceTier::Bindless))
+    {
+        features_12.descriptorIndexing = VK_TRUE;
+        features_12.runtimeDescriptorArray = VK_TRUE;
+        features_12.descriptorBindingPartiallyBound = VK_TRUE;
+        features_12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        features_12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        features_12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        features_12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        features_12.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+    }
+    features.pNext = &features_12;
+
+    vk::DeviceCreateInfo device_info
+    (
+        {},
+        static_cast<uint32_t>(queue_infos.size()),
+        queue_infos.data(),
+        0,
+        nullptr,
+        static_cast<uint32_t>(device_extensions.size()),
+        device_extensions.data(),
+        nullptr
+    );
+    device_info.pNext = &features;
+    m_vk_device = Get(m_vk_physical_device.createDevice(device_info));
+    //there is only ever this one device, its functions replace the instance level ones that dispatch per device
+    VULKAN_HPP_DEFAULT_DISPATCHER.init(m_vk_device);
+
+    m_vk_graphics_queue = m_vk_device.getQueue(m_queue_families.graphics, 0);
+    m_vk_present_queue = m_vk_device.getQueue(m_queue_families.present, 0);
+    m_vk_transfer_queue = m_vk_device.getQueue(m_queue_families.transfer, 0);
+    m_vk_compute_queue = m_vk_device.getQueue(m_queue_families.compute, 0);
+}
+
+void RendererFrameworkImpl::SetupVKSync()
+{
+    Assert(m_vk_device);
+    for(auto& frame : m_frames)
+    {
+        frame.image_available = Get(m_vk_device.createSemaphore(vk::SemaphoreCreateInfo()));
+        frame.render_finished = Get(m_vk_device.createSemaphore(vk::SemaphoreCreateInfo()));
+    }
+}
+
+void RendererFrameworkImpl::SetupDescriptorAllocator()
+{
+    Assert(m_vk_device);
+    m_descriptor_allocator.Init(m_vk_device, MAX_FRAMES_IN_FLIGHT);
+}
+
+void RendererFrameworkImpl::SetupVKSurface()
+{
+    Assert(m_vk_instance);
+    if(m_conf.headless)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    Assert(m_window);
+    const vk::Win32SurfaceCreateInfoKHR surface_create_info({}, m_window_framework->GetInstance(), m_window->GetHandle());
+    m_vk_surface = Get(m_vk_instance.createWin32SurfaceKHR(surface_create_info));
+#endif
+}
+
+void RendererFrameworkImpl::SetupVKSwapchain()
+{
+    Assert(m_vk_physical_device);
+    Assert(m_vk_surface);
+    Assert(m_vk_device);
+
     const auto& surface_formats = Get(m_vk_physical_device.getSurfaceFormatsKHR(m_vk_surface));
     Assert(!surface_formats.empty());
 
@@ -241,6 +567,7 @@ void RendererFrameworkImpl::SetupVKSwapchain()
     m_vk_extent = surface_capabilities.currentExtent;
     if(m_vk_extent.width == 0xFFFFFFFF)
     {
+#ifdef _WIN32
         const auto& window_size = m_window->GetSize();
         const vk::Extent2D window_extent = {window_size.first, window_size.second};
         m_vk_extent = 
@@ -248,6 +575,7 @@ void RendererFrameworkImpl::SetupVKSwapchain()
             std::clamp(window_extent.width, surface_capabilities.minImageExtent.width, surface_capabilities.maxImageExtent.width),
             std::clamp(window_extent.height, surface_capabilities.minImageExtent.height, surface_capabilities.maxImageExtent.height)
         };
+#endif
     }
 
     vk::SurfaceTransformFlagBitsKHR pre_transform = surface_capabilities.currentTransform;
@@ -276,9 +604,9 @@ void RendererFrameworkImpl::SetupVKSwapchain()
         {} //old swapchain
     );
 
-    if(graphics_queue_family_index != present_queue_family_index)
+    const uint32_t queueFamilyIndices[] = { m_queue_families.graphics, m_queue_families.present };
+    if(m_queue_families.graphics != m_queue_families.present)
     {
-        const uint32_t queueFamilyIndices[] = { graphics_queue_family_index, present_queue_family_index };
         swapchain_info.imageSharingMode = vk::SharingMode::eConcurrent;
         swapchain_info.queueFamilyIndexCount = 2;
         swapchain_info.pQueueFamilyIndices = queueFamilyIndices;
@@ -286,12 +614,65 @@ void RendererFrameworkImpl::SetupVKSwapchain()
     m_vk_swapchain = Get(m_vk_device.createSwapchainKHR(swapchain_info));
 }
 
+void RendererFrameworkImpl::SetupOffscreenTargets()
+{
+    Assert(m_vk_physical_device);
+    Assert(m_vk_device);
+
+    //one image per frame in flight stands in for the swapchain, so one can be read back while the next renders
+    m_vk_format = vk::Format::eR8G8B8A8Unorm;
+    m_vk_extent = vk::Extent2D(m_conf.width, m_conf.height);
+    const vk::DeviceSize readback_size = vk::DeviceSize(m_vk_extent.width) * m_vk_extent.height * 4;
+
+    const auto& mem_properties = m_vk_physical_device.getMemoryProperties();
+    vk::MemoryPropertyFlags readback_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    if(FindMemoryTypeIndex(mem_properties, UINT32_MAX, readback_flags | vk::MemoryPropertyFlagBits::eHostCached) != UINT32_MAX)
+    {
+        readback_flags |= vk::MemoryPropertyFlagBits::eHostCached; //the CPU reads every byte, uncached reads crawl
+    }
+
+    for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        const vk::ImageCreateInfo image_info
+        (
+            {},
+            vk::ImageType::e2D,
+            m_vk_format,
+            {m_vk_extent.width, m_vk_extent.height, 1},
+            1,
+            1,
+            vk::SampleCountFlagBits::e1,
+            vk::ImageTiling::eOptimal,
+            vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+            vk::SharingMode::eExclusive,
+            0,
+            nullptr,
+            vk::ImageLayout::eUndefined
+        );
+        const vk::Image image = Get(m_vk_device.createImage(image_info));
+
+        const auto& mem_reqs = m_vk_device.getImageMemoryRequirements(image);
+        const uint32_t memory_type_index = FindMemoryTypeIndex(mem_properties, mem_reqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        Assert(memory_type_index != UINT32_MAX);
+        const vk::DeviceMemory memory = Get(m_vk_device.allocateMemory(vk::MemoryAllocateInfo(mem_reqs.size, memory_type_index)));
+        Assert(m_vk_device.bindImageMemory(image, memory, 0) == vk::Result::eSuccess);
+
+        m_image_buffer.images.push_back(image);
+        m_image_buffer.memory.push_back(memory);
+
+        m_readback_slots[i].buffer = CreateBuffer(m_vk_physical_device, m_vk_device, readback_size, vk::BufferUsageFlagBits::eTransferDst, readback_flags);
+    }
+}
+
 void RendererFrameworkImpl::SetupVKImageViews()
 {
     Assert(m_vk_device);
-    Assert(m_vk_swapchain);
-    
-    m_image_buffer.images = Get(m_vk_device.getSwapchainImagesKHR(m_vk_swapchain));
+
+    if(m_vk_swapchain)
+    {
+        m_image_buffer.images = Get(m_vk_device.getSwapchainImagesKHR(m_vk_swapchain));
+    }
+    Assert(!m_image_buffer.images.empty());
 
     const size_t num_swapchain_images = m_image_buffer.images.size();
     m_image_buffer.image_views.resize(num_swapchain_images);
@@ -317,7 +698,8 @@ void RendererFrameworkImpl::SetupVKDepthBuffer()
     Assert(m_vk_physical_device);
     Assert(m_vk_device);
 
-    const vk::Format depth_format = vk::Format::eD16Unorm;
+    m_depth_buffer.format = vk::Format::eD16Unorm;
+    const vk::Format depth_format = m_depth_buffer.format;
 
     const auto& depth_props = m_vk_physical_device.getFormatProperties(depth_format);
 
@@ -343,9 +725,9 @@ void RendererFrameworkImpl::SetupVKDepthBuffer()
         {m_vk_extent.width, m_vk_extent.height, 1},
         1,
         1,
-        vk::SampleCountFlagBits::e16,
+        m_sample_count,
         image_tiling,
-        vk::ImageUsageFlagBits::eDepthStencilAttachment,
+        vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
         vk::SharingMode::eExclusive,
         0,
         nullptr,
@@ -356,20 +738,9 @@ void RendererFrameworkImpl::SetupVKDepthBuffer()
     const auto& mem_reqs = m_vk_device.getImageMemoryRequirements(m_depth_buffer.image);
     const auto& mem_properties = m_vk_physical_device.getMemoryProperties();
 
-    const vk::MemoryPropertyFlags mem_flags = vk::MemoryPropertyFlagBits::eDeviceLocal;
-    uint32_t memory_type_index;
-    for(memory_type_index = 0; memory_type_index < mem_properties.memoryTypeCount; ++memory_type_index)
-    {
-        if 
-        (
-            ((mem_properties.memoryTypes[memory_type_index].propertyFlags & mem_flags) == mem_flags) //has type flag
-            && ((mem_reqs.memoryTypeBits >> memory_type_index) & 1) //mem_reqs accepts that index
-        )
-        {
-            break;
-        }
-    }
-    Assert(memory_type_index < mem_properties.memoryTypeCount);
+    //the depth pyramid is built from it after the main pass, so it can't be transient any more
+    const uint32_t memory_type_index = FindMemoryTypeIndex(mem_properties, mem_reqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    Assert(memory_type_index != UINT32_MAX);
 
     const vk::MemoryAllocateInfo alloc_info(mem_reqs.size, memory_type_index);
     m_depth_buffer.memory = Get(m_vk_device.allocateMemory(alloc_info));
@@ -388,253 +759,640 @@ void RendererFrameworkImpl::SetupVKDepthBuffer()
     m_depth_buffer.image_view = Get(m_vk_device.createImageView(image_view_info));
 }
 
-void RendererFrameworkImpl::SetupVKUniformBuffer()
+void RendererFrameworkImpl::SetupClusteredLighting()
 {
     Assert(m_vk_physical_device);
     Assert(m_vk_device);
 
-    const vk::BufferCreateInfo buffer_info
-    (
-        {},
-        sizeof(glm::mat4), //TODO something more appropriate
-        vk::BufferUsageFlagBits::eUniformBuffer,
-        vk::SharingMode::eExclusive
-    );
+    //binning runs on the async compute queue, drawing on graphics
+    m_lighting.Init(m_vk_physical_device, m_vk_device, m_descriptor_allocator, 1 << 14, MAX_FRAMES_IN_FLIGHT, {m_queue_families.graphics, m_queue_families.compute});
+}
 
-    m_uniform_buffer.buffer = Get(m_vk_device.createBuffer(buffer_info));
+void RendererFrameworkImpl::SetupDrawConstants()
+{
+    Assert(m_vk_physical_device);
+    Assert(m_vk_device);
 
-    const auto& mem_reqs = m_vk_device.getBufferMemoryRequirements(m_uniform_buffer.buffer);
-    const auto& mem_properties = m_vk_physical_device.getMemoryProperties();
+    //the CPU recorded draws' transforms, the shadow atlas' 128 bytes are what every device takes as push constants
+    m_draw_constants.Init(m_vk_physical_device, m_vk_device, m_descriptor_allocator, sizeof(GPUScene::DepthConstants), vk::ShaderStageFlagBits::eVertex, MAX_FRAMES_IN_FLIGHT, 4096);
+}
+
+void RendererFrameworkImpl::SetupUploadQueue()
+{
+    Assert(m_vk_physical_device);
+    Assert(m_vk_device);
+    Assert(m_vk_transfer_queue);
+
+    const vk::DeviceSize staging_size = 64 * 1024 * 1024;
+    m_upload_queue.Init(m_vk_physical_device, m_vk_device, m_vk_transfer_queue, m_queue_families.transfer, m_queue_families.graphics, staging_size);
+}
+
+void RendererFrameworkImpl::SetupBindlessHeap()
+{
+    Assert(m_vk_physical_device);
+    Assert(m_vk_device);
 
-    const vk::MemoryPropertyFlags mem_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
-    uint32_t memory_type_index;
-    for(memory_type_index = 0; memory_type_index < mem_properties.memoryTypeCount; ++memory_type_index)
+    if(!m_caps.Has(DeviceTier::Bindless))
     {
-        if 
-        (
-            ((mem_properties.memoryTypes[memory_type_index].propertyFlags & mem_flags) == mem_flags) //has type flag
-            && ((mem_reqs.memoryTypeBits >> memory_type_index) & 1) //mem_reqs accepts that index
-        )
-        {
-            break;
-        }
+        return;
     }
-    Assert(memory_type_index < mem_properties.memoryTypeCount);
 
-    const vk::MemoryAllocateInfo alloc_info(mem_reqs.size, memory_type_index);
-    m_uniform_buffer.memory = Get(m_vk_device.allocateMemory(alloc_info));
+    BindlessHeap::Limits limits;
+    limits.max_sampled_images = 1 << 16;
+    limits.max_storage_buffers = 1 << 14;
+    limits.max_samplers = 1 << 8;
+    m_bindless_heap.Init(m_vk_physical_device, m_vk_device, limits, MAX_FRAMES_IN_FLIGHT);
+}
+
+void RendererFrameworkImpl::SetupGPUScene()
+{
+    Assert(m_vk_physical_device);
+    Assert(m_vk_device);
 
-    void* mem = Get(m_vk_device.mapMemory(m_uniform_buffer.memory, 0, sizeof(glm::mat4), {}));
-    glm::mat4 identity;
-    memcpy(mem, &identity, sizeof(glm::mat4));
-    m_vk_device.unmapMemory(m_uniform_buffer.memory);
+    GPUScene::Limits limits;
+    limits.max_objects = 1 << 18;
+    limits.max_meshes = 1 << 12;
+    limits.max_vertices = 1 << 22;
+    limits.max_indices = 1 << 24;
+    limits.max_textures = MAX_TEXTURES;
+    limits.max_meshlets = 1 << 18;
+    limits.max_meshlet_vertices = 1 << 23;
+    limits.max_visible_meshlets = 1 << 15;
+    m_gpu_scene.Init(m_vk_physical_device, m_vk_device, m_descriptor_allocator, m_upload_queue, limits, MAX_FRAMES_IN_FLIGHT, m_caps.Has(DeviceTier::IndirectCount), m_conf.meshlets);
 }
 
-void RendererFrameworkImpl::SetupVKDescriptors()
+void RendererFrameworkImpl::SetupDepthPyramid()
 {
+    Assert(m_vk_physical_device);
     Assert(m_vk_device);
+    Assert(m_depth_buffer.image_view);
 
-    const vk::DescriptorSetLayoutBinding layout_binding
+    m_depth_pyramid.Init
     (
-        0, 
-        vk::DescriptorType::eUniformBuffer, 
-        1, 
-        vk::ShaderStageFlagBits::eVertex
+        m_vk_physical_device,
+        m_vk_device,
+        m_descriptor_allocator,
+        m_vk_graphics_queue,
+        m_queue_families.graphics,
+        m_depth_buffer.image_view,
+        m_vk_extent,
+        m_sample_count
     );
+    m_gpu_scene.SetDepthPyramid(m_depth_pyramid.GetView(), m_depth_pyramid.GetSampler(), m_depth_pyramid.GetExtent(), m_depth_pyramid.GetMipCount());
+}
 
-    const vk::DescriptorSetLayoutCreateInfo layout_create_info
-    (
-        {},
-        1,
-        &layout_binding
-    );
+void RendererFrameworkImpl::SetupShadowAtlas()
+{
+    Assert(m_vk_physical_device);
+    Assert(m_vk_device);
+
+    //four 1024 lights or 64 of the smallest, whichever way the screen space splits it
+    ShadowAtlas::Limits limits;
+    limits.atlas_size = 4096;
+    limits.max_tile_size = 1024;
+    limits.max_lights = 64;
+    limits.faces_per_frame = 24;
+    m_shadow_atlas.Init(m_vk_physical_device, m_vk_device, m_vk_graphics_queue, m_queue_families.graphics, limits, MAX_FRAMES_IN_FLIGHT);
 
-    m_vk_descriptor_set_layout = Get(m_vk_device.createDescriptorSetLayout(layout_create_info));
+    std::vector<vk::Buffer> shadow_buffers;
+    for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        shadow_buffers.push_back(m_shadow_atlas.GetShadowBuffer(i));
+    }
+    m_lighting.SetShadowAtlas(m_shadow_atlas.GetView(), m_shadow_atlas.GetSampler(), shadow_buffers);
 }
 
-void RendererFrameworkImpl::SetupVKPipeline()
+void RendererFrameworkImpl::SetupTextureStreamer()
 {
+    Assert(m_vk_physical_device);
     Assert(m_vk_device);
-    Assert(m_vk_descriptor_set_layout);
 
-    const vk::PipelineLayoutCreateInfo layout_create_info
-    (
-        {},
-        1,
-        &m_vk_descriptor_set_layout,
-        0,
-        nullptr
-    );
+    //texture ids are shared with the scene's feedback
+    TextureStreamer::Limits limits;
+    limits.max_textures = MAX_TEXTURES;
+    limits.budget = 512 * 1024 * 1024;
+    limits.upload_bytes_per_frame = 16 * 1024 * 1024;
+    BindlessHeap* bindless_heap = m_caps.Has(DeviceTier::Bindless) ? &m_bindless_heap : nullptr;
+    m_texture_streamer.Init(m_vk_physical_device, m_vk_device, m_upload_queue, bindless_heap, limits, MAX_FRAMES_IN_FLIGHT);
+
+    if(bindless_heap)
+    {
+        std::vector<vk::Buffer> texture_tables;
+        for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+        {
+            texture_tables.push_back(m_texture_streamer.GetTextureTable(i));
+        }
+        m_gpu_scene.SetTextureTables(texture_tables);
+    }
+}
+
+void RendererFrameworkImpl::SetupGPUProfiler()
+{
+    Assert(m_vk_physical_device);
+    Assert(m_vk_device);
 
-    m_vk_pipeline_layout = Get(m_vk_device.createPipelineLayout(layout_create_info));
+    if(!m_caps.timestamps)
+    {
+        return;
+    }
+
+    m_gpu_profiler.Init(m_vk_physical_device, m_vk_device, m_queue_families.graphics, MAX_FRAMES_IN_FLIGHT, 64);
+    m_render_graph.SetProfiler(&m_gpu_profiler);
+}
+
+void RendererFrameworkImpl::SetupDynamicResolution()
+{
+    Assert(m_vk_device);
+
+    //no timestamps, nothing to steer by
+    DynamicResolution::Settings settings;
+    settings.target_ns = m_caps.timestamps ? static_cast<double>(m_conf.gpu_target_ms) * 1e6 : 0.0;
+    settings.min_scale = 0.5f;
+    settings.max_scale = 1.0f;
+    m_dynamic_resolution.Init(m_vk_device, m_descriptor_allocator, m_vk_extent, settings, MAX_FRAMES_IN_FLIGHT);
 }
 
-void RendererFrameworkImpl::SetupVKDescriptorPool()
+void RendererFrameworkImpl::SetupRenderGraph()
 {
+    Assert(m_vk_physical_device);
     Assert(m_vk_device);
+    Assert(m_depth_buffer.image);
 
-    const vk::DescriptorPoolSize pool_size
+    const RenderGraph::ImageDesc backbuffer_desc{m_vk_format, m_vk_extent};
+    const auto backbuffer = m_render_graph.ImportImage
     (
-        vk::DescriptorType::eUniformBuffer,
-        1
+        "Backbuffer",
+        backbuffer_desc,
+        m_image_buffer.images,
+        m_image_buffer.image_views,
+        vk::ImageLayout::eUndefined,
+        m_conf.headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR,
+        true
     );
 
-    const vk::DescriptorPoolCreateInfo pool_create_info
+    const RenderGraph::ImageDesc depth_desc{m_depth_buffer.format, m_vk_extent, m_sample_count};
+    const auto depth = m_render_graph.ImportImage
     (
-        {},
-        1,
-        1,
-        &pool_size
+        "Depth",
+        depth_desc,
+        {m_depth_buffer.image},
+        {m_depth_buffer.image_view},
+        vk::ImageLayout::eUndefined,
+        vk::ImageLayout::eUndefined,
+        false
     );
 
-    m_vk_descriptor_pool = Get(m_vk_device.createDescriptorPool(pool_create_info));
-}
+    const auto clusters = m_render_graph.ImportBuffer("Clusters", m_lighting.GetClusterBuffer());
 
-void RendererFrameworkImpl::SetupDescriptorSets()
-{
-    Assert(m_vk_device);
-    Assert(m_vk_descriptor_set_layout);
-    Assert(m_vk_descriptor_pool);
-    Assert(m_uniform_buffer.buffer);
+    //carries over from one frame's end to the next frame's culling
+    const RenderGraph::ImageDesc pyramid_desc{vk::Format::eR32Sfloat, m_depth_pyramid.GetExtent()};
+    const auto pyramid = m_render_graph.ImportImage
+    (
+        "DepthPyramid",
+        pyramid_desc,
+        {m_depth_pyramid.GetImage()},
+        {m_depth_pyramid.GetView()},
+        vk::ImageLayout::eShaderReadOnlyOptimal,
+        vk::ImageLayout::eShaderReadOnlyOptimal,
+        true
+    );
 
-    const vk::DescriptorSetAllocateInfo allocate_info
+    //tiles are cached from frame to frame, the pass only touches the faces that went stale
+    const RenderGraph::ImageDesc shadow_desc{ShadowAtlas::FORMAT, m_shadow_atlas.GetExtent()};
+    const auto shadow_atlas = m_render_graph.ImportImage
     (
-        m_vk_descriptor_pool,
-        1,
-        &m_vk_descriptor_set_layout
+        "ShadowAtlas",
+        shadow_desc,
+        {m_shadow_atlas.GetImage()},
+        {m_shadow_atlas.GetView()},
+        vk::ImageLayout::eShaderReadOnlyOptimal,
+        vk::ImageLayout::eShaderReadOnlyOptimal,
+        true
     );
-    auto sets = Get(m_vk_device.allocateDescriptorSets(allocate_info));
-    Assert(sets.size() == 1);
-    m_vk_descriptor_set = sets[0];
 
-    const vk::DescriptorBufferInfo descriptor_buffer_info(m_uniform_buffer.buffer, 0, 0);
+    //only needs the lights, overlaps culling on the compute queue
+    m_render_graph.AddPass("LightBinning", RenderGraph::PassType::AsyncCompute)
+        .Write(clusters, RenderGraph::Access::StorageWrite)
+        .SetExecute([this](vk::CommandBuffer command_buffer) { m_lighting.RecordBinning(command_buffer, m_frame_index); });
+
+    auto& cull_reset_pass = m_render_graph.AddPass("CullReset", RenderGraph::PassType::Compute);
+    auto& cull_pass = m_render_graph.AddPass("Cull", RenderGraph::PassType::Compute);
+    cull_reset_pass.SetExecute([this](vk::CommandBuffer command_buffer) { m_gpu_scene.RecordReset(command_buffer); });
+    cull_pass
+        .Read(pyramid, RenderGraph::Access::Sampled)
+        .SetExecute([this](vk::CommandBuffer command_buffer) { m_gpu_scene.RecordCull(command_buffer, m_frame_index); });
+
+    //what the main pass draws from, filled by whichever passes the GPU scene's mode needs
+    std::vector<std::pair<RenderGraph::ResourceHandle, RenderGraph::Access>> draw_inputs;
+    if(m_gpu_scene.UsesMeshlets())
+    {
+        const auto visible_objects = m_render_graph.ImportBuffer("VisibleObjects", m_gpu_scene.GetVisibleObjectBuffer());
+        const auto meshlet_dispatch = m_render_graph.ImportBuffer("MeshletDispatch", m_gpu_scene.GetMeshletDispatchBuffer());
+        const auto visible_meshlets = m_render_graph.ImportBuffer("VisibleMeshlets", m_gpu_scene.GetVisibleMeshletBuffer());
+        const auto meshlet_draw = m_render_graph.ImportBuffer("MeshletDraw", m_gpu_scene.GetMeshletDrawBuffer());
+        const auto meshlet_indices = m_render_graph.ImportBuffer("MeshletIndices", m_gpu_scene.GetMeshletIndexBuffer());
+
+        cull_reset_pass
+            .Write(visible_objects, RenderGraph::Access::TransferDst)
+            .Write(meshlet_dispatch, RenderGraph::Access::TransferDst)
+            .Write(meshlet_draw, RenderGraph::Access::TransferDst);
+        cull_pass
+            .Write(visible_objects, RenderGraph::Access::StorageWrite)
+            .Write(meshlet_dispatch, RenderGraph::Access::StorageWrite);
+        m_render_graph.AddPass("MeshletCull", RenderGraph::PassType::Compute)
+            .Read(visible_objects, RenderGraph::Access::StorageRead)
+            .Read(meshlet_dispatch, RenderGraph::Access::IndirectRead)
+            .Read(pyramid, RenderGraph::Access::Sampled)
+            .Write(visible_meshlets, RenderGraph::Access::StorageWrite)
+            .Write(meshlet_draw, RenderGraph::Access::StorageWrite)
+            .Write(meshlet_indices, RenderGraph::Access::StorageWrite)
+            .SetExecute([this](vk::CommandBuffer command_buffer) { m_gpu_scene.RecordMeshletCull(command_buffer, m_frame_index); });
+
+        draw_inputs =
+        {
+            {meshlet_draw, RenderGraph::Access::IndirectRead},
+            {meshlet_indices, RenderGraph::Access::IndexRead},
+            {visible_meshlets, RenderGraph::Access::StorageRead}
+        };
+    }
+    else
+    {
+        const auto draws = m_render_graph.ImportBuffer("Draws", m_gpu_scene.GetDrawBuffer());
+        const auto draw_count = m_render_graph.ImportBuffer("DrawCount", m_gpu_scene.GetCountBuffer());
+        const auto instances = m_render_graph.ImportBuffer("Instances", m_gpu_scene.GetInstanceBuffer());
+        const auto batch_counts = m_render_graph.ImportBuffer("BatchCounts", m_gpu_scene.GetBatchCountBuffer());
+
+        cull_reset_pass
+            .Write(draw_count, RenderGraph::Access::TransferDst)
+            .Write(batch_counts, RenderGraph::Access::TransferDst);
+        cull_pass
+            .Write(batch_counts, RenderGraph::Access::StorageWrite)
+            .Write(instances, RenderGraph::Access::StorageWrite);
+        m_render_graph.AddPass("Batch", RenderGraph::PassType::Compute)
+            .Read(batch_counts, RenderGraph::Access::StorageRead)
+            .Write(draws, RenderGraph::Access::StorageWrite)
+            .Write(draw_count, RenderGraph::Access::StorageWrite)
+            .SetExecute([this](vk::CommandBuffer command_buffer) { m_gpu_scene.RecordBatch(command_buffer, m_frame_index); });
+
+        draw_inputs =
+        {
+            {draws, RenderGraph::Access::IndirectRead},
+            {draw_count, RenderGraph::Access::IndirectRead},
+            {instances, RenderGraph::Access::StorageRead}
+        };
+    }
+
+    //no clear, RecordDraw() clears the tiles it renders
+    auto& shadow_pass = m_render_graph.AddPass("Shadows", RenderGraph::PassType::Graphics)
+        .Write(shadow_atlas, RenderGraph::Access::DepthAttachment)
+        .SetExecute([this](vk::CommandBuffer command_buffer) { m_shadow_atlas.RecordDraw(command_buffer, m_gpu_scene); });
+    m_shadow_pass = &shadow_pass;
+
+    const vk::ClearColorValue clear_colour(std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f});
+
+    //full size, the frame only renders to its top left at the dynamic resolution scale
+    const RenderGraph::ImageDesc scene_desc{m_vk_format, m_vk_extent};
+    const auto scene_color = m_render_graph.CreateImage("SceneColor", scene_desc);
+
+    auto& main_pass = m_render_graph.AddPass("Main", RenderGraph::PassType::Graphics);
+    if(m_sample_count == vk::SampleCountFlagBits::e1)
+    {
+        main_pass
+            .Write(scene_color, RenderGraph::Access::ColorAttachment)
+            .Clear(scene_color, clear_colour);
+    }
+    else
+    {
+        //multisampled colour never leaves the pass, it is resolved straight into the scene image
+        const RenderGraph::ImageDesc color_desc{m_vk_format, m_vk_extent, m_sample_count};
+        const auto color = m_render_graph.CreateImage("Color", color_desc);
+        main_pass
+            .Write(color, RenderGraph::Access::ColorAttachment)
+            .Clear(color, clear_colour)
+            .Write(scene_color, RenderGraph::Access::Resolve);
+    }
+    main_pass
+        .Write(depth, RenderGraph::Access::DepthAttachment)
+        .Clear(depth, vk::ClearDepthStencilValue(1.0f, 0))
+        .Read(clusters, RenderGraph::Access::StorageRead)
+        .Read(shadow_atlas, RenderGraph::Access::Sampled)
+        .SetExecute([this](vk::CommandBuffer command_buffer) { m_gpu_scene.RecordDraw(command_buffer, m_frame_index, m_dynamic_resolution.GetRenderExtent(), m_lighting.GetSet(m_frame_index)); });
+    for(const auto& input : draw_inputs)
+    {
+        main_pass.Read(input.first, input.second);
+    }
+    m_main_pass = &main_pass;
+
+    //every pixel of the output is written, the clear only keeps the old contents from being loaded
+    auto& upscale_pass = m_render_graph.AddPass("Upscale", RenderGraph::PassType::Graphics)
+        .Read(scene_color, RenderGraph::Access::Sampled)
+        .Write(backbuffer, RenderGraph::Access::ColorAttachment)
+        .Clear(backbuffer, clear_colour)
+        .SetExecute([this](vk::CommandBuffer command_buffer) { m_dynamic_resolution.RecordUpscale(command_buffer); });
+    m_upscale_pass = &upscale_pass;
+
+    //nothing in this frame reads it, the next frame's cull does
+    m_render_graph.AddPass("DepthPyramid", RenderGraph::PassType::Compute)
+        .Read(depth, RenderGraph::Access::Sampled)
+        .Write(pyramid, RenderGraph::Access::StorageWrite)
+        .SetSideEffects()
+        .SetExecute([this](vk::CommandBuffer command_buffer) { m_depth_pyramid.RecordBuild(command_buffer, m_dynamic_resolution.GetRenderExtent()); });
+
+    if(m_conf.headless)
+    {
+        m_render_graph.AddPass("Readback", RenderGraph::PassType::Compute)
+            .Read(backbuffer, RenderGraph::Access::TransferSrc)
+            .SetSideEffects()
+            .SetExecute([this](vk::CommandBuffer command_buffer) { RecordReadback(command_buffer); });
+    }
 
-    const vk::WriteDescriptorSet write
+    m_render_graph.SetOutput(backbuffer);
+    //cull stays on the graphics queue, the main pass needs it straight away
+    m_render_graph.Compile
     (
-        m_vk_descriptor_set,
-        0,
-        0,
-        1,
-        vk::DescriptorType::eUniformBuffer,
-        nullptr,
-        &descriptor_buffer_info
+        m_vk_physical_device,
+        m_vk_device,
+        {m_vk_graphics_queue, m_queue_families.graphics},
+        {m_vk_compute_queue, m_queue_families.compute},
+        MAX_FRAMES_IN_FLIGHT
     );
 
-    m_vk_device.updateDescriptorSets(1, &write, 0, nullptr);
+    //UNORM swapchains get the sRGB encode in the shader, the hardware only does it for SRGB formats
+    const vk::Format srgb_formats[] = {vk::Format::eB8G8R8A8Srgb, vk::Format::eR8G8B8A8Srgb, vk::Format::eA8B8G8R8SrgbPack32};
+    if(std::find(std::begin(srgb_formats), std::end(srgb_formats), m_vk_format) == std::end(srgb_formats))
+    {
+        m_shader_features |= SHADER_FEATURE_LINEAR_TO_SRGB;
+    }
+    m_gpu_scene.SetFeatures(m_shader_features);
+    m_gpu_scene.InitPipelines
+    (
+        m_pipeline_manager,
+        m_main_pass->GetRenderPass(),
+        m_main_pass->GetSubpass(),
+        m_sample_count,
+        m_lighting.GetSetLayout(),
+        m_caps.Has(DeviceTier::Bindless) ? &m_bindless_heap : nullptr
+    );
+    m_shadow_atlas.InitPipeline(m_pipeline_manager, m_shadow_pass->GetRenderPass(), m_shadow_pass->GetSubpass(), m_draw_constants);
+    m_dynamic_resolution.InitPipeline(m_pipeline_manager, m_upscale_pass->GetRenderPass(), m_upscale_pass->GetSubpass(), m_render_graph.GetImageView(scene_color, 0));
 }
 
-void RendererFrameworkImpl::SetupRenderPass()
+void RendererFrameworkImpl::SetupPipelineManager()
 {
     Assert(m_vk_device);
 
-    const auto num_samples = vk::SampleCountFlagBits::e16;
+    //leave a core for the render thread
+    const uint32_t worker_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    m_pipeline_manager.Init(m_vk_device, "./pipeline_cache.bin", worker_count);
+}
+
+void RendererFrameworkImpl::DrawFrame()
+{
+    ProfileScope profile_scope("DrawFrame");
 
-    const vk::AttachmentDescription attachments[2] =
+    FrameData& frame = m_frames[m_frame_index];
+
+    //frame pacing, upload and async compute completion all run on timeline semaphores
+    m_render_graph.Wait(frame.done_value);
+    m_descriptor_allocator.BeginFrame(m_frame_index);
+
+    //headless frames render into their own offscreen image, the last copy out of it has landed now
+    uint32_t image_index = m_frame_index;
+    if(m_conf.headless)
     {
-        vk::AttachmentDescription
-        (
-            {},
-            m_vk_format,
-            num_samples,
-            vk::AttachmentLoadOp::eClear,
-            vk::AttachmentStoreOp::eStore,
-            vk::AttachmentLoadOp::eDontCare,
-            vk::AttachmentStoreOp::eDontCare,
-            vk::ImageLayout::eUndefined,
-            vk::ImageLayout::ePresentSrcKHR
-        ),
-        vk::AttachmentDescription
-        (
-            {},
-            m_vk_format,
-            num_samples,
-            vk::AttachmentLoadOp::eClear,
-            vk::AttachmentStoreOp::eDontCare,
-            vk::AttachmentLoadOp::eDontCare,
-            vk::AttachmentStoreOp::eDontCare,
-            vk::ImageLayout::eUndefined,
-            vk::ImageLayout::eDepthStencilAttachmentOptimal
-        )
-    };
+        CollectReadback(m_frame_index);
+    }
+    else
+    {
+        const auto acquired = m_vk_device.acquireNextImageKHR(m_vk_swapchain, UINT64_MAX, frame.image_available, {});
+        Assert((acquired.result == vk::Result::eSuccess) || (acquired.result == vk::Result::eSuboptimalKHR));
+        image_index = acquired.value;
+    }
+
+    //everything sized by the screen follows the resolution this frame renders at
+    m_dynamic_resolution.Update(GetGPUFrameTime());
+    const vk::Extent2D render_extent = m_dynamic_resolution.GetRenderExtent();
+
+    //the wait guarantees the GPU is done with this frame's copy of the scene
+    m_gpu_scene.Defragment(DEFRAGMENT_BYTES_PER_FRAME);
+    m_gpu_scene.Update(m_frame_index, render_extent);
+    m_shadow_atlas.Update(m_frame_index, render_extent, m_gpu_scene.TakeChangedBounds());
+    m_texture_streamer.Update(m_frame_index, m_gpu_scene.GetTextureFeedback());
+    m_lighting.Update(m_frame_index, render_extent);
+    //the lit variant only once there is something to light with
+    m_gpu_scene.SetFeatures(m_shader_features | ((m_lighting.GetLightCount() > 0) ? SHADER_FEATURE_CLUSTERED_LIGHTING : 0));
+    m_draw_constants.BeginFrame(m_frame_index);
+    if(m_caps.Has(DeviceTier::Bindless))
+    {
+        m_bindless_heap.BeginFrame(m_frame_index);
+    }
+    if(m_caps.timestamps)
+    {
+        m_gpu_profiler.BeginFrame(m_frame_index);
+    }
+
+    //uploads issued since last frame go out now, finished ones are handed over to this frame
+    m_upload_queue.Flush();
+
+    //the upload value has already been reached, waiting on it only orders the ownership transfer
+    RenderGraph::FrameSubmit submit;
+    submit.frame_index = m_frame_index;
+    submit.image_index = image_index;
+    if(!m_conf.headless)
+    {
+        submit.waits.push_back({frame.image_available, 0, vk::PipelineStageFlagBits::eColorAttachmentOutput});
+        submit.signal = frame.render_finished;
+    }
+    submit.waits.push_back({m_upload_queue.GetSemaphore(), m_upload_queue.PrepareAcquire(), vk::PipelineStageFlagBits::eAllCommands});
+    submit.prologue = [this](vk::CommandBuffer command_buffer) { m_upload_queue.RecordAcquire(command_buffer); };
+    if(m_caps.timestamps)
+    {
+        m_gpu_profiler.MarkSubmit();
+    }
+    frame.done_value = m_render_graph.Submit(submit);
+    ++m_frame_count;
+
+    if(m_conf.headless)
+    {
+        m_readback_slots[m_frame_index].frame = m_frame_count;
+    }
+    else
+    {
+        const vk::PresentInfoKHR present_info(1, &frame.render_finished, 1, &m_vk_swapchain, &image_index);
+        const vk::Result present_result = m_vk_present_queue.presentKHR(present_info);
+        Assert((present_result == vk::Result::eSuccess) || (present_result == vk::Result::eSuboptimalKHR));
+    }
 
-    const vk::AttachmentReference color_reference(0, vk::ImageLayout::eColorAttachmentOptimal);
-    const vk::AttachmentReference depth_reference(0, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+    m_frame_index = (m_frame_index + 1) % MAX_FRAMES_IN_FLIGHT;
+}
 
-    const vk::SubpassDescription subpass_description
+void RendererFrameworkImpl::RecordReadback(const vk::CommandBuffer command_buffer) const
+{
+    //the graph has the image in TransferSrcOptimal for this pass
+    const vk::BufferImageCopy region
     (
-        {},
-        vk::PipelineBindPoint::eGraphics,
         0,
-        nullptr,
-        1,
-        &color_reference,
-        nullptr,
-        &depth_reference,
         0,
-        nullptr
+        0,
+        vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
+        vk::Offset3D(0, 0, 0),
+        vk::Extent3D(m_vk_extent.width, m_vk_extent.height, 1)
     );
-    
-    const vk::RenderPassCreateInfo render_pass_create_info
+    command_buffer.copyImageToBuffer(m_image_buffer.images[m_frame_index], vk::ImageLayout::eTransferSrcOptimal, m_readback_slots[m_frame_index].buffer.buffer, region);
+
+    const vk::BufferMemoryBarrier barrier
     (
-        {},
-        2,
-        attachments,
-        1,
-        &subpass_description,
+        vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlagBits::eHostRead,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        m_readback_slots[m_frame_index].buffer.buffer,
         0,
-        nullptr
+        VK_WHOLE_SIZE
     );
+    command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, nullptr, barrier, nullptr);
+}
+
+void RendererFrameworkImpl::CollectReadback(const uint32_t frame_index)
+{
+    ReadbackSlot& slot = m_readback_slots[frame_index];
+    if(slot.frame == 0)
+    {
+        return;
+    }
 
-    m_vk_render_pass = Get(m_vk_device.createRenderPass(render_pass_create_info));
+    //tightly packed RGBA8, rows top to bottom
+    const size_t size = size_t(m_vk_extent.width) * m_vk_extent.height * 4;
+    m_readback.frame = slot.frame;
+    m_readback.width = m_vk_extent.width;
+    m_readback.height = m_vk_extent.height;
+    m_readback.pixels.resize(size);
+    memcpy(m_readback.pixels.data(), slot.buffer.mapped, size);
+    slot.frame = 0;
 }
 
-void RendererFrameworkImpl::SetupShaders()
+void RendererFrameworkImpl::SetupBenchmarkScene()
 {
-    Assert(m_vk_device);
+    if(m_conf.benchmark_objects == 0)
+    {
+        return;
+    }
 
-    auto ReadByteCode = [](auto& filename)
+    //a fixed grid of cubes in front of a fixed camera, every run renders exactly the same frames
+    const std::vector<GPUScene::Vertex> corners =
+    {
+        {{-0.5f, -0.5f, -0.5f, 1.0f}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{ 0.5f, -0.5f, -0.5f, 1.0f}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{ 0.5f,  0.5f, -0.5f, 1.0f}, {0.0f, 0.0f, 1.0f, 1.0f}},
+        {{-0.5f,  0.5f, -0.5f, 1.0f}, {1.0f, 1.0f, 0.0f, 1.0f}},
+        {{-0.5f, -0.5f,  0.5f, 1.0f}, {1.0f, 0.0f, 1.0f, 1.0f}},
+        {{ 0.5f, -0.5f,  0.5f, 1.0f}, {0.0f, 1.0f, 1.0f, 1.0f}},
+        {{ 0.5f,  0.5f,  0.5f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{-0.5f,  0.5f,  0.5f, 1.0f}, {0.5f, 0.5f, 0.5f, 1.0f}}
+    };
+    const uint32_t faces[6][4] =
     {
-        std::vector<uint32_t> ret;
-        std::ifstream file(filename, std::ifstream::in | std::ifstream::binary);
-        Assert(file);
-        
-        file.seekg(0, std::ios::end);
-        std::streamsize size = file.tellg();
+        {4, 5, 6, 7}, //+z
+        {1, 0, 3, 2}, //-z
+        {5, 1, 2, 6}, //+x
+        {0, 4, 7, 3}, //-x
+        {7, 6, 2, 3}, //+y
+        {0, 1, 5, 4}  //-y
+    };
 
-        Assert
-        (
-            (size > 0)
-            && ((size % sizeof(uint32_t)) == 0)
-            && ((size / sizeof(uint32_t)) <= std::numeric_limits<uint32_t>::max())
-        );
-        ret.resize(static_cast<size_t>(size / sizeof(uint32_t)));
+    //corners aren't shared between faces, each face maps the whole texture
+    const glm::vec2 face_uvs[4] = {{0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 1.0f}};
+    std::vector<GPUScene::Vertex> vertices;
+    std::vector<uint32_t> indices;
+    for(const auto& face : faces)
+    {
+        const uint32_t first_vertex = static_cast<uint32_t>(vertices.size());
+        const glm::vec3 tangent = glm::normalize(glm::vec3(corners[face[1]].position - corners[face[0]].position));
+        const glm::vec3 bitangent = glm::vec3(corners[face[3]].position - corners[face[0]].position);
+        const glm::vec3 normal = glm::normalize(glm::cross(tangent, bitangent));
+        for(uint32_t c = 0; c < 4; ++c)
+        {
+            GPUScene::Vertex vertex = corners[face[c]];
+            vertex.normal = normal;
+            vertex.tangent = glm::vec4(tangent, 1.0f);
+            vertex.uv = face_uvs[c];
+            vertices.push_back(vertex);
+        }
+        for(const uint32_t c : {0u, 1u, 2u, 2u, 3u, 0u})
+        {
+            indices.push_back(first_vertex + c);
+        }
+    }
+    const uint32_t cube = m_gpu_scene.AddMesh(vertices, indices);
 
-        file.seekg(std::ios::beg);
-        file.read(reinterpret_cast<char*>(&ret[0]), size);
+    //a few checkerboards of different sizes, streamed in as the cubes get close enough to need them
+    std::array<uint32_t, 4> textures{};
+    for(uint32_t t = 0; t < textures.size(); ++t)
+    {
+        const uint32_t size = 256u << t;
+        const uint32_t check = 8u << t;
+        std::vector<uint8_t> pixels(size_t(size) * size * 4);
+        for(uint32_t y = 0; y < size; ++y)
+        {
+            for(uint32_t x = 0; x < size; ++x)
+            {
+                const uint8_t value = (((x / check) + (y / check)) & 1) ? 255 : 64;
+                uint8_t* texel = &pixels[(size_t(y) * size + x) * 4];
+                texel[0] = value;
+                texel[1] = value;
+                texel[2] = value;
+                texel[3] = 255;
+            }
+        }
+        textures[t] = m_texture_streamer.AddTexture(size, size, TextureStreamer::BuildMipChain(size, size, pixels.data()));
+    }
 
-        return ret;
-    };
+    const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(m_conf.benchmark_objects))));
+    const float spacing = 2.0f;
+    const float half_extent = 0.5f * spacing * static_cast<float>(side - 1);
+    for(uint32_t i = 0; i < m_conf.benchmark_objects; ++i)
+    {
+        const glm::vec3 position(static_cast<float>(i % side) * spacing - half_extent, 0.0f, static_cast<float>(i / side) * spacing - half_extent);
+        m_gpu_scene.AddObject(cube, glm::translate(glm::mat4(1.0f), position), 0xFFFFFFFF, textures[i % textures.size()]);
+    }
 
-    std::vector<uint32_t> vertex_shader_bytecode = ReadByteCode("./Resources/Shaders/Simple.vert.spv");
-	const vk::ShaderModuleCreateInfo vertex_shader_module_create_info
-	(
-		{},
-        vertex_shader_bytecode.size(),
-        &vertex_shader_bytecode[0]
-	);
-    m_vk_vertex_shader_module = Get(m_vk_device.createShaderModule(vertex_shader_module_create_info));
-
-    std::vector<uint32_t> fragment_shader_bytecode = ReadByteCode("./Resources/Shaders/Simple.frag.spv");
-    const vk::ShaderModuleCreateInfo fragment_shader_module_create_info
-    (
-        {},
-        fragment_shader_bytecode.size(),
-        &fragment_shader_bytecode[0]
-    );
-    m_vk_fragment_shader_module = Get(m_vk_device.createShaderModule(fragment_shader_module_create_info));
+    //a light for every fourth cube, hovering over the grid in a spread of colours, as many of them
+    //shadowed as the atlas takes, spread evenly over the grid
+    const uint32_t light_count = std::min(m_conf.benchmark_objects / 4 + 1, 1u << 14);
+    const uint32_t shadow_stride = (light_count + 63) / 64;
+    const uint32_t light_side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(light_count))));
+    const float light_spacing = 2.0f * half_extent / static_cast<float>(std::max(light_side - 1, 1u));
+    for(uint32_t i = 0; i < light_count; ++i)
+    {
+        const glm::vec3 position(static_cast<float>(i % light_side) * light_spacing - half_extent, 1.0f, static_cast<float>(i / light_side) * light_spacing - half_extent);
+        const float hue = static_cast<float>(i) * 0.618034f;
+        const glm::vec3 colour = glm::clamp(glm::abs(glm::fract(glm::vec3(hue) + glm::vec3(0.0f, 2.0f / 3.0f, 1.0f / 3.0f)) * 6.0f - 3.0f) - 1.0f, 0.0f, 1.0f);
+        const float radius = 2.5f * std::max(light_spacing, spacing);
+        const uint32_t light = m_lighting.AddLight(position, radius, colour);
+        if(i % shadow_stride == 0)
+        {
+            m_lighting.SetShadow(light, m_shadow_atlas.AddLight(position, radius));
+        }
+    }
+
+    const float aspect = static_cast<float>(m_vk_extent.width) / static_cast<float>(m_vk_extent.height);
+    const float near_plane = 0.1f;
+    const float far_plane = 4.0f * (half_extent + spacing);
+    glm::mat4 projection = glm::perspectiveRH_ZO(glm::radians(60.0f), aspect, near_plane, far_plane);
+    projection[1][1] *= -1.0f; //Vulkan clip space has y down
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, half_extent + spacing, 1.5f * (half_extent + spacing)), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    m_gpu_scene.SetViewProjection(projection * view);
+    m_lighting.SetView(view, projection, near_plane, far_plane);
+    m_shadow_atlas.SetViewProjection(projection * view);
+}
+
+std::unique_ptr<RendererFramework> RendererFramework::Create(WindowFramework& window_framework, const StartupConf& conf)
+{
+    return std::make_unique<RendererFrameworkImpl>(&window_framework, conf);
 }
 
-std::unique_ptr<RendererFramework> RendererFramework::Create(WindowFramework& window_framework)
+std::unique_ptr<RendererFramework> RendererFramework::CreateHeadless(const StartupConf& conf)
 {
-    return std::make_unique<RendererFrameworkImpl>(window_framework);
+    Assert(conf.headless);
+    return std::make_unique<RendererFrameworkImpl>(nullptr, conf);
 }
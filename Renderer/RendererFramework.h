@@ -9,6 +9,22 @@ class WindowFramework;
 class RendererEXPORT RendererFramework : public Framework
 {
 public:
-    static std::unique_ptr<RendererFramework> Create(WindowFramework& window_framework);
+    static std::unique_ptr<RendererFramework> Create(WindowFramework& window_framework, const StartupConf& conf);
+    //conf.headless has to be set, no window framework needed
+    static std::unique_ptr<RendererFramework> CreateHeadless(const StartupConf& conf);
+
+    //headless only: the newest frame that has finished on the GPU, RGBA8 rows without padding
+    //frames are read MAX_FRAMES_IN_FLIGHT frames after they were submitted so reading never waits
+    struct Readback
+    {
+        uint64_t frame = 0; //0 until the first one arrives
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> pixels{};
+    };
+    virtual const Readback& GetReadback() const = 0;
+
+    //nanoseconds, of the newest frame the GPU profiler read back, 0 without timestamp support
+    virtual double GetGPUFrameTime() const = 0;
 };
 
@@ -0,0 +1,16 @@
+#pragma once
+
+//feature switches the shaders are specialized on
+//bit i is the specialization constant with constant_id = i, declared in GLSL as
+//    layout(constant_id = i) const bool NAME = false;
+//so a switch folds away when the pipeline is compiled instead of branching on a uniform
+//a shader only has to declare the ones it reads
+
+enum ShaderFeature : uint32_t
+{
+    SHADER_FEATURE_LINEAR_TO_SRGB = 1 << 0, //encode in the shader, the swapchain format doesn't
+    SHADER_FEATURE_OBJECT_COLOUR = 1 << 1, //colour by object instead of by vertex, for debugging
+    SHADER_FEATURE_CLUSTERED_LIGHTING = 1 << 2 //light with the binned lights of ClusteredLighting
+};
+
+static constexpr uint32_t SHADER_FEATURE_COUNT = 3;
@@ -0,0 +1,43 @@
+#include "stdafx.h"
+#include "ShaderPermutations.h"
+
+//2^n variants, keep n small
+static const uint32_t MAX_SWITCHES = 6;
+
+void ShaderPermutations::Init(PipelineManager& pipelines, const PipelineManager::GraphicsDesc& desc, const uint32_t features)
+{
+    Assert((features >> SHADER_FEATURE_COUNT) == 0);
+
+    uint32_t switch_count = 0;
+    for(uint32_t bits = features; bits != 0; bits &= bits - 1)
+    {
+        ++switch_count;
+    }
+    Assert(switch_count <= MAX_SWITCHES);
+
+    m_pipelines = &pipelines;
+    m_features = features;
+    m_variants.resize(size_t(1) << switch_count);
+
+    //index 0 has every switch off, it goes first and is everyone's fallback
+    PipelineManager::GraphicsDesc variant = desc;
+    for(uint32_t index = 0; index < m_variants.size(); ++index)
+    {
+        variant.features = (desc.features & ~m_features) | Expand(index, m_features);
+        m_variants[index] = pipelines.Request(variant, index == 0 ? PipelineManager::INVALID_HANDLE : m_variants[0]);
+    }
+}
+
+void ShaderPermutations::Shutdown()
+{
+    //the pipelines belong to the manager
+    m_variants.clear();
+    m_features = 0;
+    m_pipelines = nullptr;
+}
+
+vk::Pipeline ShaderPermutations::Get(const uint32_t features) const
+{
+    Assert(m_pipelines);
+    return m_pipelines->Get(m_variants[Compact(features, m_features)]);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "PipelineManager.h"
+
+//every variant of one pipeline over the feature switches its shaders read
+//all combinations are requested from the pipeline manager when the set is created, so they compile
+//in the background before anyone asks for them, each one falling back to the variant with every
+//switch off until it is ready
+//lookups take any feature mask: the bits the set cares about are packed into a dense index
+
+class ShaderPermutations
+{
+public:
+    //features: the switches that make a difference to this pipeline
+    void Init(PipelineManager& pipelines, const PipelineManager::GraphicsDesc& desc, const uint32_t features);
+    void Shutdown();
+
+    //bits outside the set's features are ignored
+    vk::Pipeline Get(const uint32_t features) const;
+    PipelineManager::Handle GetHandle(const uint32_t features) const { return m_variants[Compact(features, m_features)]; }
+    size_t GetVariantCount() const { return m_variants.size(); }
+
+    //inline below, they work without a pipeline manager
+    //software pext: gathers the bits of features selected by set_features into the low bits
+    static uint32_t Compact(const uint32_t features, const uint32_t set_features);
+    //and pdep, the other way
+    static uint32_t Expand(const uint32_t index, const uint32_t set_features);
+
+private:
+    PipelineManager* m_pipelines = nullptr;
+    uint32_t m_features = 0;
+    std::vector<PipelineManager::Handle> m_variants{}; //indexed by Compact()
+};
+
+inline uint32_t ShaderPermutations::Compact(const uint32_t features, const uint32_t set_features)
+{
+    uint32_t index = 0;
+    uint32_t out_bit = 1;
+    for(uint32_t bits = set_features; bits != 0; bits &= bits - 1)
+    {
+        if(features & bits & ~(bits - 1))
+        {
+            index |= out_bit;
+        }
+        out_bit <<= 1;
+    }
+    return index;
+}
+
+inline uint32_t ShaderPermutations::Expand(const uint32_t index, const uint32_t set_features)
+{
+    uint32_t features = 0;
+    uint32_t in_bit = 1;
+    for(uint32_t bits = set_features; bits != 0; bits &= bits - 1)
+    {
+        if(index & in_bit)
+        {
+            features |= bits & ~(bits - 1);
+        }
+        in_bit <<= 1;
+    }
+    return features;
+}
@@ -0,0 +1,576 @@
+#include "stdafx.h"
+#include "ShadowAtlas.h"
+#include "DrawConstants.h"
+#include "GPUScene.h"
+
+#include <glm/glm/gtc/matrix_transform.hpp>
+
+static const float NEAR_PLANE = 0.01f; //of the radius
+static const uint32_t ALL_FACES = (1u << ShadowAtlas::FACE_COUNT) - 1;
+
+static uint32_t NextPowerOfTwo(const uint32_t value)
+{
+    uint32_t ret = 1;
+    while(ret < value)
+    {
+        ret <<= 1;
+    }
+    return ret;
+}
+
+static uint32_t CountBits(uint32_t value)
+{
+    uint32_t count = 0;
+    for(; value != 0; value &= value - 1)
+    {
+        ++count;
+    }
+    return count;
+}
+
+//largest side of the sphere's bounding box on screen in pixels, the whole screen if it crosses the camera plane
+static float ScreenSize(const glm::mat4& view_projection, const glm::vec4& sphere, const vk::Extent2D& extent)
+{
+    glm::vec2 ndc_min(1.0f);
+    glm::vec2 ndc_max(-1.0f);
+    for(uint32_t i = 0; i < 8; ++i)
+    {
+        const glm::vec3 corner = glm::vec3(sphere) + sphere.w * glm::vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+        const glm::vec4 clip = view_projection * glm::vec4(corner, 1.0f);
+        if(clip.w <= 0.0f)
+        {
+            return static_cast<float>(std::max(extent.width, extent.height));
+        }
+        ndc_min = glm::min(ndc_min, glm::vec2(clip) / clip.w);
+        ndc_max = glm::max(ndc_max, glm::vec2(clip) / clip.w);
+    }
+    const glm::vec2 size = (glm::clamp(ndc_max, -1.0f, 1.0f) - glm::clamp(ndc_min, -1.0f, 1.0f)) * 0.5f;
+    return std::max(size.x * static_cast<float>(extent.width), size.y * static_cast<float>(extent.height));
+}
+
+void ShadowAtlas::Init
+(
+    const vk::PhysicalDevice physical_device,
+    const vk::Device device,
+    const vk::Queue queue,
+    const uint32_t queue_family,
+    const Limits& limits,
+    const uint32_t frames_in_flight
+)
+{
+    Assert(physical_device);
+    Assert(device);
+    Assert(frames_in_flight > 0);
+    Assert(NextPowerOfTwo(limits.atlas_size) == limits.atlas_size);
+    Assert(NextPowerOfTwo(limits.max_tile_size) == limits.max_tile_size);
+    Assert((limits.max_tile_size >= MIN_TILE_SIZE) && (limits.max_tile_size <= limits.atlas_size));
+    Assert(limits.faces_per_frame >= FACE_COUNT);
+
+    m_device = device;
+    m_limits = limits;
+    //faces are submitted from the render thread, only a scene with a lot of objects sorts on more
+    m_draw_list.Init(1, std::max(std::thread::hardware_concurrency(), 1u));
+
+    const vk::ImageCreateInfo image_info
+    (
+        {},
+        vk::ImageType::e2D,
+        FORMAT,
+        {m_limits.atlas_size, m_limits.atlas_size, 1},
+        1,
+        1,
+        vk::SampleCountFlagBits::e1,
+        vk::ImageTiling::eOptimal,
+        vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+        vk::SharingMode::eExclusive,
+        0,
+        nullptr,
+        vk::ImageLayout::eUndefined
+    );
+    m_image = Get(m_device.createImage(image_info));
+
+    const auto& mem_reqs = m_device.getImageMemoryRequirements(m_image);
+    const uint32_t memory_type_index = FindMemoryTypeIndex(physical_device.getMemoryProperties(), mem_reqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    Assert(memory_type_index != UINT32_MAX);
+    m_memory = Get(m_device.allocateMemory(vk::MemoryAllocateInfo(mem_reqs.size, memory_type_index)));
+    Assert(m_device.bindImageMemory(m_image, m_memory, 0) == vk::Result::eSuccess);
+
+    const vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1);
+    m_view = Get(m_device.createImageView(vk::ImageViewCreateInfo({}, m_image, vk::ImageViewType::e2D, FORMAT, vk::ComponentMapping(), range)));
+
+    //linear filtering of depth formats is optional, Simple.frag takes its own taps
+    vk::SamplerCreateInfo sampler_info
+    (
+        {},
+        vk::Filter::eNearest,
+        vk::Filter::eNearest,
+        vk::SamplerMipmapMode::eNearest,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge
+    );
+    sampler_info.compareEnable = VK_TRUE;
+    sampler_info.compareOp = vk::CompareOp::eLessOrEqual;
+    m_sampler = Get(m_device.createSampler(sampler_info));
+
+    const vk::MemoryPropertyFlags host_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    m_frames.resize(frames_in_flight);
+    for(auto& frame : m_frames)
+    {
+        frame.shadows = CreateBuffer(physical_device, m_device, sizeof(GPUShadow) * m_limits.max_lights, vk::BufferUsageFlagBits::eStorageBuffer, host_flags);
+    }
+
+    //a single free tile covering everything
+    uint32_t tile_sizes = 1;
+    while((m_limits.atlas_size >> tile_sizes) >= MIN_TILE_SIZE)
+    {
+        ++tile_sizes;
+    }
+    m_free_tiles.resize(tile_sizes);
+    m_free_tiles[0].push_back(glm::uvec2(0));
+
+    Clear(queue, queue_family);
+}
+
+void ShadowAtlas::InitPipeline(PipelineManager& pipelines, const vk::RenderPass render_pass, const uint32_t subpass, DrawConstants& draw_constants)
+{
+    Assert(m_device);
+    Assert(render_pass);
+    Assert(draw_constants.GetSize() == sizeof(GPUScene::DepthConstants));
+    Assert(draw_constants.UsesPushConstants()); //Shadow.vert only comes with a push constant block
+
+    m_draw_constants = &draw_constants;
+    m_pipeline_layout = m_draw_constants->CreatePipelineLayout({});
+
+    PipelineManager::GraphicsDesc desc;
+    desc.vertex_shader = "./Resources/Shaders/Shadow.vert.spv";
+    desc.fragment_shader = "./Resources/Shaders/Shadow.frag.spv";
+    desc.vertex_bindings = {vk::VertexInputBindingDescription(0, sizeof(PackedVertex), vk::VertexInputRate::eVertex)};
+    desc.vertex_attributes = {vk::VertexInputAttributeDescription(0, 0, vk::Format::eR16G16B16A16Unorm, offsetof(PackedVertex, position_xy))};
+    //back faces only, whatever acne the bias misses ends up on surfaces facing away from the light
+    desc.cull_mode = vk::CullModeFlagBits::eFront;
+    desc.color_attachments = 0;
+    desc.layout = m_pipeline_layout;
+    desc.render_pass = render_pass;
+    desc.subpass = subpass;
+
+    m_pipelines = &pipelines;
+    m_pipeline = pipelines.RequestNow(desc);
+}
+
+void ShadowAtlas::Shutdown()
+{
+    if(!m_device)
+    {
+        return;
+    }
+
+    m_device.destroyPipelineLayout(m_pipeline_layout);
+    m_draw_constants = nullptr;
+    m_pipeline = PipelineManager::INVALID_HANDLE;
+    m_pipelines = nullptr;
+
+    for(auto& frame : m_frames)
+    {
+        DestroyBuffer(m_device, frame.shadows);
+    }
+    m_frames.clear();
+
+    m_device.destroySampler(m_sampler);
+    m_device.destroyImageView(m_view);
+    m_device.destroyImage(m_image);
+    m_device.freeMemory(m_memory);
+
+    m_lights.clear();
+    m_free_tiles.clear();
+    m_draws.clear();
+    m_device = vk::Device();
+}
+
+uint32_t ShadowAtlas::AddLight(const glm::vec3& position, const float radius)
+{
+    Assert(m_lights.size() < m_limits.max_lights);
+
+    const uint32_t shadow = static_cast<uint32_t>(m_lights.size());
+    m_lights.emplace_back();
+    SetLight(shadow, position, radius);
+    return shadow;
+}
+
+void ShadowAtlas::SetLight(const uint32_t shadow, const glm::vec3& position, const float radius)
+{
+    Assert(shadow < m_lights.size());
+    Assert(radius > 0.0f);
+
+    Light& light = m_lights[shadow];
+    if((light.position == position) && (light.radius == radius))
+    {
+        return;
+    }
+    light.position = position;
+    light.radius = radius;
+    light.dirty_faces = ALL_FACES;
+    light.moved = true;
+}
+
+void ShadowAtlas::Update(const uint32_t frame_index, const vk::Extent2D& extent, const std::vector<glm::vec4>& changed_bounds)
+{
+    //importance, lights off screen light nothing anyone can see
+    glm::vec4 planes[6];
+    GPUScene::GetFrustumPlanes(m_view_projection, planes);
+    std::vector<uint32_t> order(m_lights.size());
+    for(uint32_t i = 0; i < m_lights.size(); ++i)
+    {
+        Light& light = m_lights[i];
+        const glm::vec4 sphere(light.position, light.radius);
+        light.importance = GPUScene::InFrustum(planes, sphere) ? ScreenSize(m_view_projection, sphere, extent) : 0.0f;
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](const uint32_t a, const uint32_t b) { return m_lights[a].importance > m_lights[b].importance; });
+
+    //a face is about half the light's range across, shrinking waits for a factor of four so
+    //lights hovering around a size don't get new tiles every frame
+    auto wanted_size = [this](const Light& light)
+    {
+        const uint32_t size = NextPowerOfTwo(static_cast<uint32_t>(light.importance * 0.5f));
+        return (size < MIN_TILE_SIZE) ? MIN_TILE_SIZE : std::min(size, m_limits.max_tile_size);
+    };
+    for(const uint32_t i : order)
+    {
+        Light& light = m_lights[i];
+        if((light.tile_size > 0) && (wanted_size(light) * 4 <= light.tile_size))
+        {
+            Resize(light, wanted_size(light));
+            MarkDirty(i);
+        }
+    }
+    //growing in order of importance, a light that didn't fit only tries again once something was freed
+    for(const uint32_t i : order)
+    {
+        Light& light = m_lights[i];
+        const uint32_t wanted = wanted_size(light);
+        if(((light.tile_size == 0) || (wanted > light.tile_size)) && (light.failed_generation != m_free_generation))
+        {
+            Resize(light, wanted);
+            if(light.tile_size < wanted)
+            {
+                light.failed_generation = m_free_generation;
+            }
+            MarkDirty(i);
+        }
+    }
+
+    //casters that moved through a face
+    for(const auto& bounds : changed_bounds)
+    {
+        for(auto& light : m_lights)
+        {
+            if((light.dirty_faces == ALL_FACES) || (glm::length(glm::vec3(bounds) - light.position) >= light.radius + bounds.w))
+            {
+                continue;
+            }
+            for(uint32_t face = 0; face < FACE_COUNT; ++face)
+            {
+                glm::vec4 face_planes[6];
+                GPUScene::GetFrustumPlanes(GetFaceViewProjection(light, face), face_planes);
+                if(GPUScene::InFrustum(face_planes, bounds))
+                {
+                    light.dirty_faces |= 1u << face;
+                }
+            }
+        }
+    }
+
+    //lights without a usable shadow first, a light whose faces all have to change together only
+    //goes when all of them fit, everything else renders stale faces as far as the budget goes
+    m_draws.clear();
+    uint32_t budget = m_limits.faces_per_frame;
+    for(uint32_t pass = 0; pass < 2; ++pass)
+    {
+        for(const uint32_t i : order)
+        {
+            Light& light = m_lights[i];
+            const bool complete = !light.ready || light.moved;
+            if((light.tile_size == 0) || (light.dirty_faces == 0) || (complete != (pass == 0)))
+            {
+                continue;
+            }
+            if(complete && (CountBits(light.dirty_faces) > budget))
+            {
+                continue;
+            }
+
+            const glm::mat4 view = glm::translate(glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / light.radius)), -light.position);
+            for(uint32_t face = 0; (face < FACE_COUNT) && (budget > 0); ++face)
+            {
+                if((light.dirty_faces & (1u << face)) == 0)
+                {
+                    continue;
+                }
+                FaceDraw draw{};
+                draw.rect = vk::Rect2D({static_cast<int32_t>(light.tiles[face].x), static_cast<int32_t>(light.tiles[face].y)}, {light.tile_size, light.tile_size});
+                draw.view_projection = GetFaceViewProjection(light, face);
+                draw.view = view;
+                m_draws.push_back(draw);
+
+                light.gpu.faces[face] = draw.view_projection;
+                light.dirty_faces &= ~(1u << face);
+                --budget;
+            }
+            if(complete)
+            {
+                light.gpu.light = glm::vec4(light.position, light.radius);
+                light.ready = true;
+                light.moved = false;
+            }
+            light.gpu.ready = light.ready ? 1 : 0;
+            MarkDirty(i);
+        }
+    }
+
+    FrameData& frame = m_frames[frame_index];
+    for(uint32_t i = frame.dirty_begin; i < frame.dirty_end; ++i)
+    {
+        static_cast<GPUShadow*>(frame.shadows.mapped)[i] = m_lights[i].gpu;
+    }
+    frame.dirty_begin = UINT32_MAX;
+    frame.dirty_end = 0;
+}
+
+void ShadowAtlas::RecordDraw(const vk::CommandBuffer command_buffer, const GPUScene& scene)
+{
+    if(m_draws.empty())
+    {
+        return;
+    }
+    Assert(m_draws.size() <= (1u << DrawList::LAYER_BITS));
+
+    m_draw_list.Reset();
+    for(uint32_t face = 0; face < m_draws.size(); ++face)
+    {
+        scene.SubmitDepth(m_draw_list, 0, 0, face, m_pipeline, m_pipeline_layout, *m_draw_constants, m_draws[face].view_projection, m_draws[face].view);
+    }
+    m_draw_list.Sort();
+
+    //the render pass keeps the whole atlas, every face clears its own tile, with or without draws
+    std::vector<vk::ClearRect> clear_rects;
+    for(const auto& draw : m_draws)
+    {
+        clear_rects.emplace_back(draw.rect, 0, 1);
+    }
+    const vk::ClearAttachment clear(vk::ImageAspectFlagBits::eDepth, 0, vk::ClearDepthStencilValue(1.0f, 0));
+    command_buffer.clearAttachments(clear, clear_rects);
+
+    m_draw_list.Record
+    (
+        command_buffer,
+        *m_pipelines,
+        0,
+        [this, command_buffer](const uint32_t, const uint32_t face)
+        {
+            const vk::Rect2D& rect = m_draws[face].rect;
+            const vk::Viewport viewport
+            (
+                static_cast<float>(rect.offset.x),
+                static_cast<float>(rect.offset.y),
+                static_cast<float>(rect.extent.width),
+                static_cast<float>(rect.extent.height),
+                0.0f,
+                1.0f
+            );
+            command_buffer.setViewport(0, viewport);
+            command_buffer.setScissor(0, rect);
+        }
+    );
+}
+
+glm::mat4 ShadowAtlas::GetFaceViewProjection(const Light& light, const uint32_t face) const
+{
+    //+x, -x, +y, -y, +z, -z, any up works as long as Simple.frag picks faces by the major axis
+    static const glm::vec3 directions[FACE_COUNT] =
+    {
+        {1.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f}
+    };
+    static const glm::vec3 ups[FACE_COUNT] =
+    {
+        {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f, 0.0f}
+    };
+
+    glm::mat4 projection = glm::perspectiveRH_ZO(glm::radians(90.0f), 1.0f, light.radius * NEAR_PLANE, light.radius);
+    projection[1][1] *= -1.0f; //same winding as the main pass
+    return projection * glm::lookAt(light.position, light.position + directions[face], ups[face]);
+}
+
+void ShadowAtlas::Resize(Light& light, const uint32_t tile_size)
+{
+    if(light.tile_size > 0)
+    {
+        for(const auto& tile : light.tiles)
+        {
+            FreeTile(light.tile_size, tile);
+        }
+    }
+    light.tile_size = 0;
+
+    for(uint32_t size = tile_size; size >= MIN_TILE_SIZE; size /= 2)
+    {
+        uint32_t allocated = 0;
+        while((allocated < FACE_COUNT) && AllocateTile(size, light.tiles[allocated]))
+        {
+            ++allocated;
+        }
+        if(allocated == FACE_COUNT)
+        {
+            light.tile_size = size;
+            break;
+        }
+        while(allocated > 0)
+        {
+            --allocated;
+            FreeTile(size, light.tiles[allocated]);
+        }
+    }
+
+    //new tiles hold nothing of this light, no shadow until all of them are rendered
+    const float atlas_size = static_cast<float>(m_limits.atlas_size);
+    for(uint32_t face = 0; face < FACE_COUNT; ++face)
+    {
+        light.gpu.rects[face] = glm::vec4(glm::vec2(light.tiles[face]) / atlas_size, glm::vec2(static_cast<float>(light.tile_size) / atlas_size));
+    }
+    light.gpu.texel_scale = (light.tile_size > 0) ? 2.0f / static_cast<float>(light.tile_size) : 0.0f;
+    light.gpu.ready = 0;
+    light.ready = false;
+    light.dirty_faces = ALL_FACES;
+}
+
+bool ShadowAtlas::AllocateTile(const uint32_t size, glm::uvec2& tile)
+{
+    uint32_t level = 0;
+    while((m_limits.atlas_size >> level) > size)
+    {
+        ++level;
+    }
+    Assert(level < m_free_tiles.size());
+
+    uint32_t from = level;
+    while(m_free_tiles[from].empty())
+    {
+        if(from == 0)
+        {
+            return false;
+        }
+        --from;
+    }
+
+    //split down to the size asked for, the other three quarters of every split stay free
+    tile = m_free_tiles[from].back();
+    m_free_tiles[from].pop_back();
+    for(uint32_t split = from; split < level; ++split)
+    {
+        const uint32_t half = m_limits.atlas_size >> (split + 1);
+        m_free_tiles[split + 1].push_back(tile + glm::uvec2(half, 0));
+        m_free_tiles[split + 1].push_back(tile + glm::uvec2(0, half));
+        m_free_tiles[split + 1].push_back(tile + glm::uvec2(half, half));
+    }
+    return true;
+}
+
+void ShadowAtlas::FreeTile(const uint32_t size, const glm::uvec2& tile)
+{
+    uint32_t level = 0;
+    while((m_limits.atlas_size >> level) > size)
+    {
+        ++level;
+    }
+
+    //merges back into the parent while all four quarters are free
+    glm::uvec2 current = tile;
+    for(; level > 0; --level)
+    {
+        const uint32_t parent_size = m_limits.atlas_size >> (level - 1);
+        const glm::uvec2 parent = (current / parent_size) * parent_size;
+        auto& free_tiles = m_free_tiles[level];
+
+        std::vector<glm::uvec2>::iterator siblings[3];
+        uint32_t found = 0;
+        for(uint32_t quarter = 0; quarter < 4; ++quarter)
+        {
+            const glm::uvec2 sibling = parent + glm::uvec2(quarter & 1, quarter >> 1) * (parent_size / 2);
+            if(sibling == current)
+            {
+                continue;
+            }
+            const auto it = std::find(free_tiles.begin(), free_tiles.end(), sibling);
+            if(it == free_tiles.end())
+            {
+                break;
+            }
+            siblings[found++] = it;
+        }
+        if(found < 3)
+        {
+            break;
+        }
+
+        //back to front so the other iterators stay valid
+        std::sort(std::begin(siblings), std::end(siblings), [](const auto& a, const auto& b) { return a > b; });
+        for(const auto& it : siblings)
+        {
+            free_tiles.erase(it);
+        }
+        current = parent;
+    }
+    m_free_tiles[level].push_back(current);
+    ++m_free_generation;
+}
+
+void ShadowAtlas::Clear(const vk::Queue queue, const uint32_t queue_family) const
+{
+    //the far plane everywhere, before any frame can sample it
+    SubmitAndWait
+    (
+        m_device,
+        queue,
+        queue_family,
+        [this](const vk::CommandBuffer command_buffer)
+        {
+            const vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1);
+            const vk::ImageMemoryBarrier to_transfer
+            (
+                {},
+                vk::AccessFlagBits::eTransferWrite,
+                vk::ImageLayout::eUndefined,
+                vk::ImageLayout::eTransferDstOptimal,
+                VK_QUEUE_FAMILY_IGNORED,
+                VK_QUEUE_FAMILY_IGNORED,
+                m_image,
+                range
+            );
+            command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, to_transfer);
+
+            command_buffer.clearDepthStencilImage(m_image, vk::ImageLayout::eTransferDstOptimal, vk::ClearDepthStencilValue(1.0f, 0), range);
+
+            const vk::ImageMemoryBarrier to_read
+            (
+                vk::AccessFlagBits::eTransferWrite,
+                vk::AccessFlagBits::eShaderRead,
+                vk::ImageLayout::eTransferDstOptimal,
+                vk::ImageLayout::eShaderReadOnlyOptimal,
+                VK_QUEUE_FAMILY_IGNORED,
+                VK_QUEUE_FAMILY_IGNORED,
+                m_image,
+                range
+            );
+            command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, to_read);
+        }
+    );
+}
+
+void ShadowAtlas::MarkDirty(const uint32_t shadow)
+{
+    for(auto& frame : m_frames)
+    {
+        frame.dirty_begin = std::min(frame.dirty_begin, shadow);
+        frame.dirty_end = std::max(frame.dirty_end, shadow + 1);
+    }
+}
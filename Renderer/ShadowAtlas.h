@@ -0,0 +1,144 @@
+#pragma once
+
+#include "DrawList.h"
+#include "PipelineManager.h"
+#include "VKUtils.h"
+
+class DrawConstants;
+class GPUScene;
+
+//cached point light shadows: every shadowed light gets six square tiles of one depth atlas, a
+//cube face each, holding the distance to the light over its radius
+//tiles are kept from frame to frame and a face is only rendered again when it goes stale, the
+//light moved or an object moved through the face (GPUScene::TakeChangedBounds()), so a static
+//scene renders its shadows once and samples them from then on
+//tile sizes follow how large a light's range is on screen, powers of two carved out of the atlas
+//like a quadtree so every size packs without gaps, lights off screen drop to the smallest tile
+//and a light that doesn't fit at the size it wants settles for a smaller one
+//rendering is capped at a number of faces per frame, lights that have never been rendered at
+//their current tiles go first and stay unshadowed until all of their faces are done, stale
+//faces keep showing what they were last rendered with
+//a frame's faces go through one DrawList, a layer each, with every face's objects front to back
+
+class ShadowAtlas
+{
+public:
+    static constexpr uint32_t FACE_COUNT = 6;
+    static constexpr uint32_t MIN_TILE_SIZE = 64;
+    //D16 is the one depth format every device samples, plenty for distances normalized to the radius
+    static constexpr vk::Format FORMAT = vk::Format::eD16Unorm;
+
+    struct Limits
+    {
+        uint32_t atlas_size; //power of two
+        uint32_t max_tile_size; //power of two, at most atlas_size
+        uint32_t max_lights;
+        uint32_t faces_per_frame; //rendered at most
+    };
+
+    //queue is only used once to clear the atlas
+    void Init
+    (
+        const vk::PhysicalDevice physical_device,
+        const vk::Device device,
+        const vk::Queue queue,
+        const uint32_t queue_family,
+        const Limits& limits,
+        const uint32_t frames_in_flight
+    );
+    //needs the render pass from the compiled render graph, draw_constants carry
+    //GPUScene::DepthConstants and have to be started on every frame before RecordDraw()
+    void InitPipeline(PipelineManager& pipelines, const vk::RenderPass render_pass, const uint32_t subpass, DrawConstants& draw_constants);
+    void Shutdown();
+
+    //what ClusteredLighting::SetShadow() takes
+    uint32_t AddLight(const glm::vec3& position, const float radius);
+    void SetLight(const uint32_t shadow, const glm::vec3& position, const float radius);
+    //the camera, tile sizes are picked by how large each light looks through it
+    void SetViewProjection(const glm::mat4& view_projection) { m_view_projection = view_projection; }
+
+    //host side, before the frame is recorded, changed_bounds is GPUScene::TakeChangedBounds()
+    void Update(const uint32_t frame_index, const vk::Extent2D& extent, const std::vector<glm::vec4>& changed_bounds);
+    //render graph pass with the atlas as its depth attachment, renders the faces Update() picked
+    void RecordDraw(const vk::CommandBuffer command_buffer, const GPUScene& scene);
+
+    //between frames the atlas is in eShaderReadOnlyOptimal
+    vk::Image GetImage() const { return m_image; }
+    vk::ImageView GetView() const { return m_view; }
+    vk::Sampler GetSampler() const { return m_sampler; } //depth compare
+    vk::Extent2D GetExtent() const { return vk::Extent2D(m_limits.atlas_size, m_limits.atlas_size); }
+    //per light tiles and face matrices, set 1 binding 4 of the lit pipelines
+    vk::Buffer GetShadowBuffer(const uint32_t frame_index) const { return m_frames[frame_index].shadows.buffer; }
+    uint32_t GetRenderedFaceCount() const { return static_cast<uint32_t>(m_draws.size()); }
+
+private:
+    //std430, Simple.frag
+    struct GPUShadow
+    {
+        glm::mat4 faces[FACE_COUNT]; //world to the face's clip space, as it was last rendered
+        glm::vec4 rects[FACE_COUNT]; //atlas coordinates, offset in xy and size in zw
+        glm::vec4 light; //position and radius the faces were rendered with
+        float texel_scale; //world size of a texel at one unit from the light
+        uint32_t ready; //0 until every face has been rendered into the current tiles
+        float pad[2];
+    };
+    static_assert(sizeof(GPUShadow) == 512, "GPUShadow layout");
+
+    struct Light
+    {
+        glm::vec3 position{};
+        float radius = 0.0f;
+        uint32_t tile_size = 0; //0 without tiles
+        glm::uvec2 tiles[FACE_COUNT]{}; //texel offsets into the atlas
+        uint32_t dirty_faces = 0; //bit per face
+        bool ready = false;
+        bool moved = false; //faces rendered before don't match the new position
+        float importance = 0.0f; //screen size in pixels
+        uint64_t failed_generation = UINT64_MAX; //tiles were freed since the last failed growth if it differs
+        GPUShadow gpu{};
+    };
+
+    struct FrameData
+    {
+        BufferAllocation shadows{};
+        //lights written since this frame's buffer was last updated
+        uint32_t dirty_begin = UINT32_MAX;
+        uint32_t dirty_end = 0;
+    };
+
+    struct FaceDraw
+    {
+        vk::Rect2D rect; //the face's tile
+        glm::mat4 view_projection;
+        glm::mat4 view; //light space scaled by the radius
+    };
+
+    glm::mat4 GetFaceViewProjection(const Light& light, const uint32_t face) const;
+    //frees the light's tiles and takes six new ones of the largest size up to tile_size that fits
+    void Resize(Light& light, const uint32_t tile_size);
+    bool AllocateTile(const uint32_t size, glm::uvec2& tile);
+    void FreeTile(const uint32_t size, const glm::uvec2& tile);
+    void Clear(const vk::Queue queue, const uint32_t queue_family) const;
+    void MarkDirty(const uint32_t shadow);
+
+    vk::Device m_device{};
+    Limits m_limits{};
+
+    vk::Image m_image{};
+    vk::DeviceMemory m_memory{};
+    vk::ImageView m_view{};
+    vk::Sampler m_sampler{};
+    std::vector<FrameData> m_frames{};
+
+    std::vector<Light> m_lights{};
+    std::vector<std::vector<glm::uvec2>> m_free_tiles{}; //per tile size, index 0 is the whole atlas
+    uint64_t m_free_generation = 0;
+    std::vector<FaceDraw> m_draws{}; //this frame's
+    glm::mat4 m_view_projection{1.0f};
+
+    PipelineManager* m_pipelines = nullptr;
+    PipelineManager::Handle m_pipeline = PipelineManager::INVALID_HANDLE;
+    vk::PipelineLayout m_pipeline_layout{};
+    DrawConstants* m_draw_constants = nullptr;
+    DrawList m_draw_list{};
+};
@@ -0,0 +1,434 @@
+#include "stdafx.h"
+#include "TextureStreamer.h"
+#include "UploadQueue.h"
+
+static const vk::Format TEXTURE_FORMAT = vk::Format::eR8G8B8A8Unorm;
+static const uint32_t TEXEL_SIZE = 4;
+
+void TextureStreamer::Init
+(
+    const vk::PhysicalDevice physical_device,
+    const vk::Device device,
+    UploadQueue& upload_queue,
+    BindlessHeap* bindless_heap,
+    const Limits& limits,
+    const uint32_t frames_in_flight
+)
+{
+    Assert(physical_device);
+    Assert(device);
+    Assert(frames_in_flight > 0);
+
+    m_physical_device = physical_device;
+    m_device = device;
+    m_upload_queue = &upload_queue;
+    m_bindless_heap = bindless_heap;
+    m_limits = limits;
+
+    const vk::SamplerCreateInfo sampler_info
+    (
+        {},
+        vk::Filter::eLinear,
+        vk::Filter::eLinear,
+        vk::SamplerMipmapMode::eLinear,
+        vk::SamplerAddressMode::eRepeat,
+        vk::SamplerAddressMode::eRepeat,
+        vk::SamplerAddressMode::eRepeat,
+        0.0f,
+        VK_FALSE,
+        1.0f,
+        VK_FALSE,
+        vk::CompareOp::eNever,
+        0.0f,
+        VK_LOD_CLAMP_NONE
+    );
+    m_sampler = Get(m_device.createSampler(sampler_info));
+
+    if(m_bindless_heap)
+    {
+        m_sampler_handle = m_bindless_heap->AddSampler(m_sampler);
+
+        const vk::MemoryPropertyFlags host_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+        const vk::DeviceSize table_size = sizeof(uint32_t) * (1 + m_limits.max_textures);
+        m_tables.resize(frames_in_flight);
+        for(auto& table : m_tables)
+        {
+            table = CreateBuffer(m_physical_device, m_device, table_size, vk::BufferUsageFlagBits::eStorageBuffer, host_flags);
+            uint32_t* slots = static_cast<uint32_t*>(table.mapped);
+            slots[0] = m_sampler_handle.index;
+            std::fill(slots + 1, slots + 1 + m_limits.max_textures, NO_SLOT);
+        }
+    }
+
+    m_textures.reserve(m_limits.max_textures);
+    m_retired.resize(frames_in_flight);
+}
+
+void TextureStreamer::Shutdown()
+{
+    if(!m_device)
+    {
+        return;
+    }
+
+    //the device is idle, nothing can still be sampling or uploading
+    for(auto& retired : m_retired)
+    {
+        for(auto& residency : retired)
+        {
+            Destroy(residency);
+        }
+    }
+    m_retired.clear();
+
+    for(auto& texture : m_textures)
+    {
+        if(m_bindless_heap && m_bindless_heap->IsValid(texture.handle))
+        {
+            m_bindless_heap->Remove(texture.handle);
+        }
+        Destroy(texture.pending);
+        Destroy(texture.resident);
+    }
+    m_textures.clear();
+    Assert(m_allocated_bytes == 0);
+
+    for(auto& table : m_tables)
+    {
+        DestroyBuffer(m_device, table);
+    }
+    m_tables.clear();
+    if(m_bindless_heap && m_bindless_heap->IsValid(m_sampler_handle))
+    {
+        m_bindless_heap->Remove(m_sampler_handle);
+    }
+    m_device.destroySampler(m_sampler);
+
+    m_upload_queue = nullptr;
+    m_bindless_heap = nullptr;
+    m_device = vk::Device();
+}
+
+uint32_t TextureStreamer::AddTexture(const uint32_t width, const uint32_t height, std::vector<uint8_t>&& mip_chain)
+{
+    Assert((width > 0) && (height > 0));
+    Assert(m_textures.size() < m_limits.max_textures);
+
+    Texture texture;
+    texture.width = width;
+    texture.height = height;
+    texture.mip_count = 1;
+    while((std::max(width, height) >> texture.mip_count) > 0)
+    {
+        ++texture.mip_count;
+    }
+
+    vk::DeviceSize offset = 0;
+    //a texture no larger than the tail is all tail
+    for(uint32_t mip = 0; mip < texture.mip_count; ++mip)
+    {
+        const uint32_t mip_width = std::max(width >> mip, 1u);
+        const uint32_t mip_height = std::max(height >> mip, 1u);
+        if((texture.tail_mip == 0) && (mip > 0) && (std::max(mip_width, mip_height) <= TAIL_SIZE))
+        {
+            texture.tail_mip = mip;
+        }
+        texture.mip_offsets.push_back(offset);
+        offset += vk::DeviceSize(mip_width) * mip_height * TEXEL_SIZE;
+    }
+    texture.mip_offsets.push_back(offset);
+    Assert(mip_chain.size() == offset);
+    texture.mip_chain = std::move(mip_chain);
+
+    //nothing is resident until the tail has landed
+    texture.resident.first_mip = texture.mip_count;
+    texture.wanted_mip = texture.tail_mip;
+
+    m_textures.push_back(std::move(texture));
+    StartLoad(m_textures.back(), m_textures.back().tail_mip);
+
+    return static_cast<uint32_t>(m_textures.size() - 1);
+}
+
+std::vector<uint8_t> TextureStreamer::BuildMipChain(const uint32_t width, const uint32_t height, const uint8_t* pixels)
+{
+    Assert((width > 0) && (height > 0));
+    Assert(pixels);
+
+    std::vector<uint8_t> mip_chain(pixels, pixels + size_t(width) * height * TEXEL_SIZE);
+    size_t source = 0;
+    uint32_t source_width = width;
+    uint32_t source_height = height;
+    while((source_width > 1) || (source_height > 1))
+    {
+        const uint32_t mip_width = std::max(source_width >> 1, 1u);
+        const uint32_t mip_height = std::max(source_height >> 1, 1u);
+        const size_t destination = mip_chain.size();
+        mip_chain.resize(destination + size_t(mip_width) * mip_height * TEXEL_SIZE);
+
+        //2x2 box, the last row or column of an odd sized mip is repeated
+        for(uint32_t y = 0; y < mip_height; ++y)
+        {
+            const uint32_t y0 = std::min(y * 2, source_height - 1);
+            const uint32_t y1 = std::min(y * 2 + 1, source_height - 1);
+            for(uint32_t x = 0; x < mip_width; ++x)
+            {
+                const uint32_t x0 = std::min(x * 2, source_width - 1);
+                const uint32_t x1 = std::min(x * 2 + 1, source_width - 1);
+                for(uint32_t c = 0; c < TEXEL_SIZE; ++c)
+                {
+                    const uint32_t sum =
+                        mip_chain[source + (size_t(y0) * source_width + x0) * TEXEL_SIZE + c]
+                        + mip_chain[source + (size_t(y0) * source_width + x1) * TEXEL_SIZE + c]
+                        + mip_chain[source + (size_t(y1) * source_width + x0) * TEXEL_SIZE + c]
+                        + mip_chain[source + (size_t(y1) * source_width + x1) * TEXEL_SIZE + c];
+                    mip_chain[destination + (size_t(y) * mip_width + x) * TEXEL_SIZE + c] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+
+        source = destination;
+        source_width = mip_width;
+        source_height = mip_height;
+    }
+    return mip_chain;
+}
+
+void TextureStreamer::Update(const uint32_t frame_index, const std::vector<uint32_t>& feedback)
+{
+    m_frame_index = frame_index;
+    ++m_frame;
+    m_frame_upload_bytes = 0;
+
+    //the last frame that could sample these has completed
+    for(auto& residency : m_retired[m_frame_index])
+    {
+        Destroy(residency);
+    }
+    m_retired[m_frame_index].clear();
+
+    std::vector<uint32_t> loads;
+    for(uint32_t t = 0; t < m_textures.size(); ++t)
+    {
+        Texture& texture = m_textures[t];
+
+        //swapped in for every command buffer recorded from now on, frames in flight keep the old image
+        if(texture.pending.image && m_upload_queue->IsComplete(texture.pending_upload))
+        {
+            if(m_bindless_heap && m_bindless_heap->IsValid(texture.handle))
+            {
+                m_bindless_heap->Remove(texture.handle);
+            }
+            Retire(texture.resident);
+            texture.resident = texture.pending;
+            texture.pending = Residency();
+            if(m_bindless_heap)
+            {
+                texture.handle = m_bindless_heap->AddImage(texture.resident.view, vk::ImageLayout::eShaderReadOnlyOptimal);
+            }
+        }
+
+        //the smallest mip that still has a texel per pixel, unseen textures only need their tail
+        const uint32_t pixels = (t < feedback.size()) ? feedback[t] : 0;
+        if(pixels > 0)
+        {
+            const uint32_t size = std::max(texture.width, texture.height);
+            uint32_t mip = 0;
+            while((mip < texture.tail_mip) && ((size >> (mip + 1)) >= pixels))
+            {
+                ++mip;
+            }
+            texture.wanted_mip = mip;
+            texture.last_seen = m_frame;
+        }
+        else
+        {
+            texture.wanted_mip = texture.tail_mip;
+        }
+
+        if(!texture.pending.image && (texture.wanted_mip < texture.resident.first_mip))
+        {
+            loads.push_back(t);
+        }
+    }
+
+    //loads started below only swap in on a later frame, this frame's slots are final here
+    if(!m_tables.empty())
+    {
+        uint32_t* slots = static_cast<uint32_t*>(m_tables[m_frame_index].mapped) + 1;
+        for(uint32_t t = 0; t < m_textures.size(); ++t)
+        {
+            const BindlessHeap::Handle handle = m_textures[t].handle;
+            slots[t] = m_bindless_heap->IsValid(handle) ? handle.index : NO_SLOT;
+        }
+    }
+
+    //furthest from what they need first, then the ones seen most recently
+    std::sort
+    (
+        loads.begin(),
+        loads.end(),
+        [this](const uint32_t a, const uint32_t b)
+        {
+            const Texture& ta = m_textures[a];
+            const Texture& tb = m_textures[b];
+            const uint32_t missing_a = ta.resident.first_mip - ta.wanted_mip;
+            const uint32_t missing_b = tb.resident.first_mip - tb.wanted_mip;
+            return (missing_a != missing_b) ? (missing_a > missing_b) : (ta.last_seen > tb.last_seen);
+        }
+    );
+
+    for(const uint32_t t : loads)
+    {
+        Texture& texture = m_textures[t];
+        const vk::DeviceSize bytes = texture.mip_offsets.back() - texture.mip_offsets[texture.wanted_mip];
+        if((m_frame_upload_bytes > 0) && (m_frame_upload_bytes + bytes > m_limits.upload_bytes_per_frame))
+        {
+            break;
+        }
+
+        if(m_allocated_bytes + bytes <= m_limits.budget)
+        {
+            StartLoad(texture, texture.wanted_mip);
+            continue;
+        }
+
+        //over budget, textures holding more than they need drop back, least recently seen first
+        //their smaller images are allocated before the old ones go, the budget is briefly exceeded
+        std::vector<uint32_t> victims;
+        for(uint32_t v = 0; v < m_textures.size(); ++v)
+        {
+            const Texture& victim = m_textures[v];
+            if(!victim.pending.image && victim.resident.image && (victim.resident.first_mip < victim.wanted_mip))
+            {
+                victims.push_back(v);
+            }
+        }
+        std::sort(victims.begin(), victims.end(), [this](const uint32_t a, const uint32_t b) { return m_textures[a].last_seen < m_textures[b].last_seen; });
+
+        vk::DeviceSize freed = 0;
+        for(const uint32_t v : victims)
+        {
+            if(m_allocated_bytes + bytes <= m_limits.budget + freed)
+            {
+                break;
+            }
+            Texture& victim = m_textures[v];
+            const vk::DeviceSize victim_bytes = victim.resident.bytes;
+            StartLoad(victim, victim.wanted_mip);
+            freed += victim_bytes - std::min(victim.pending.bytes, victim_bytes);
+        }
+
+        //memory comes back once the evicted images are retired, this load waits for a later frame
+        break;
+    }
+}
+
+TextureStreamer::Residency TextureStreamer::CreateResidency(const Texture& texture, const uint32_t first_mip)
+{
+    Assert(first_mip < texture.mip_count);
+
+    Residency residency;
+    residency.first_mip = first_mip;
+
+    const uint32_t mip_count = texture.mip_count - first_mip;
+    const vk::ImageCreateInfo image_info
+    (
+        {},
+        vk::ImageType::e2D,
+        TEXTURE_FORMAT,
+        {std::max(texture.width >> first_mip, 1u), std::max(texture.height >> first_mip, 1u), 1},
+        mip_count,
+        1,
+        vk::SampleCountFlagBits::e1,
+        vk::ImageTiling::eOptimal,
+        vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+        vk::SharingMode::eExclusive,
+        0,
+        nullptr,
+        vk::ImageLayout::eUndefined
+    );
+    residency.image = Get(m_device.createImage(image_info));
+
+    const auto& mem_reqs = m_device.getImageMemoryRequirements(residency.image);
+    const uint32_t memory_type_index = FindMemoryTypeIndex(m_physical_device.getMemoryProperties(), mem_reqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    Assert(memory_type_index != UINT32_MAX);
+    residency.memory = Get(m_device.allocateMemory(vk::MemoryAllocateInfo(mem_reqs.size, memory_type_index)));
+    Assert(m_device.bindImageMemory(residency.image, residency.memory, 0) == vk::Result::eSuccess);
+    residency.bytes = mem_reqs.size;
+    m_allocated_bytes += residency.bytes;
+
+    const vk::ImageViewCreateInfo view_info
+    (
+        {},
+        residency.image,
+        vk::ImageViewType::e2D,
+        TEXTURE_FORMAT,
+        vk::ComponentMapping(),
+        vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, mip_count, 0, 1)
+    );
+    residency.view = Get(m_device.createImageView(view_info));
+
+    return residency;
+}
+
+uint64_t TextureStreamer::Upload(const Texture& texture, const Residency& residency)
+{
+    //a copy per mip, each one only transitions its own mip and takes its own slice of the staging ring
+    uint64_t upload = 0;
+    for(uint32_t mip = residency.first_mip; mip < texture.mip_count; ++mip)
+    {
+        const uint32_t level = mip - residency.first_mip;
+        const vk::BufferImageCopy region
+        (
+            0,
+            0,
+            0,
+            vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level, 0, 1),
+            {0, 0, 0},
+            {std::max(texture.width >> mip, 1u), std::max(texture.height >> mip, 1u), 1}
+        );
+        upload = m_upload_queue->UploadImage
+        (
+            residency.image,
+            vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, level, 1, 0, 1),
+            {region},
+            texture.mip_chain.data() + texture.mip_offsets[mip],
+            texture.mip_offsets[mip + 1] - texture.mip_offsets[mip],
+            vk::ImageLayout::eShaderReadOnlyOptimal
+        );
+    }
+    return upload;
+}
+
+void TextureStreamer::StartLoad(Texture& texture, const uint32_t first_mip)
+{
+    Assert(!texture.pending.image);
+
+    texture.pending = CreateResidency(texture, first_mip);
+    texture.pending_upload = Upload(texture, texture.pending);
+    m_frame_upload_bytes += texture.mip_offsets.back() - texture.mip_offsets[first_mip];
+}
+
+void TextureStreamer::Retire(Residency& residency)
+{
+    if(residency.image)
+    {
+        m_retired[m_frame_index].push_back(residency);
+    }
+    residency = Residency();
+}
+
+void TextureStreamer::Destroy(Residency& residency)
+{
+    if(!residency.image)
+    {
+        return;
+    }
+
+    m_device.destroyImageView(residency.view);
+    m_device.destroyImage(residency.image);
+    m_device.freeMemory(residency.memory);
+    m_allocated_bytes -= residency.bytes;
+    residency = Residency();
+}
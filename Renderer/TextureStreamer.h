@@ -0,0 +1,118 @@
+#pragma once
+
+#include "BindlessHeap.h"
+#include "VKUtils.h"
+
+class UploadQueue;
+
+//streamed textures: every texture keeps its whole mip chain in system memory and only the mips
+//it needs on the GPU, starting out with the small mips of its tail
+//the mip a texture needs comes from GPUScene's feedback, the largest screen size it was drawn at,
+//more detailed mips are loaded in order of how far a texture is from what it needs and, when
+//the memory budget is used up, textures nobody has looked at for longest drop back to what they need
+//a texture's mips live in one image starting at its most detailed resident mip, changing the
+//residency uploads a new image in the background and swaps it in once the copy has landed,
+//normalized coordinates don't change so shaders can't tell, the old image is freed once the
+//frames that could still sample it are done
+//with a bindless heap every swap moves the texture to a new heap slot, shaders find it through
+//the per frame texture table, see GetTextureTable()
+
+class TextureStreamer
+{
+public:
+    //mips this size and smaller are never evicted
+    static constexpr uint32_t TAIL_SIZE = 64;
+    //texture table entry of a texture with nothing resident yet, same as GPUScene::NO_TEXTURE
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    struct Limits
+    {
+        uint32_t max_textures;
+        vk::DeviceSize budget; //bytes of image memory, tails included
+        vk::DeviceSize upload_bytes_per_frame; //a single mip may go over it
+    };
+
+    //bindless_heap may be null, textures are then only reachable through GetView()
+    void Init
+    (
+        const vk::PhysicalDevice physical_device,
+        const vk::Device device,
+        UploadQueue& upload_queue,
+        BindlessHeap* bindless_heap,
+        const Limits& limits,
+        const uint32_t frames_in_flight
+    );
+    void Shutdown();
+
+    //RGBA8, every mip down to 1x1 packed one after the other, see BuildMipChain()
+    uint32_t AddTexture(const uint32_t width, const uint32_t height, std::vector<uint8_t>&& mip_chain);
+    //box filtered mip chain of an RGBA8 image, in the layout AddTexture() takes
+    static std::vector<uint8_t> BuildMipChain(const uint32_t width, const uint32_t height, const uint8_t* pixels);
+
+    //frame_index's previous submission must have completed, feedback is GPUScene::GetTextureFeedback()
+    void Update(const uint32_t frame_index, const std::vector<uint32_t>& feedback);
+
+    //both change when the residency does, look them up every frame
+    vk::ImageView GetView(const uint32_t texture) const { return m_textures[texture].resident.view; }
+    BindlessHeap::Handle GetHandle(const uint32_t texture) const { return m_textures[texture].handle; }
+    //bindless heap only, written by Update(): the sampler's heap slot, then the image slot of every
+    //texture or NO_SLOT, for max_textures textures
+    vk::Buffer GetTextureTable(const uint32_t frame_index) const { return m_tables[frame_index].buffer; }
+    //most detailed mip on the GPU, the mip count until the tail has landed
+    uint32_t GetResidentMip(const uint32_t texture) const { return m_textures[texture].resident.first_mip; }
+    vk::Sampler GetSampler() const { return m_sampler; }
+    uint32_t GetTextureCount() const { return static_cast<uint32_t>(m_textures.size()); }
+    vk::DeviceSize GetAllocatedBytes() const { return m_allocated_bytes; }
+
+private:
+    //mips first_mip and below of a texture
+    struct Residency
+    {
+        vk::Image image{};
+        vk::DeviceMemory memory{};
+        vk::ImageView view{};
+        vk::DeviceSize bytes = 0;
+        uint32_t first_mip = 0;
+    };
+
+    struct Texture
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t mip_count = 0;
+        uint32_t tail_mip = 0; //first mip no larger than TAIL_SIZE
+        std::vector<uint8_t> mip_chain{};
+        std::vector<vk::DeviceSize> mip_offsets{}; //into mip_chain, one past the last mip at the end
+
+        Residency resident{};
+        Residency pending{}; //being uploaded, no image if there is nothing in flight
+        uint64_t pending_upload = 0;
+        BindlessHeap::Handle handle{};
+
+        uint32_t wanted_mip = 0;
+        uint64_t last_seen = 0; //frame the feedback last had it on screen
+    };
+
+    Residency CreateResidency(const Texture& texture, const uint32_t first_mip);
+    //uploads the mips of a new residency, returns the upload queue value of the last copy
+    uint64_t Upload(const Texture& texture, const Residency& residency);
+    void StartLoad(Texture& texture, const uint32_t first_mip);
+    void Retire(Residency& residency);
+    void Destroy(Residency& residency);
+
+    vk::PhysicalDevice m_physical_device{};
+    vk::Device m_device{};
+    UploadQueue* m_upload_queue = nullptr;
+    BindlessHeap* m_bindless_heap = nullptr;
+    Limits m_limits{};
+
+    vk::Sampler m_sampler{};
+    BindlessHeap::Handle m_sampler_handle{};
+    std::vector<BufferAllocation> m_tables{}; //per frame in flight, bindless heap only
+    std::vector<Texture> m_textures{};
+    std::vector<std::vector<Residency>> m_retired{}; //per frame in flight
+    uint32_t m_frame_index = 0;
+    uint64_t m_frame = 0;
+    vk::DeviceSize m_allocated_bytes = 0; //resident, pending and retired
+    vk::DeviceSize m_frame_upload_bytes = 0;
+};
@@ -0,0 +1,310 @@
+#include "stdafx.h"
+#include "UploadQueue.h"
+
+void UploadQueue::Init
+(
+    const vk::PhysicalDevice physical_device,
+    const vk::Device device,
+    const vk::Queue transfer_queue,
+    const uint32_t transfer_family,
+    const uint32_t graphics_family,
+    const vk::DeviceSize ring_size
+)
+{
+    Assert(physical_device);
+    Assert(device);
+    Assert(transfer_queue);
+
+    m_device = device;
+    m_queue = transfer_queue;
+    m_transfer_family = transfer_family;
+    m_graphics_family = graphics_family;
+
+    const vk::CommandPoolCreateInfo command_pool_info(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, m_transfer_family);
+    m_command_pool = Get(m_device.createCommandPool(command_pool_info));
+
+    const vk::SemaphoreTypeCreateInfo semaphore_type_info(vk::SemaphoreType::eTimeline, 0);
+    vk::SemaphoreCreateInfo semaphore_info;
+    semaphore_info.pNext = &semaphore_type_info;
+    m_semaphore = Get(m_device.createSemaphore(semaphore_info));
+
+    //image copies need offsets that are a multiple of the texel block size and of 4
+    m_ring_alignment = std::max<vk::DeviceSize>(physical_device.getProperties().limits.optimalBufferCopyOffsetAlignment, 16);
+    m_ring_size = ring_size;
+    m_ring = CreateBuffer
+    (
+        physical_device,
+        m_device,
+        m_ring_size,
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+    );
+}
+
+void UploadQueue::Shutdown()
+{
+    if(!m_device)
+    {
+        return;
+    }
+
+    Flush();
+    if(m_submitted_value > 0)
+    {
+        const vk::SemaphoreWaitInfo wait_info({}, 1, &m_semaphore, &m_submitted_value);
+        Assert(m_device.waitSemaphores(wait_info, UINT64_MAX) == vk::Result::eSuccess);
+    }
+
+    DestroyBuffer(m_device, m_ring);
+    m_device.destroySemaphore(m_semaphore);
+    m_device.destroyCommandPool(m_command_pool); //frees every command buffer
+
+    m_in_flight.clear();
+    m_acquires.clear();
+    m_free_command_buffers.clear();
+    m_recording = Batch();
+    m_releases = Acquire();
+    m_ready = Acquire();
+    m_device = vk::Device();
+}
+
+uint64_t UploadQueue::UploadBuffer(const vk::Buffer buffer, const vk::DeviceSize offset, const void* data, const vk::DeviceSize size)
+{
+    Assert(buffer);
+    Assert(data && (size > 0));
+
+    const vk::DeviceSize staging_offset = AllocateStaging(size);
+    memcpy(static_cast<uint8_t*>(m_ring.mapped) + staging_offset, data, static_cast<size_t>(size));
+
+    const vk::CommandBuffer command_buffer = GetCommandBuffer();
+    command_buffer.copyBuffer(m_ring.buffer, buffer, vk::BufferCopy(staging_offset, offset, size));
+
+    m_releases.buffers.emplace_back
+    (
+        vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlags(),
+        m_transfer_family,
+        m_graphics_family,
+        buffer,
+        offset,
+        size
+    );
+
+    return m_submitted_value + 1;
+}
+
+uint64_t UploadQueue::UploadImage
+(
+    const vk::Image image,
+    const vk::ImageSubresourceRange& range,
+    const std::vector<vk::BufferImageCopy>& regions,
+    const void* data,
+    const vk::DeviceSize size,
+    const vk::ImageLayout final_layout
+)
+{
+    Assert(image);
+    Assert(!regions.empty());
+    Assert(data && (size > 0));
+
+    const vk::DeviceSize staging_offset = AllocateStaging(size);
+    memcpy(static_cast<uint8_t*>(m_ring.mapped) + staging_offset, data, static_cast<size_t>(size));
+
+    std::vector<vk::BufferImageCopy> staged_regions = regions;
+    for(auto& region : staged_regions)
+    {
+        region.bufferOffset += staging_offset;
+    }
+
+    const vk::CommandBuffer command_buffer = GetCommandBuffer();
+
+    const vk::ImageMemoryBarrier to_transfer
+    (
+        vk::AccessFlags(),
+        vk::AccessFlagBits::eTransferWrite,
+        vk::ImageLayout::eUndefined,
+        vk::ImageLayout::eTransferDstOptimal,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        image,
+        range
+    );
+    command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, to_transfer);
+    command_buffer.copyBufferToImage(m_ring.buffer, image, vk::ImageLayout::eTransferDstOptimal, staged_regions);
+
+    //the release also does the transition to the final layout, the acquire has to repeat it
+    m_releases.images.emplace_back
+    (
+        vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlags(),
+        vk::ImageLayout::eTransferDstOptimal,
+        final_layout,
+        m_transfer_family,
+        m_graphics_family,
+        image,
+        range
+    );
+
+    return m_submitted_value + 1;
+}
+
+void UploadQueue::Flush()
+{
+    if(!m_recording.command_buffer)
+    {
+        return;
+    }
+
+    const vk::CommandBuffer command_buffer = m_recording.command_buffer;
+
+    if(OwnershipTransfer())
+    {
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, m_releases.buffers, m_releases.images);
+    }
+    else
+    {
+        //same family, a plain barrier makes the copies and layout changes visible, the semaphore orders the rest
+        for(auto& barrier : m_releases.buffers)
+        {
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+        }
+        for(auto& barrier : m_releases.images)
+        {
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+        }
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, m_releases.buffers, m_releases.images);
+        m_releases.buffers.clear();
+        m_releases.images.clear();
+    }
+    Assert(command_buffer.end() == vk::Result::eSuccess);
+
+    m_recording.value = ++m_submitted_value;
+
+    const vk::TimelineSemaphoreSubmitInfo timeline_info(0, nullptr, 1, &m_recording.value);
+    vk::SubmitInfo submit_info(0, nullptr, nullptr, 1, &command_buffer, 1, &m_semaphore);
+    submit_info.pNext = &timeline_info;
+    Assert(m_queue.submit(1, &submit_info, vk::Fence()) == vk::Result::eSuccess);
+
+    //acquires mirror the releases: same layouts and families, access on the graphics side
+    m_releases.value = m_recording.value;
+    for(auto& barrier : m_releases.buffers)
+    {
+        barrier.srcAccessMask = vk::AccessFlags();
+        barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+    }
+    for(auto& barrier : m_releases.images)
+    {
+        barrier.srcAccessMask = vk::AccessFlags();
+        barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+    }
+    m_acquires.push_back(std::move(m_releases));
+    m_releases = Acquire();
+
+    m_in_flight.push_back(m_recording);
+    m_recording = Batch();
+}
+
+uint64_t UploadQueue::PrepareAcquire()
+{
+    const uint64_t completed = Get(m_device.getSemaphoreCounterValue(m_semaphore));
+    Reclaim(completed);
+
+    while(!m_acquires.empty() && (m_acquires.front().value <= completed))
+    {
+        Acquire& acquire = m_acquires.front();
+        m_ready.buffers.insert(m_ready.buffers.end(), acquire.buffers.begin(), acquire.buffers.end());
+        m_ready.images.insert(m_ready.images.end(), acquire.images.begin(), acquire.images.end());
+        m_acquired_value = acquire.value;
+        m_acquires.pop_front();
+    }
+
+    return m_acquired_value;
+}
+
+void UploadQueue::RecordAcquire(const vk::CommandBuffer command_buffer)
+{
+    if(!m_ready.buffers.empty() || !m_ready.images.empty())
+    {
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, m_ready.buffers, m_ready.images);
+    }
+    m_ready = Acquire();
+}
+
+vk::DeviceSize UploadQueue::AllocateStaging(const vk::DeviceSize size)
+{
+    Assert(size <= m_ring_size);
+
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize bytes = 0;
+    for(;;)
+    {
+        //nothing staged, start at the front rather than skip a tail that a large allocation can't fit behind
+        if(m_ring_used == 0)
+        {
+            m_ring_head = 0;
+        }
+
+        offset = AlignUp(m_ring_head, m_ring_alignment);
+        if(offset + size > m_ring_size)
+        {
+            offset = 0; //the rest of the ring is skipped and freed along with this allocation
+        }
+        bytes = (offset >= m_ring_head ? offset - m_ring_head : m_ring_size - m_ring_head) + size;
+        if(m_ring_used + bytes <= m_ring_size)
+        {
+            break;
+        }
+
+        //ring full, wait for the oldest batch, submitting the current one first if it is all there is
+        if(m_in_flight.empty())
+        {
+            Flush();
+        }
+        Assert(!m_in_flight.empty());
+
+        const uint64_t oldest = m_in_flight.front().value;
+        const vk::SemaphoreWaitInfo wait_info({}, 1, &m_semaphore, &oldest);
+        Assert(m_device.waitSemaphores(wait_info, UINT64_MAX) == vk::Result::eSuccess);
+        Reclaim(oldest);
+    }
+
+    m_ring_used += bytes;
+    m_ring_head = offset + size;
+    m_recording.ring_bytes += bytes;
+
+    return offset;
+}
+
+vk::CommandBuffer UploadQueue::GetCommandBuffer()
+{
+    if(!m_recording.command_buffer)
+    {
+        if(m_free_command_buffers.empty())
+        {
+            const vk::CommandBufferAllocateInfo allocate_info(m_command_pool, vk::CommandBufferLevel::ePrimary, 1);
+            m_free_command_buffers.push_back(Get(m_device.allocateCommandBuffers(allocate_info))[0]);
+        }
+        m_recording.command_buffer = m_free_command_buffers.back();
+        m_free_command_buffers.pop_back();
+
+        Assert(m_recording.command_buffer.reset({}) == vk::Result::eSuccess);
+        const vk::CommandBufferBeginInfo begin_info(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+        Assert(m_recording.command_buffer.begin(begin_info) == vk::Result::eSuccess);
+    }
+    return m_recording.command_buffer;
+}
+
+void UploadQueue::Reclaim(const uint64_t completed)
+{
+    //batches finish in submission order, their staging space is freed in the same order
+    while(!m_in_flight.empty() && (m_in_flight.front().value <= completed))
+    {
+        m_ring_used -= m_in_flight.front().ring_bytes;
+        m_free_command_buffers.push_back(m_in_flight.front().command_buffer);
+        m_in_flight.pop_front();
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "VKUtils.h"
+
+#include <deque>
+
+//asynchronous uploads on the transfer queue
+//data is copied into a persistently mapped staging ring, copies are batched into one submission
+//per Flush() and every submission signals the next value of a timeline semaphore
+//when the transfer family differs from the graphics family the batch releases ownership of its
+//destinations and RecordAcquire() acquires them on the graphics side once the copy has finished,
+//so the graphics queue never waits on a transfer still in progress
+
+class UploadQueue
+{
+public:
+    void Init
+    (
+        const vk::PhysicalDevice physical_device,
+        const vk::Device device,
+        const vk::Queue transfer_queue,
+        const uint32_t transfer_family,
+        const uint32_t graphics_family,
+        const vk::DeviceSize ring_size
+    );
+    void Shutdown();
+
+    //both return the timeline value that marks the copy as done
+    uint64_t UploadBuffer(const vk::Buffer buffer, const vk::DeviceSize offset, const void* data, const vk::DeviceSize size);
+    //the whole image goes from undefined to final_layout
+    uint64_t UploadImage
+    (
+        const vk::Image image,
+        const vk::ImageSubresourceRange& range,
+        const std::vector<vk::BufferImageCopy>& regions,
+        const void* data,
+        const vk::DeviceSize size,
+        const vk::ImageLayout final_layout
+    );
+
+    //submits every copy recorded since the last flush
+    void Flush();
+
+    //picks up the transfers that have finished, the graphics submission that records their
+    //acquire has to wait on GetSemaphore() for the returned value
+    uint64_t PrepareAcquire();
+    //records the graphics side of what PrepareAcquire() picked up
+    void RecordAcquire(const vk::CommandBuffer command_buffer);
+
+    //true once the upload is done and usable by command buffers recorded from now on
+    bool IsComplete(const uint64_t value) const { return value <= m_acquired_value; }
+    vk::Semaphore GetSemaphore() const { return m_semaphore; }
+
+private:
+    struct Batch
+    {
+        vk::CommandBuffer command_buffer{};
+        uint64_t value = 0;
+        vk::DeviceSize ring_bytes = 0;
+    };
+
+    struct Acquire
+    {
+        uint64_t value = 0;
+        std::vector<vk::BufferMemoryBarrier> buffers{};
+        std::vector<vk::ImageMemoryBarrier> images{};
+    };
+
+    vk::DeviceSize AllocateStaging(const vk::DeviceSize size);
+    vk::CommandBuffer GetCommandBuffer();
+    void Reclaim(const uint64_t completed);
+    bool OwnershipTransfer() const { return m_transfer_family != m_graphics_family; }
+
+    vk::Device m_device{};
+    vk::Queue m_queue{};
+    uint32_t m_transfer_family = UINT32_MAX;
+    uint32_t m_graphics_family = UINT32_MAX;
+    vk::CommandPool m_command_pool{};
+    vk::Semaphore m_semaphore{};
+
+    BufferAllocation m_ring{};
+    vk::DeviceSize m_ring_size = 0;
+    vk::DeviceSize m_ring_alignment = 0;
+    vk::DeviceSize m_ring_head = 0;
+    vk::DeviceSize m_ring_used = 0;
+
+    //batch being recorded
+    Batch m_recording{};
+    Acquire m_releases{};
+
+    std::deque<Batch> m_in_flight{};
+    std::deque<Acquire> m_acquires{};
+    Acquire m_ready{};
+    std::vector<vk::CommandBuffer> m_free_command_buffers{};
+    uint64_t m_submitted_value = 0;
+    uint64_t m_acquired_value = 0;
+};
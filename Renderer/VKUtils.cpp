@@ -0,0 +1,128 @@
+#include "stdafx.h"
+#include "VKUtils.h"
+
+#include <limits>
+#include <fstream>
+
+//the dispatch table behind every vk:: call, filled in by the framework
+VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
+
+BufferAllocation CreateBuffer
+(
+    const vk::PhysicalDevice physical_device,
+    const vk::Device device,
+    const vk::DeviceSize size,
+    const vk::BufferUsageFlags usage,
+    const vk::MemoryPropertyFlags mem_flags,
+    const std::vector<uint32_t>& queue_families
+)
+{
+    Assert(physical_device);
+    Assert(device);
+
+    BufferAllocation ret;
+
+    std::vector<uint32_t> families = queue_families;
+    std::sort(families.begin(), families.end());
+    families.erase(std::unique(families.begin(), families.end()), families.end());
+    const bool shared = families.size() > 1;
+
+    const vk::BufferCreateInfo buffer_info
+    (
+        {},
+        size,
+        usage,
+        shared ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+        shared ? static_cast<uint32_t>(families.size()) : 0,
+        shared ? families.data() : nullptr
+    );
+    ret.buffer = Get(device.createBuffer(buffer_info));
+
+    const auto& mem_reqs = device.getBufferMemoryRequirements(ret.buffer);
+    const auto& mem_properties = physical_device.getMemoryProperties();
+
+    const uint32_t memory_type_index = FindMemoryTypeIndex(mem_properties, mem_reqs.memoryTypeBits, mem_flags);
+    Assert(memory_type_index != UINT32_MAX);
+
+    const vk::MemoryAllocateInfo alloc_info(mem_reqs.size, memory_type_index);
+    ret.memory = Get(device.allocateMemory(alloc_info));
+    Assert(device.bindBufferMemory(ret.buffer, ret.memory, 0) == vk::Result::eSuccess);
+
+    if(mem_flags & vk::MemoryPropertyFlagBits::eHostVisible)
+    {
+        ret.mapped = Get(device.mapMemory(ret.memory, 0, VK_WHOLE_SIZE, {}));
+    }
+
+    return ret;
+}
+
+void DestroyBuffer(const vk::Device device, BufferAllocation& allocation)
+{
+    if(allocation.mapped)
+    {
+        device.unmapMemory(allocation.memory);
+    }
+    device.destroyBuffer(allocation.buffer);
+    device.freeMemory(allocation.memory);
+    allocation = BufferAllocation();
+}
+
+void SubmitAndWait(const vk::Device device, const vk::Queue queue, const uint32_t queue_family, const std::function<void(vk::CommandBuffer)>& record)
+{
+    Assert(device);
+    Assert(queue);
+
+    const vk::CommandPool command_pool = Get(device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient, queue_family)));
+    const auto& command_buffers = Get(device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(command_pool, vk::CommandBufferLevel::ePrimary, 1)));
+    const vk::CommandBuffer command_buffer = command_buffers[0];
+
+    Assert(command_buffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit)) == vk::Result::eSuccess);
+    record(command_buffer);
+    Assert(command_buffer.end() == vk::Result::eSuccess);
+
+    const vk::SemaphoreTypeCreateInfo semaphore_type_info(vk::SemaphoreType::eTimeline, 0);
+    vk::SemaphoreCreateInfo semaphore_info;
+    semaphore_info.pNext = &semaphore_type_info;
+    const vk::Semaphore semaphore = Get(device.createSemaphore(semaphore_info));
+
+    const uint64_t done_value = 1;
+    const vk::TimelineSemaphoreSubmitInfo timeline_info(0, nullptr, 1, &done_value);
+    vk::SubmitInfo submit_info(0, nullptr, nullptr, 1, &command_buffer, 1, &semaphore);
+    submit_info.pNext = &timeline_info;
+    Assert(queue.submit(1, &submit_info, vk::Fence()) == vk::Result::eSuccess);
+    const vk::SemaphoreWaitInfo wait_info({}, 1, &semaphore, &done_value);
+    Assert(device.waitSemaphores(wait_info, UINT64_MAX) == vk::Result::eSuccess);
+
+    device.destroySemaphore(semaphore);
+    device.destroyCommandPool(command_pool);
+}
+
+vk::ShaderModule LoadShaderModule(const vk::Device device, const std::string& filename)
+{
+    Assert(device);
+
+    std::ifstream file(filename, std::ifstream::in | std::ifstream::binary);
+    Assert(file);
+
+    file.seekg(0, std::ios::end);
+    std::streamsize size = file.tellg();
+
+    Assert
+    (
+        (size > 0)
+        && ((size % sizeof(uint32_t)) == 0)
+        && ((size / sizeof(uint32_t)) <= std::numeric_limits<uint32_t>::max())
+    );
+    std::vector<uint32_t> bytecode(static_cast<size_t>(size / sizeof(uint32_t)));
+
+    file.seekg(std::ios::beg);
+    file.read(reinterpret_cast<char*>(&bytecode[0]), size);
+
+    const vk::ShaderModuleCreateInfo shader_module_create_info
+    (
+        {},
+        bytecode.size() * sizeof(uint32_t),
+        &bytecode[0]
+    );
+    return Get(device.createShaderModule(shader_module_create_info));
+}
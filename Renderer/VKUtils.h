@@ -0,0 +1,75 @@
+#pragma once
+
+//small helpers shared by the renderer's Vulkan code
+
+template<typename T>
+T Get(vk::ResultValue<T>&& res)
+{
+    Assert(res.result == vk::Result::eSuccess);
+    return res.value;
+}
+
+//returns UINT32_MAX if no memory type accepted by memory_type_bits has all of mem_flags
+inline uint32_t FindMemoryTypeIndex(const vk::PhysicalDeviceMemoryProperties& mem_properties, const uint32_t memory_type_bits, const vk::MemoryPropertyFlags mem_flags)
+{
+    for(uint32_t memory_type_index = 0; memory_type_index < mem_properties.memoryTypeCount; ++memory_type_index)
+    {
+        if
+        (
+            ((mem_properties.memoryTypes[memory_type_index].propertyFlags & mem_flags) == mem_flags) //has type flag
+            && ((memory_type_bits >> memory_type_index) & 1) //mem_reqs accepts that index
+        )
+        {
+            return memory_type_index;
+        }
+    }
+    return UINT32_MAX;
+}
+
+inline vk::ImageAspectFlags GetImageAspect(const vk::Format format)
+{
+    switch(format)
+    {
+        case vk::Format::eD16Unorm:
+        case vk::Format::eX8D24UnormPack32:
+        case vk::Format::eD32Sfloat:
+            return vk::ImageAspectFlagBits::eDepth;
+        case vk::Format::eD16UnormS8Uint:
+        case vk::Format::eD24UnormS8Uint:
+        case vk::Format::eD32SfloatS8Uint:
+            return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+        case vk::Format::eS8Uint:
+            return vk::ImageAspectFlagBits::eStencil;
+        default:
+            return vk::ImageAspectFlagBits::eColor;
+    }
+}
+
+struct BufferAllocation
+{
+    vk::Buffer buffer{};
+    vk::DeviceMemory memory{};
+    void* mapped = nullptr; //host visible memory stays mapped for the buffer's lifetime
+};
+
+//more than one distinct queue family makes the buffer concurrent, for buffers async compute shares with graphics
+BufferAllocation CreateBuffer
+(
+    const vk::PhysicalDevice physical_device,
+    const vk::Device device,
+    const vk::DeviceSize size,
+    const vk::BufferUsageFlags usage,
+    const vk::MemoryPropertyFlags mem_flags,
+    const std::vector<uint32_t>& queue_families = {}
+);
+void DestroyBuffer(const vk::Device device, BufferAllocation& allocation);
+
+vk::ShaderModule LoadShaderModule(const vk::Device device, const std::string& filename);
+
+//records a one time command buffer, submits it to queue and waits for it, setup work only
+void SubmitAndWait(const vk::Device device, const vk::Queue queue, const uint32_t queue_family, const std::function<void(vk::CommandBuffer)>& record);
+
+inline vk::DeviceSize AlignUp(const vk::DeviceSize value, const vk::DeviceSize alignment)
+{
+    return ((value + alignment - 1) / alignment) * alignment;
+}
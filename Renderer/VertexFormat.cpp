@@ -0,0 +1,80 @@
+#include "stdafx.h"
+#include "VertexFormat.h"
+
+static const float UNORM16_MAX = 65535.0f;
+
+//unit vector onto the octahedron, the lower half folded over the upper one, [-1, 1]^2
+static glm::vec2 EncodeOctahedral(const glm::vec3& v)
+{
+    const float length = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+    if(length <= 0.0f)
+    {
+        return glm::vec2(0.0f);
+    }
+
+    const glm::vec3 n = v / length;
+    if(n.z >= 0.0f)
+    {
+        return glm::vec2(n);
+    }
+    return glm::vec2
+    (
+        (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+        (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f)
+    );
+}
+
+PackedVertices PackVertices(const std::vector<SourceVertex>& vertices)
+{
+    PackedVertices packed;
+    if(vertices.empty())
+    {
+        return packed;
+    }
+
+    glm::vec3 min_position(vertices[0].position);
+    glm::vec3 max_position(vertices[0].position);
+    for(const auto& vertex : vertices)
+    {
+        min_position = glm::min(min_position, glm::vec3(vertex.position));
+        max_position = glm::max(max_position, glm::vec3(vertex.position));
+    }
+    packed.quantization.offset = min_position;
+    packed.quantization.scale = max_position - min_position;
+
+    //a flat axis has a scale of 0, everything on it quantizes to 0
+    const glm::vec3& scale = packed.quantization.scale;
+    const glm::vec3 inverse_scale
+    (
+        scale.x > 0.0f ? 1.0f / scale.x : 0.0f,
+        scale.y > 0.0f ? 1.0f / scale.y : 0.0f,
+        scale.z > 0.0f ? 1.0f / scale.z : 0.0f
+    );
+
+    packed.vertices.resize(vertices.size());
+    for(size_t v = 0; v < vertices.size(); ++v)
+    {
+        const SourceVertex& source = vertices[v];
+        PackedVertex& vertex = packed.vertices[v];
+
+        const glm::vec3 position = glm::clamp((glm::vec3(source.position) - min_position) * inverse_scale, 0.0f, 1.0f);
+        const float handedness = (source.tangent.w < 0.0f) ? 0.0f : 1.0f;
+        vertex.position_xy = glm::packUnorm2x16(glm::vec2(position.x, position.y));
+        vertex.position_zw = glm::packUnorm2x16(glm::vec2(position.z, handedness));
+
+        const glm::vec2 normal = EncodeOctahedral(source.normal);
+        const glm::vec2 tangent = EncodeOctahedral(glm::vec3(source.tangent));
+        vertex.normal_tangent = glm::packSnorm4x8(glm::vec4(normal, tangent));
+
+        vertex.uv = glm::packHalf2x16(source.uv);
+        vertex.colour = glm::packUnorm4x8(source.colour);
+    }
+    return packed;
+}
+
+glm::vec3 UnpackPosition(const PackedVertex& vertex, const VertexQuantization& quantization)
+{
+    const glm::vec2 xy = glm::unpackUnorm2x16(vertex.position_xy);
+    const float z = static_cast<float>(vertex.position_zw & 0xFFFF) / UNORM16_MAX;
+    return quantization.offset + quantization.scale * glm::vec3(xy, z);
+}
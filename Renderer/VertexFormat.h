@@ -0,0 +1,47 @@
+#pragma once
+
+//compressed vertices: what the GPU scene stores and its vertex shaders read, 20 bytes in place of
+//the 64 of an authored vertex, so vertex fetch bandwidth and the vertex buffer shrink to a third
+//- positions are 16 bit UNORM inside the mesh's bounding box, VertexQuantization maps them back
+//- normal and tangent are octahedral, two 8 bit SNORM each, the tangent's handedness is position w
+//- texture coordinates are half floats
+//- colours are RGBA8 UNORM
+//packing is meant for asset tools, meshes added as SourceVertex are packed at load time
+
+struct SourceVertex
+{
+    glm::vec4 position; //w is ignored
+    glm::vec4 colour;
+    glm::vec3 normal{0.0f, 0.0f, 1.0f};
+    glm::vec4 tangent{1.0f, 0.0f, 0.0f, 1.0f}; //w is the bitangent's handedness, +-1
+    glm::vec2 uv{0.0f};
+};
+
+//32 bit words, storage buffer reads see the same layout as vertex input
+struct PackedVertex
+{
+    uint32_t position_xy; //R16G16B16A16_UNORM together with position_zw, x in the low half
+    uint32_t position_zw; //w is 0 for a -1 tangent handedness, 1 for +1
+    uint32_t normal_tangent; //R8G8B8A8_SNORM, octahedral normal xy then tangent xy
+    uint32_t uv; //R16G16_SFLOAT
+    uint32_t colour; //R8G8B8A8_UNORM
+};
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex layout");
+
+//object space position = offset + scale * UNORM position
+struct VertexQuantization
+{
+    glm::vec3 offset;
+    glm::vec3 scale;
+};
+
+struct PackedVertices
+{
+    std::vector<PackedVertex> vertices{};
+    VertexQuantization quantization{};
+};
+
+//positions are quantized over the bounding box of all of them
+PackedVertices PackVertices(const std::vector<SourceVertex>& vertices);
+//object space, what the vertex shaders see
+glm::vec3 UnpackPosition(const PackedVertex& vertex, const VertexQuantization& quantization);
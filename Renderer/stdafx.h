@@ -1,8 +1,15 @@
 #pragma once
 
 #include <Base/Globals.h>
-#include <Base/WindowsInclude.h>
+
+//headless builds run without the windowing code, e.g. on a Linux CI box
+#ifdef _WIN32
+#  include <Base/WindowsInclude.h>
+#  define VK_USE_PLATFORM_WIN32_KHR
+#endif
 
 #define VULKAN_HPP_NO_EXCEPTIONS
-#define VK_USE_PLATFORM_WIN32_KHR
+//nothing links against the loader, vk:: calls go through function pointers fetched at runtime,
+//device calls straight to the driver without the loader's trampolines, see SetupVKInstance()
+#define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 #include <vulkan/vulkan.hpp>
@@ -0,0 +1,95 @@
+#version 450
+//feature switches, see ShaderFeatures.h
+layout(constant_id = 1) const bool OBJECT_COLOUR = false;
+
+struct Object
+{
+	mat4 transform;
+	vec4 sphere;
+	uint mesh;
+	uint colour; //RGBA8 tint
+	uint texture;
+};
+
+struct Mesh
+{
+	uint index_count;
+	uint first_index;
+	int vertex_offset;
+	uint first_meshlet;
+	vec4 sphere;
+	vec3 position_offset; //dequantization, see VertexFormat.h
+	uint meshlet_count;
+	vec3 position_scale;
+};
+
+layout(std430, binding = 0) readonly buffer Objects
+{
+	Object objects[];
+};
+
+//object indices grouped by batch, written by the cull pass
+layout(std430, binding = 1) readonly buffer Instances
+{
+	uint instances[];
+};
+
+layout(std430, binding = 2) readonly buffer Meshes
+{
+	Mesh meshes[];
+};
+
+layout(push_constant) uniform Constants
+{
+	mat4 view_projection;
+} constants;
+
+//PackedVertex, see VertexFormat.h
+layout(location = 0) in vec4 position; //quantized, w is the tangent's handedness
+layout(location = 1) in vec4 colour;
+layout(location = 2) in vec4 normal_tangent; //octahedral
+layout(location = 3) in vec2 uv;
+
+layout(location = 0) out vec4 out_colour;
+layout(location = 1) out vec3 out_position; //world space
+//for materials that need them, Simple.frag lights with face normals
+layout(location = 2) out vec3 out_normal; //world space
+layout(location = 3) out vec4 out_tangent; //world space, w is the handedness
+layout(location = 4) out vec2 out_uv;
+layout(location = 5) flat out uint out_texture;
+
+//octahedral unit vector, see VertexFormat.cpp
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if(v.z < 0.0)
+	{
+		v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(v);
+}
+
+void main()
+{
+	//gl_InstanceIndex starts at the batch's firstInstance
+	const uint object = instances[gl_InstanceIndex];
+	const Mesh mesh = meshes[objects[object].mesh];
+	const mat4 transform = objects[object].transform;
+	const vec4 world_position = transform * vec4(mesh.position_offset + mesh.position_scale * position.xyz, 1.0);
+	gl_Position = constants.view_projection * world_position;
+	out_position = world_position.xyz;
+
+	const mat3 normal_transform = transpose(inverse(mat3(transform)));
+	out_normal = normalize(normal_transform * DecodeOctahedral(normal_tangent.xy));
+	out_tangent = vec4(normalize(mat3(transform) * DecodeOctahedral(normal_tangent.zw)), position.w * 2.0 - 1.0);
+	out_texture = objects[object].texture;
+	out_uv = uv;
+
+	out_colour = colour * unpackUnorm4x8(objects[object].colour);
+	if(OBJECT_COLOUR)
+	{
+		//hashed object index, neighbours get very different colours
+		const uint hash = object * 2654435761u;
+		out_colour = vec4(vec3((hash >> 8) & 255u, (hash >> 16) & 255u, (hash >> 24) & 255u) / 255.0, 1.0);
+	}
+}
@@ -0,0 +1,127 @@
+#version 450
+//feature switches, see ShaderFeatures.h
+layout(constant_id = 1) const bool OBJECT_COLOUR = false;
+
+const uint VERTEX_BITS = 6; //see ClusterCull.comp
+
+struct Object
+{
+	mat4 transform;
+	vec4 sphere;
+	uint mesh;
+	uint colour; //RGBA8 tint
+	uint texture;
+};
+
+struct Meshlet
+{
+	vec4 sphere;
+	vec4 cone;
+	uint vertex_offset;
+	uint triangle_offset;
+	uint vertex_count;
+	uint triangle_count;
+};
+
+struct Mesh
+{
+	uint index_count;
+	uint first_index;
+	int vertex_offset;
+	uint first_meshlet;
+	vec4 sphere;
+	vec3 position_offset; //dequantization, see VertexFormat.h
+	uint meshlet_count;
+	vec3 position_scale;
+};
+
+layout(std430, binding = 0) readonly buffer Objects
+{
+	Object objects[];
+};
+
+//object and meshlet, written by the cluster cull pass
+layout(std430, binding = 1) readonly buffer VisibleMeshlets
+{
+	uvec2 visible_meshlets[];
+};
+
+layout(std430, binding = 2) readonly buffer Meshlets
+{
+	Meshlet meshlets[];
+};
+
+//the mesh vertex of every meshlet vertex, relative to the mesh's vertex_offset
+layout(std430, binding = 3) readonly buffer MeshletVertices
+{
+	uint meshlet_vertices[];
+};
+
+//PackedVertex, see VertexFormat.h
+const uint VERTEX_WORDS = 5;
+
+layout(std430, binding = 4) readonly buffer Vertices
+{
+	uint vertex_words[];
+};
+
+layout(std430, binding = 5) readonly buffer Meshes
+{
+	Mesh meshes[];
+};
+
+layout(push_constant) uniform Constants
+{
+	mat4 view_projection;
+} constants;
+
+layout(location = 0) out vec4 out_colour;
+layout(location = 1) out vec3 out_position; //world space
+//for materials that need them, Simple.frag lights with face normals
+layout(location = 2) out vec3 out_normal; //world space
+layout(location = 3) out vec4 out_tangent; //world space, w is the handedness
+layout(location = 4) out vec2 out_uv;
+layout(location = 5) flat out uint out_texture;
+
+//octahedral unit vector, see VertexFormat.cpp
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if(v.z < 0.0)
+	{
+		v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(v);
+}
+
+void main()
+{
+	//no vertex buffer, the index says which visible meshlet and which of its vertices
+	const uint index = uint(gl_VertexIndex);
+	const uvec2 visible_meshlet = visible_meshlets[index >> VERTEX_BITS];
+	const uint object = visible_meshlet.x;
+	const Mesh mesh = meshes[objects[object].mesh];
+	const uint vertex = uint(mesh.vertex_offset) + meshlet_vertices[meshlets[visible_meshlet.y].vertex_offset + (index & ((1u << VERTEX_BITS) - 1u))];
+	const uint first_word = vertex * VERTEX_WORDS;
+	const vec4 position = vec4(unpackUnorm2x16(vertex_words[first_word]), unpackUnorm2x16(vertex_words[first_word + 1]));
+	const vec4 normal_tangent = unpackSnorm4x8(vertex_words[first_word + 2]);
+
+	const mat4 transform = objects[object].transform;
+	const vec4 world_position = transform * vec4(mesh.position_offset + mesh.position_scale * position.xyz, 1.0);
+	gl_Position = constants.view_projection * world_position;
+	out_position = world_position.xyz;
+
+	const mat3 normal_transform = transpose(inverse(mat3(transform)));
+	out_normal = normalize(normal_transform * DecodeOctahedral(normal_tangent.xy));
+	out_tangent = vec4(normalize(mat3(transform) * DecodeOctahedral(normal_tangent.zw)), position.w * 2.0 - 1.0);
+	out_texture = objects[object].texture;
+	out_uv = unpackHalf2x16(vertex_words[first_word + 3]);
+
+	out_colour = unpackUnorm4x8(vertex_words[first_word + 4]) * unpackUnorm4x8(objects[object].colour);
+	if(OBJECT_COLOUR)
+	{
+		//hashed object index, neighbours get very different colours
+		const uint hash = object * 2654435761u;
+		out_colour = vec4(vec3((hash >> 8) & 255u, (hash >> 16) & 255u, (hash >> 24) & 255u) / 255.0, 1.0);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#version 450
+//distance to the light over its radius instead of the projection's depth, every face stores the
+//same linear value so Simple.frag compares against one reference whichever face it lands on
+layout(location = 0) in vec3 in_view_position;
+
+void main()
+{
+	gl_FragDepth = clamp(length(in_view_position), 0.0, 1.0);
+}
\ No newline at end of file
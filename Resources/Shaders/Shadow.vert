@@ -0,0 +1,19 @@
+#version 450
+//one cube face of a point light, see ShadowAtlas.h
+layout(push_constant) uniform Constants
+{
+	mat4 clip;
+	mat4 view; //light space scaled by the radius
+} constants;
+
+//quantized, DepthConstants dequantize it, w isn't a position
+layout(location = 0) in vec4 quantized_position;
+
+layout(location = 0) out vec3 out_view_position;
+
+void main()
+{
+	const vec4 position = vec4(quantized_position.xyz, 1.0);
+	gl_Position = constants.clip * position;
+	out_view_position = (constants.view * position).xyz;
+}
\ No newline at end of file
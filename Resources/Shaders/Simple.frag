@@ -1,8 +1,171 @@
-#version 400
-in vec4 out_colour;
-out vec4 colour;
+#version 450
+//built twice, with BINDLESS objects sample their texture from the bindless heap, see BindlessHeap.h
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+//feature switches, see ShaderFeatures.h
+layout(constant_id = 0) const bool LINEAR_TO_SRGB = false;
+layout(constant_id = 2) const bool CLUSTERED_LIGHTING = false;
+
+//must match ClusterLights.comp
+const uvec3 CLUSTER_GRID = uvec3(16, 9, 24);
+const uint MAX_LIGHTS_PER_CLUSTER = 128;
+const vec3 AMBIENT = vec3(0.05);
+//must match ClusteredLighting.h and ShadowAtlas.h
+const uint NO_SHADOW = 0xFFFFFFFF;
+const uint FACE_COUNT = 6;
+//must match GPUScene.h
+const uint NO_TEXTURE = 0xFFFFFFFF;
+
+struct Light
+{
+	vec4 position; //world space, w is the radius
+	vec3 colour;
+	uint shadow;
+};
+
+struct Shadow
+{
+	mat4 faces[FACE_COUNT];
+	vec4 rects[FACE_COUNT]; //atlas coordinates, offset in xy and size in zw
+	vec4 light; //position and radius the faces were rendered with
+	float texel_scale;
+	uint ready;
+};
+
+struct Cluster
+{
+	uint light_count;
+	uint lights[MAX_LIGHTS_PER_CLUSTER];
+};
+
+layout(std140, set = 1, binding = 0) uniform Params
+{
+	mat4 view;
+	mat4 inverse_projection;
+	vec4 camera_position;
+	vec2 screen_size;
+	float near_plane;
+	float far_plane;
+	uint light_count;
+} params;
+
+layout(std430, set = 1, binding = 1) readonly buffer Lights
+{
+	Light lights[];
+};
+
+layout(std430, set = 1, binding = 2) readonly buffer Clusters
+{
+	Cluster clusters[];
+};
+
+layout(set = 1, binding = 3) uniform sampler2DShadow shadow_atlas;
+
+layout(std430, set = 1, binding = 4) readonly buffer Shadows
+{
+	Shadow shadows[];
+};
+
+#ifdef BINDLESS
+//the sampler's heap slot, then the heap slot of every texture id, see TextureStreamer.h
+layout(std430, set = 0, binding = 6) readonly buffer TextureTable
+{
+	uint sampler_slot;
+	uint image_slots[];
+} texture_table;
+
+layout(set = 2, binding = 0) uniform texture2D images[];
+layout(set = 2, binding = 2) uniform sampler samplers[];
+#endif
+
+layout(location = 0) in vec4 in_colour;
+layout(location = 1) in vec3 in_position; //world space
+layout(location = 4) in vec2 in_uv;
+layout(location = 5) flat in uint in_texture;
+layout(location = 0) out vec4 colour;
+
+//3x3 taps of the face the fragment is on, kept inside the face's tile
+float Visibility(uint index, vec3 normal)
+{
+	Shadow shadow = shadows[index];
+	if(shadow.ready == 0)
+	{
+		return 1.0;
+	}
+
+	vec3 from_light = in_position - shadow.light.xyz;
+	float light_distance = length(from_light);
+	vec3 axis = abs(from_light);
+	uint face = axis.x >= max(axis.y, axis.z) ? (from_light.x >= 0.0 ? 0 : 1) : (axis.y >= axis.z ? (from_light.y >= 0.0 ? 2 : 3) : (from_light.z >= 0.0 ? 4 : 5));
+
+	//texels grow with the distance, so does the offset along the normal
+	vec3 offset_position = in_position + normal * (shadow.texel_scale * light_distance);
+	vec4 clip = shadow.faces[face] * vec4(offset_position, 1.0);
+	vec4 rect = shadow.rects[face];
+	vec2 texel = 1.0 / vec2(textureSize(shadow_atlas, 0));
+	vec2 uv = rect.xy + (clip.xy / clip.w * 0.5 + 0.5) * rect.zw;
+	float reference = (light_distance - 1.5 * shadow.texel_scale * light_distance) / shadow.light.w;
+
+	float visibility = 0.0;
+	for(int y = -1; y <= 1; ++y)
+	{
+		for(int x = -1; x <= 1; ++x)
+		{
+			vec2 tap = clamp(uv + vec2(x, y) * texel, rect.xy + 0.5 * texel, rect.xy + rect.zw - 0.5 * texel);
+			visibility += texture(shadow_atlas, vec3(tap, reference));
+		}
+	}
+	return visibility / 9.0;
+}
+
+vec3 Lighting(vec3 albedo)
+{
+	//no vertex normals, the face normal turned towards the camera
+	vec3 to_camera = params.camera_position.xyz - in_position;
+	vec3 normal = normalize(cross(dFdx(in_position), dFdy(in_position)));
+	normal = dot(normal, to_camera) < 0.0 ? -normal : normal;
+
+	float depth = -(params.view * vec4(in_position, 1.0)).z;
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / params.screen_size * vec2(CLUSTER_GRID.xy)), CLUSTER_GRID.xy - 1);
+	float slice = log(max(depth, params.near_plane) / params.near_plane) / log(params.far_plane / params.near_plane) * float(CLUSTER_GRID.z);
+	uint cluster = (min(uint(slice), CLUSTER_GRID.z - 1) * CLUSTER_GRID.y + tile.y) * CLUSTER_GRID.x + tile.x;
+
+	vec3 light = AMBIENT;
+	uint light_count = clusters[cluster].light_count;
+	for(uint i = 0; i < light_count; ++i)
+	{
+		Light current = lights[clusters[cluster].lights[i]];
+		vec3 to_light = current.position.xyz - in_position;
+		float light_distance = length(to_light);
+		float falloff = clamp(1.0 - light_distance / current.position.w, 0.0, 1.0);
+		float lit = falloff * falloff * max(dot(normal, to_light / max(light_distance, 1e-4)), 0.0);
+		if((lit > 0.0) && (current.shadow != NO_SHADOW))
+		{
+			lit *= Visibility(current.shadow, normal);
+		}
+		light += current.colour * lit;
+	}
+	return albedo * light;
+}
 
 void main()
 {
-	colour = out_colour;
+	colour = in_colour;
+#ifdef BINDLESS
+	//textures still loading their first mips are drawn untextured
+	uint image = (in_texture != NO_TEXTURE) ? texture_table.image_slots[in_texture] : NO_TEXTURE;
+	if(image != NO_TEXTURE)
+	{
+		colour *= texture(sampler2D(images[nonuniformEXT(image)], samplers[texture_table.sampler_slot]), in_uv);
+	}
+#endif
+	if(CLUSTERED_LIGHTING)
+	{
+		colour.rgb = Lighting(colour.rgb);
+	}
+	if(LINEAR_TO_SRGB)
+	{
+		colour.rgb = mix(colour.rgb * 12.92, 1.055 * pow(colour.rgb, vec3(1.0 / 2.4)) - 0.055, greaterThan(colour.rgb, vec3(0.0031308)));
+	}
 }
\ No newline at end of file
@@ -0,0 +1,40 @@
+#version 450
+//bilinear from the rendered part of the scene image, sharpened against the blur of the upscale
+layout(set = 0, binding = 0) uniform sampler2D scene;
+
+layout(push_constant) uniform Constants
+{
+	vec2 uv_scale; //rendered part of the scene image
+	vec2 texel_size;
+	float sharpness;
+} constants;
+
+layout(location = 0) in vec2 in_uv;
+layout(location = 0) out vec4 colour;
+
+//never filters in texels outside what was rendered this frame
+vec3 Fetch(vec2 uv)
+{
+	return texture(scene, clamp(uv, 0.5 * constants.texel_size, constants.uv_scale - 0.5 * constants.texel_size)).rgb;
+}
+
+void main()
+{
+	vec2 uv = in_uv * constants.uv_scale;
+	vec3 centre = Fetch(uv);
+	if(constants.sharpness <= 0.0)
+	{
+		colour = vec4(centre, 1.0);
+		return;
+	}
+
+	//unsharp mask over the four neighbours, kept within their range so edges don't ring
+	vec3 up = Fetch(uv - vec2(0.0, constants.texel_size.y));
+	vec3 down = Fetch(uv + vec2(0.0, constants.texel_size.y));
+	vec3 left = Fetch(uv - vec2(constants.texel_size.x, 0.0));
+	vec3 right = Fetch(uv + vec2(constants.texel_size.x, 0.0));
+	vec3 low = min(centre, min(min(up, down), min(left, right)));
+	vec3 high = max(centre, max(max(up, down), max(left, right)));
+	vec3 sharpened = centre + constants.sharpness * (4.0 * centre - up - down - left - right);
+	colour = vec4(clamp(sharpened, low, high), 1.0);
+}
\ No newline at end of file
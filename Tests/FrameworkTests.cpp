@@ -1,13 +1,25 @@
 #include "stdafx.h"
 
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+#include "Base/Profiler.h"
+//the renderer's internals see Vulkan the way the renderer does
+#include "Renderer/stdafx.h"
+#include "Renderer/RadixSort.h"
+#include "Renderer/RangeAllocator.h"
+#include "Renderer/ShaderPermutations.h"
 #include "Renderer/RendererFramework.h"
 #include <WindowFramework/WindowFramework.h>
 
 TEST_CASE("Start up and shutdown", "[framework]")
 {
+    const StartupConf conf{};
+
     auto&& window_framework = WindowFramework::Create();
     REQUIRE(window_framework);
-    auto&& renderer_framework = RendererFramework::Create(*window_framework.get());
+    auto&& renderer_framework = RendererFramework::Create(*window_framework.get(), conf);
     REQUIRE(renderer_framework);
 
     REQUIRE_NOTHROW(window_framework->Init());
@@ -16,3 +28,180 @@ TEST_CASE("Start up and shutdown", "[framework]")
     REQUIRE_NOTHROW(renderer_framework->Shutdown());
     REQUIRE_NOTHROW(window_framework->Shutdown());
 }
+
+TEST_CASE("Profiler keeps the newest events in order", "[profiler]")
+{
+    Profiler& profiler = Profiler::Instance();
+    profiler.Clear();
+
+    const size_t count = Profiler::MAX_EVENTS + 10;
+    for(size_t i = 0; i < count; ++i)
+    {
+        profiler.AddEvent({"Event", Profiler::Track::CPU, 0, static_cast<double>(i), static_cast<double>(i)});
+    }
+
+    const auto events = profiler.GetEvents();
+    REQUIRE(events.size() == Profiler::MAX_EVENTS);
+    REQUIRE(events.front().begin_ns == static_cast<double>(count - Profiler::MAX_EVENTS));
+    REQUIRE(events.back().begin_ns == static_cast<double>(count - 1));
+
+    profiler.Clear();
+}
+
+TEST_CASE("RangeAllocator takes the first free range that fits", "[range_allocator]")
+{
+    RangeAllocator allocator;
+    allocator.Init(100);
+    REQUIRE(allocator.Allocate(10) == 0);
+    REQUIRE(allocator.Allocate(20) == 10);
+    REQUIRE(allocator.Allocate(30) == 30);
+
+    //a hole of 10 at the front and 70 from 30 on, 20 only fit the second one
+    allocator.Free(0, 10);
+    allocator.Free(30, 30);
+    REQUIRE(allocator.Allocate(20) == 30);
+    REQUIRE(allocator.Allocate(10) == 0);
+
+    //50 free in one range, more than that doesn't fit anywhere
+    REQUIRE(allocator.GetFreeCount() == 50);
+    REQUIRE(allocator.Allocate(60) == RangeAllocator::INVALID_OFFSET);
+    REQUIRE(allocator.Allocate(50) == 50);
+    REQUIRE(allocator.GetFreeCount() == 0);
+    REQUIRE(allocator.Allocate(1) == RangeAllocator::INVALID_OFFSET);
+}
+
+TEST_CASE("RangeAllocator merges freed ranges with their neighbours", "[range_allocator]")
+{
+    RangeAllocator allocator;
+    allocator.Init(64);
+    for(uint32_t i = 0; i < 4; ++i)
+    {
+        REQUIRE(allocator.Allocate(16) == i * 16);
+    }
+    REQUIRE(allocator.IsCompact());
+
+    allocator.Free(16, 16);
+    REQUIRE_FALSE(allocator.IsCompact());
+    allocator.Free(48, 16);
+    REQUIRE_FALSE(allocator.IsCompact());
+    REQUIRE(allocator.Allocate(32) == RangeAllocator::INVALID_OFFSET);
+
+    //joins the ranges on both sides into one that runs to the end
+    allocator.Free(32, 16);
+    REQUIRE(allocator.IsCompact());
+    REQUIRE(allocator.GetFreeCount() == 48);
+    REQUIRE(allocator.Allocate(48) == 16);
+
+    allocator.Free(16, 48);
+    allocator.Free(0, 16);
+    REQUIRE(allocator.IsCompact());
+    REQUIRE(allocator.Allocate(64) == 0);
+}
+
+TEST_CASE("RadixSort sorts like std::stable_sort on any number of threads", "[radix_sort]")
+{
+    //shaped like DrawList keys: a few passes, layers and pipelines on top, so the top digits repeat
+    //and some passes are skipped, a depth below; values are the submission order, for stability
+    std::mt19937_64 random(1234);
+    const size_t entry_count = 4 * 16384 + 1000; //up to 4 sort workers
+    std::vector<RadixSort::Entry> entries;
+    for(size_t i = 0; i < entry_count; ++i)
+    {
+        const uint64_t key = ((random() % 2) << 58) | ((random() % 16) << 48) | ((random() % 8) << 36) | (random() % (1 << 24));
+        entries.push_back({key, i});
+    }
+    std::vector<RadixSort::Entry> expected = entries;
+    std::stable_sort(expected.begin(), expected.end(), [](const RadixSort::Entry& a, const RadixSort::Entry& b) { return a.key < b.key; });
+
+    for(const uint32_t sort_threads : {1u, 2u, 3u, 4u, 8u})
+    {
+        RadixSort sort;
+        sort.Init(sort_threads);
+        std::vector<RadixSort::Entry> sorted = entries;
+        sort.Sort(sorted);
+
+        REQUIRE(sorted.size() == expected.size());
+        for(size_t i = 0; i < expected.size(); ++i)
+        {
+            if((sorted[i].key != expected[i].key) || (sorted[i].value != expected[i].value))
+            {
+                FAIL("sort threads " << sort_threads << ", entry " << i << " out of order");
+            }
+        }
+    }
+}
+
+TEST_CASE("ShaderPermutations packs the set's feature bits into dense variant indices", "[shader_permutations]")
+{
+    //linear to sRGB and clustered lighting, object colour is left out
+    const uint32_t set_features = SHADER_FEATURE_LINEAR_TO_SRGB | SHADER_FEATURE_CLUSTERED_LIGHTING;
+    REQUIRE(ShaderPermutations::Compact(0, set_features) == 0);
+    REQUIRE(ShaderPermutations::Compact(SHADER_FEATURE_LINEAR_TO_SRGB, set_features) == 1);
+    REQUIRE(ShaderPermutations::Compact(SHADER_FEATURE_CLUSTERED_LIGHTING, set_features) == 2);
+    REQUIRE(ShaderPermutations::Compact(set_features, set_features) == 3);
+
+    //bits outside the set don't change the index
+    REQUIRE(ShaderPermutations::Compact(SHADER_FEATURE_OBJECT_COLOUR, set_features) == 0);
+    REQUIRE(ShaderPermutations::Compact(SHADER_FEATURE_OBJECT_COLOUR | SHADER_FEATURE_CLUSTERED_LIGHTING, set_features) == 2);
+
+    //every index of every set maps back to itself
+    for(uint32_t set = 0; set < (1u << SHADER_FEATURE_COUNT); ++set)
+    {
+        uint32_t switch_count = 0;
+        for(uint32_t bits = set; bits != 0; bits &= bits - 1)
+        {
+            ++switch_count;
+        }
+        for(uint32_t index = 0; index < (1u << switch_count); ++index)
+        {
+            const uint32_t features = ShaderPermutations::Expand(index, set);
+            REQUIRE((features & ~set) == 0);
+            REQUIRE(ShaderPermutations::Compact(features, set) == index);
+        }
+    }
+}
+
+//hidden, run explicitly with "[benchmark]", also on CI through a software ICD like lavapipe
+//VIF_BENCHMARK_BUDGET_MS fails the run when the average GPU frame time is over budget
+TEST_CASE("Headless benchmark", "[.][benchmark]")
+{
+    StartupConf conf{};
+    conf.headless = true;
+    conf.width = 640;
+    conf.height = 360;
+    conf.msaa_samples = 1;
+    conf.benchmark_objects = 4096;
+
+    auto&& renderer_framework = RendererFramework::CreateHeadless(conf);
+    REQUIRE(renderer_framework);
+    REQUIRE_NOTHROW(renderer_framework->Init());
+
+    //pipelines and uploads settle during the warm up
+    const uint32_t warm_up_frames = 16;
+    const uint32_t frames = 256;
+    for(uint32_t i = 0; i < warm_up_frames; ++i)
+    {
+        renderer_framework->FinishUpdate();
+    }
+
+    double gpu_ms = 0.0;
+    const auto start = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < frames; ++i)
+    {
+        renderer_framework->FinishUpdate();
+        gpu_ms += renderer_framework->GetGPUFrameTime() * 1e-6;
+    }
+    const double cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const auto& readback = renderer_framework->GetReadback();
+    REQUIRE(readback.frame > warm_up_frames);
+    REQUIRE(readback.pixels.size() == size_t(conf.width) * conf.height * 4);
+
+    WARN("frame " << cpu_ms / frames << " ms, GPU " << gpu_ms / frames << " ms");
+    if(const char* budget = std::getenv("VIF_BENCHMARK_BUDGET_MS"))
+    {
+        CHECK(gpu_ms / frames <= std::atof(budget));
+    }
+
+    REQUIRE_NOTHROW(renderer_framework->Shutdown());
+}